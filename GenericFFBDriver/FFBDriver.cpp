@@ -1,36 +1,25 @@
 
 #include "FFBDriver.h"
 #include "vibration/VibrationController.h"
-#include <fstream>
-
-void LogMessage(const char* msg) {
-#ifdef _DEBUG
-	SYSTEMTIME st;
-	GetSystemTime(&st);
-	char buffer[256];
-
-	sprintf_s(buffer, "[ %04d-%02d-%02d %02d:%02d:%02d.%03d ] %s",
-		st.wYear, st.wMonth, st.wDay,
-		st.wHour, st.wMinute, st.wSecond,
-		st.wMilliseconds, msg);
-
-	printf(buffer);
-
-	std::ofstream outfile;
-	outfile.open("D:\\driverlog.txt", std::ios_base::app);
-	outfile << buffer;
-	outfile.close();
-#endif
+
+using vibration::BinaryLog;
+
+// Failed calls are recorded at LOG_ERROR, every call at LOG_TRACE
+static HRESULT LogResult(uint16_t event, DWORD dwID, HRESULT hr) {
+	if (FAILED(hr))
+		BinaryLog::Write(vibration::LOG_ERROR, vibration::LOG_CALL_FAILED, event, (uint32_t)hr, dwID);
+	return hr;
 }
 
 FFBDriver::FFBDriver()
+	: dwDeviceID(-1)
 {
 }
 
 FFBDriver::~FFBDriver()
 {
-	vibration::VibrationController::Reset(0);
-	vibration::VibrationController::Reset(1);
+	if (dwDeviceID != (DWORD)-1)
+		vibration::VibrationController::DetachDevice(dwDeviceID);
 }
 
 
@@ -56,22 +45,26 @@ HRESULT STDMETHODCALLTYPE FFBDriver::DeviceID(
 {
 	LPDIHIDFFINITINFO lpDIHIDInitInfo = (LPDIHIDFFINITINFO)lpInfo;
 
-#ifdef _DEBUG
-	char buff[100];
-	sprintf_s(buff, "DeviceID\n\tdwDIVer=0x%04x\n\tdwExternalID=0x%04x\n\tfBegin=0x%04x\n\tdwInternalId=0x%04x\n\n",
-		dwDIVer, dwExternalID, fBegin, dwInternalId);
-	LogMessage(buff);
-#endif
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_DEVICE_ID, dwDIVer, dwExternalID, fBegin, dwInternalId);
+
+	if (fBegin) {
+		if (lpDIHIDInitInfo == NULL)
+			return E_INVALIDARG;
 
-	vibration::VibrationController::SetHidDevicePath(lpDIHIDInitInfo->pwszDeviceInterface, dwExternalID);
+		vibration::VibrationController::AttachDevice(dwExternalID, lpDIHIDInitInfo->pwszDeviceInterface);
+		dwDeviceID = dwExternalID;
+	}
+	else {
+		vibration::VibrationController::DetachDevice(dwExternalID);
+		if (dwDeviceID == dwExternalID)
+			dwDeviceID = -1;
+	}
 
 	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE FFBDriver::GetVersions(LPDIDRIVERVERSIONS lpVersions) {
-#ifdef _DEBUG
-	LogMessage("GetVersions\n");
-#endif
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_GET_VERSIONS);
 
 	lpVersions->dwFFDriverVersion = 0x100;
 	lpVersions->dwFirmwareRevision = 0x100;
@@ -79,69 +72,58 @@ HRESULT STDMETHODCALLTYPE FFBDriver::GetVersions(LPDIDRIVERVERSIONS lpVersions)
 
 	return S_OK;
 }
-HRESULT STDMETHODCALLTYPE FFBDriver::Escape(THIS_ DWORD, DWORD, LPDIEFFESCAPE) {
-#ifdef _DEBUG
-	LogMessage("Escape!\n");
-#endif
-	return S_OK;
+HRESULT STDMETHODCALLTYPE FFBDriver::Escape(THIS_ DWORD dwID, DWORD, LPDIEFFESCAPE pesc) {
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_ESCAPE, dwID, pesc != NULL ? pesc->dwCommand : 0);
+	return LogResult(vibration::LOG_ESCAPE, dwID, vibration::VibrationController::Escape(pesc, dwID));
 }
 HRESULT STDMETHODCALLTYPE FFBDriver::SetGain(
 	DWORD dwID,
 	DWORD dwGain) 
 {
-#ifdef _DEBUG
-	char buff[100];
-	sprintf_s(buff, "SetGain\n\tdwID=0x%04x\n\tdwGain=0x%04x\n\n",
-		dwID, dwGain);
-	LogMessage(buff);
-#endif
-
-	/*
-	DWORD newGain = (dwGain / 38);
-	if (newGain > 0xfe)
-		currentGain = 0xfe;
-	else
-		currentGain = (byte)newGain;
-	*/
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_SET_GAIN, dwID, dwGain);
 
-	return S_OK;
+	return LogResult(vibration::LOG_SET_GAIN, dwID, vibration::VibrationController::SetGain(dwGain, dwID));
 }
 
 HRESULT STDMETHODCALLTYPE FFBDriver::SendForceFeedbackCommand(
 	DWORD dwID,
 	DWORD dwCommand) 
 {
-#ifdef _DEBUG
-	char buff[100];
-	sprintf_s(buff, "SendForceFeedbackCommand\n\tdwID=0x%04x\n\tdwCommand=0x%04x\n\n",
-		dwID, dwCommand);
-	LogMessage(buff);
-#endif
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_SEND_COMMAND, dwID, dwCommand);
 
+	HRESULT hr = S_OK;
 	switch (dwCommand) {
 	case DISFFC_RESET:
-		vibration::VibrationController::Reset(dwID);
+		hr = vibration::VibrationController::Reset(dwID);
 		break;
 
 	case DISFFC_STOPALL:
-		vibration::VibrationController::StopAllEffects(dwID);
+		hr = vibration::VibrationController::StopAllEffects(dwID);
 		break;
 
 	case DISFFC_PAUSE:
+		hr = vibration::VibrationController::Pause(dwID);
+		break;
+
 	case DISFFC_CONTINUE:
+		hr = vibration::VibrationController::Continue(dwID);
+		break;
+
 	case DISFFC_SETACTUATORSON:
+		hr = vibration::VibrationController::SetActuators(TRUE, dwID);
+		break;
+
 	case DISFFC_SETACTUATORSOFF:
+		hr = vibration::VibrationController::SetActuators(FALSE, dwID);
 		break;
 	}
 	
-	return S_OK;
+	return LogResult(vibration::LOG_SEND_COMMAND, dwID, hr);
 }
 
-HRESULT STDMETHODCALLTYPE FFBDriver::GetForceFeedbackState(THIS_ DWORD, LPDIDEVICESTATE) {
-#ifdef _DEBUG
-	LogMessage("GetForceFeedbackState!\n");
-#endif
-	return S_OK;
+HRESULT STDMETHODCALLTYPE FFBDriver::GetForceFeedbackState(THIS_ DWORD dwID, LPDIDEVICESTATE pds) {
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_GET_FF_STATE, dwID);
+	return LogResult(vibration::LOG_GET_FF_STATE, dwID, vibration::VibrationController::GetForceFeedbackState(pds, dwID));
 }
 
 HRESULT STDMETHODCALLTYPE FFBDriver::DownloadEffect(
@@ -151,39 +133,25 @@ HRESULT STDMETHODCALLTYPE FFBDriver::DownloadEffect(
 	LPCDIEFFECT peff,
 	DWORD       dwFlags) 
 {
-#ifdef _DEBUG
-	char buff[100];
-	sprintf_s(buff, "DownloadEffect\n\tdwID=0x%04x\n\tdwEffectID=0x%04x\n\tdwFlags=0x%04x\n\n",
-		dwID, dwEffectID, dwFlags);
-
-	LogMessage(buff);
-#endif
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_DOWNLOAD_EFFECT, dwID, dwEffectID, *pdwEffect, dwFlags);
 
-	vibration::VibrationController::StartEffect(dwEffectID, peff, dwID);
-	return S_OK;
+	return LogResult(vibration::LOG_DOWNLOAD_EFFECT, dwID,
+		vibration::VibrationController::DownloadEffect(dwEffectID, pdwEffect, peff, dwFlags, dwID));
 }
 
-HRESULT STDMETHODCALLTYPE FFBDriver::DestroyEffect(DWORD, DWORD) {
-#ifdef _DEBUG
-	LogMessage("DestroyEffect!\n");
-#endif
-	return S_OK;
+HRESULT STDMETHODCALLTYPE FFBDriver::DestroyEffect(DWORD dwID, DWORD dwEffect) {
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_DESTROY_EFFECT, dwID, dwEffect);
+	return LogResult(vibration::LOG_DESTROY_EFFECT, dwID, vibration::VibrationController::DestroyEffect(dwEffect, dwID));
 }
-HRESULT STDMETHODCALLTYPE FFBDriver::StartEffect(DWORD, DWORD, DWORD, DWORD) {
-#ifdef _DEBUG
-	LogMessage("StartEffect!\n");
-#endif
-	return S_OK;
+HRESULT STDMETHODCALLTYPE FFBDriver::StartEffect(DWORD dwID, DWORD dwEffect, DWORD dwMode, DWORD dwCount) {
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_START_EFFECT, dwID, dwEffect, dwMode, dwCount);
+	return LogResult(vibration::LOG_START_EFFECT, dwID, vibration::VibrationController::StartEffect(dwEffect, dwMode, dwCount, dwID));
 }
 HRESULT STDMETHODCALLTYPE FFBDriver::StopEffect(DWORD dwID, DWORD dwEffect) {
-#ifdef _DEBUG
-	LogMessage("StopEffect!\n");
-#endif
-	return S_OK;
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_STOP_EFFECT, dwID, dwEffect);
+	return LogResult(vibration::LOG_STOP_EFFECT, dwID, vibration::VibrationController::StopEffect(dwEffect, dwID));
 }
-HRESULT STDMETHODCALLTYPE FFBDriver::GetEffectStatus(DWORD, DWORD, LPDWORD) {
-#ifdef _DEBUG
-	LogMessage("GetEffectStatus!\n");
-#endif
-	return S_OK;
+HRESULT STDMETHODCALLTYPE FFBDriver::GetEffectStatus(DWORD dwID, DWORD dwEffect, LPDWORD pdwStatus) {
+	BinaryLog::Write(vibration::LOG_TRACE, vibration::LOG_GET_EFFECT_STATUS, dwID, dwEffect);
+	return LogResult(vibration::LOG_GET_EFFECT_STATUS, dwID, vibration::VibrationController::GetEffectStatus(dwEffect, pdwStatus, dwID));
 }
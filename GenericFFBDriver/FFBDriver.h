@@ -32,5 +32,9 @@ public:
 	HRESULT STDMETHODCALLTYPE StartEffect(DWORD, DWORD, DWORD, DWORD);
 	HRESULT STDMETHODCALLTYPE StopEffect(DWORD, DWORD);
 	HRESULT STDMETHODCALLTYPE GetEffectStatus(DWORD, DWORD, LPDWORD);
+
+private:
+	// External ID of the device this instance was attached to by DeviceID
+	DWORD dwDeviceID;
 };
 
@@ -0,0 +1,76 @@
+#include "HidTransport.h"
+#include <Hidsdi.h>
+#include <algorithm>
+
+namespace vibration {
+
+	HidTransport::HidTransport(const std::wstring& devicePath)
+		: io(NULL), completion(NULL)
+	{
+		hHidDevice = CreateFile(
+			devicePath.c_str(),
+			GENERIC_WRITE | GENERIC_READ,
+			FILE_SHARE_WRITE | FILE_SHARE_READ,
+			NULL,
+			OPEN_EXISTING,
+			FILE_FLAG_OVERLAPPED,
+			NULL);
+
+		if (hHidDevice == INVALID_HANDLE_VALUE)
+			return;
+
+		// WriteFile wants exactly OutputReportByteLength bytes
+		PHIDP_PREPARSED_DATA preparsed;
+		if (HidD_GetPreparsedData(hHidDevice, &preparsed)) {
+			HIDP_CAPS caps;
+			if (HidP_GetCaps(preparsed, &caps) == HIDP_STATUS_SUCCESS)
+				writeBuffer.resize(caps.OutputReportByteLength);
+			HidD_FreePreparsedData(preparsed);
+		}
+
+		io = CreateThreadpoolIo(hHidDevice, HidTransport::IoCompletion, this, NULL);
+	}
+
+	HidTransport::~HidTransport()
+	{
+		if (io != NULL) {
+			CancelIoEx(hHidDevice, NULL);
+			WaitForThreadpoolIoCallbacks(io, FALSE);
+			CloseThreadpoolIo(io);
+		}
+
+		if (hHidDevice != INVALID_HANDLE_VALUE)
+			CloseHandle(hHidDevice);
+	}
+
+	bool HidTransport::BeginWrite(const uint8_t* buff, size_t buffsz, IWriteCompletion& completion)
+	{
+		if (io == NULL)
+			return false;
+
+		if (writeBuffer.size() < buffsz)
+			writeBuffer.resize(buffsz);
+		std::fill(writeBuffer.begin(), writeBuffer.end(), 0);
+		memcpy(writeBuffer.data(), buff, buffsz);
+
+		this->completion = &completion;
+		ZeroMemory(&overlapped, sizeof(overlapped));
+
+		StartThreadpoolIo(io);
+		if (!WriteFile(hHidDevice, writeBuffer.data(), (DWORD)writeBuffer.size(), NULL, &overlapped)
+			&& GetLastError() != ERROR_IO_PENDING) {
+			CancelThreadpoolIo(io);
+			return false;
+		}
+
+		return true;
+	}
+
+	VOID CALLBACK HidTransport::IoCompletion(PTP_CALLBACK_INSTANCE instance, PVOID context,
+		PVOID pOverlapped, ULONG ioResult, ULONG_PTR bytesTransferred, PTP_IO io)
+	{
+		HidTransport* transport = (HidTransport*)context;
+		transport->completion->OnWriteComplete(ioResult == NO_ERROR);
+	}
+
+}
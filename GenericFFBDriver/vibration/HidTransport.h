@@ -0,0 +1,30 @@
+#pragma once
+#include "../stdafx.h"
+#include "../../VibrationCore/ReportTransport.h"
+#include <string>
+#include <vector>
+
+namespace vibration {
+
+	// Overlapped WriteFile on the adapter; completions arrive on the
+	// thread pool. Reports are padded to the device output report length.
+	class HidTransport : public IReportTransport
+	{
+	public:
+		HidTransport(const std::wstring& devicePath);
+		~HidTransport();
+
+		bool BeginWrite(const uint8_t* buff, size_t buffsz, IWriteCompletion& completion) override;
+
+	private:
+		static VOID CALLBACK IoCompletion(PTP_CALLBACK_INSTANCE instance, PVOID context,
+			PVOID pOverlapped, ULONG ioResult, ULONG_PTR bytesTransferred, PTP_IO io);
+
+		HANDLE hHidDevice;
+		PTP_IO io;
+		OVERLAPPED overlapped;
+		std::vector<byte> writeBuffer;
+		IWriteCompletion* completion;
+	};
+
+}
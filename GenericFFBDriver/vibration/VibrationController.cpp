@@ -1,337 +1,401 @@
 #include "VibrationController.h"
-#include <algorithm>
-#include <Hidsdi.h>
-
-#define DISABLE_INFINITE_VIBRATION
-
-#define MAX_EFFECTS 5
-#define MAXC(a, b) ((a) > (b) ? (a) : (b))
+#include <cstring>
+#include <cwctype>
+
+// Reports per second sent to each port, overridable with the MaxReportRate
+// DWORD of the OEM key (0 disables the limit)
+#define DEFAULT_MAX_REPORT_RATE 125
+#define OEM_KEY "SYSTEM\\CurrentControlSet\\Control\\MediaProperties\\PrivateProperties\\Joystick\\OEM\\VID_0810&PID_0001"
+
+// BinaryLog file and level while a device is attached, overridable with the
+// LogPath string and LogLevel DWORD of the OEM key (LogLevel values)
+#define DEFAULT_LOG_PATH "%TEMP%\\GenericFFBDriver.vblog"
+#ifdef _DEBUG
+#define DEFAULT_LOG_LEVEL LOG_TRACE
+#else
+#define DEFAULT_LOG_LEVEL LOG_OFF
+#endif
 
 namespace vibration {
-	bool quitVibrationThread[2] = { false };
 
-	void SendHidCommand(HANDLE hHidDevice, const byte* buff, DWORD buffsz) {
-		HidD_SetOutputReport(hHidDevice, (PVOID)buff, 5);
-	}
-	void SendVibrationForce(HANDLE hHidDevice, byte forceSmallMotor, byte forceBigMotor, DWORD dwID) {
-		byte buffer1[] = {
-			0x00, 0x01, 0x00, forceBigMotor, forceSmallMotor
-		};
-		buffer1[0] = (byte) dwID + 1;
-		SendHidCommand(hHidDevice, buffer1, 5);
-	}
-	void SendVibrationStop(HANDLE hHidDevice, DWORD dwID) {
-		byte GP_STOP_COMMAND[] = {
-			0x00, 0x01, 0x00, 0x00, 0x00
-		};
-		GP_STOP_COMMAND[0] = (byte) dwID + 1;
-		SendHidCommand(hHidDevice, GP_STOP_COMMAND, 5);
+	static_assert(sizeof(LONG) == sizeof(int32_t), "DIEFFECT directions must be 32 bits");
+	static_assert(sizeof(DICONSTANTFORCE) == sizeof(ConstantForce), "ConstantForce must match DICONSTANTFORCE");
+	static_assert(sizeof(DIRAMPFORCE) == sizeof(RampForce), "RampForce must match DIRAMPFORCE");
+	static_assert(sizeof(DIPERIODIC) == sizeof(PeriodicForce), "PeriodicForce must match DIPERIODIC");
+	static_assert(sizeof(DIENVELOPE) == sizeof(Envelope), "Envelope must match DIENVELOPE");
+	static_assert(sizeof(DICUSTOMFORCE) == sizeof(CustomForce), "CustomForce must match DICUSTOMFORCE");
+	static_assert(INFINITE == EFFECT_INFINITE, "EFFECT_INFINITE must match INFINITE");
+	static_assert(DIEP_START == DOWNLOAD_START && DIEP_NORESTART == DOWNLOAD_NORESTART, "Download flags must match DIEP_*");
+	static_assert(DIES_SOLO == START_SOLO, "START_SOLO must match DIES_SOLO");
+	static_assert(DIGFFS_EMPTY == STATE_EMPTY && DIGFFS_STOPPED == STATE_STOPPED && DIGFFS_PAUSED == STATE_PAUSED
+		&& DIGFFS_ACTUATORSON == STATE_ACTUATORS_ON && DIGFFS_ACTUATORSOFF == STATE_ACTUATORS_OFF
+		&& DIGFFS_POWERON == STATE_POWER_ON && DIGFFS_SAFETYSWITCHON == STATE_SAFETY_SWITCH_ON
+		&& DIGFFS_USERFFSWITCHON == STATE_USER_FF_SWITCH_ON, "STATE_* must match DIGFFS_*");
+	static_assert(DISFFC_RESET == DEVICE_RESET && DISFFC_STOPALL == DEVICE_STOP_ALL && DISFFC_PAUSE == DEVICE_PAUSE
+		&& DISFFC_CONTINUE == DEVICE_CONTINUE && DISFFC_SETACTUATORSON == DEVICE_ACTUATORS_ON
+		&& DISFFC_SETACTUATORSOFF == DEVICE_ACTUATORS_OFF, "DeviceCommand must match DISFFC_*");
+
+	std::mutex VibrationController::mtxAttach;
+	std::mutex VibrationController::mtxSync;
+	SteadyClock VibrationController::clock;
+	OutputScheduler VibrationController::scheduler(VibrationController::clock);
+	DeviceRegistry VibrationController::registry(VibrationController::clock, VibrationController::scheduler);
+	EffectTraceWriter VibrationController::trace;
+
+	VibrationController::VibrationController()
+	{
 	}
 
-	struct VibrationEff {
-		DWORD dwEffectId;
-		DWORD dwStartFrame;
-		DWORD dwStopFrame;
 
-		byte forceX;
-		byte forceY;
+	VibrationController::~VibrationController()
+	{
+	}
 
-		BOOL isActive;
-		BOOL started;
-	};
+	DWORD VibrationController::ReadMaxReportRate()
+	{
+		DWORD rate = DEFAULT_MAX_REPORT_RATE;
+		DWORD size = sizeof(rate);
 
-	HANDLE hHidDevice[2];
-	VibrationEff VibEffects[MAX_EFFECTS][2];
-	std::map<std::thread::id, DWORD> ThreadRef;
+		if (RegGetValueA(HKEY_LOCAL_MACHINE, OEM_KEY, "MaxReportRate", RRF_RT_REG_DWORD, NULL, &rate, &size) != ERROR_SUCCESS)
+			rate = DEFAULT_MAX_REPORT_RATE;
 
-	std::vector<std::wstring> VibrationController::hidDevPath;
-	std::mutex VibrationController::mtxSync;
-	std::unique_ptr<std::thread, VibrationController::VibrationThreadDeleter> VibrationController::thrVibration[2];
+		return rate;
+	}
 
-	VibrationController::VibrationController()
+	// MixMode values, MIX_MAX when unset
+	DWORD VibrationController::ReadMixMode()
 	{
-	}
+		DWORD mode = MIX_MAX;
+		DWORD size = sizeof(mode);
 
+		if (RegGetValueA(HKEY_LOCAL_MACHINE, OEM_KEY, "MixMode", RRF_RT_REG_DWORD, NULL, &mode, &size) != ERROR_SUCCESS
+			|| mode >= MIX_MODE_COUNT)
+			mode = MIX_MAX;
 
-	VibrationController::~VibrationController()
+		return mode;
+	}
+
+	void VibrationController::OpenLog()
 	{
+		DWORD level = DEFAULT_LOG_LEVEL;
+		DWORD size = sizeof(level);
+
+		if (RegGetValueA(HKEY_LOCAL_MACHINE, OEM_KEY, "LogLevel", RRF_RT_REG_DWORD, NULL, &level, &size) != ERROR_SUCCESS)
+			level = DEFAULT_LOG_LEVEL;
+		if (level == LOG_OFF)
+			return;
+		if (level > LOG_TRACE)
+			level = LOG_TRACE;
+
+		// REG_EXPAND_SZ values come back expanded
+		CHAR path[MAX_PATH];
+		size = sizeof(path);
+		if (RegGetValueA(HKEY_LOCAL_MACHINE, OEM_KEY, "LogPath", RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ, NULL, path, &size) != ERROR_SUCCESS) {
+			DWORD length = ExpandEnvironmentStringsA(DEFAULT_LOG_PATH, path, MAX_PATH);
+			if (length == 0 || length > MAX_PATH)
+				return;
+		}
+
+		BinaryLog::Open(path, (uint8_t)level, clock);
 	}
 
-	void VibrationController::StartVibrationThread(DWORD dwID)
+	// Effect calls are only traced when the OEM key has a TracePath string
+	void VibrationController::OpenTrace()
 	{
-		mtxSync.lock();
-		if (thrVibration[dwID] == NULL) {
-			quitVibrationThread[dwID] = false;
+		CHAR path[MAX_PATH];
+		DWORD size = sizeof(path);
+
+		if (RegGetValueA(HKEY_LOCAL_MACHINE, OEM_KEY, "TracePath", RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ, NULL, path, &size) == ERROR_SUCCESS)
+			trace.Open(path, clock);
+	}
 
-			for (int k = 0; k < MAX_EFFECTS; k++) {
-				VibEffects[k][dwID].isActive = FALSE;
-				VibEffects[k][dwID].dwEffectId = -1;
+	// Each adapter exposes one top level collection per port
+	// (...&col01... and ...&col02...), which selects the report ID.
+	DWORD VibrationController::PortFromDevicePath(LPCWSTR path, DWORD dwExternalID)
+	{
+		for (LPCWSTR p = path; p != NULL && p[0] != L'\0'; p++) {
+			if (p[0] == L'&'
+				&& towlower(p[1]) == L'c' && towlower(p[2]) == L'o' && towlower(p[3]) == L'l'
+				&& iswdigit(p[4]) && iswdigit(p[5])) {
+				DWORD col = (p[4] - L'0') * 10 + (p[5] - L'0');
+				if (col > 0)
+					return col - 1;
 			}
-			
-			thrVibration[dwID].reset(new std::thread(VibrationController::VibrationThreadEntryPoint, dwID));
-			
 		}
 
-		mtxSync.unlock();
+		return dwExternalID % 2;
 	}
 
-	void VibrationController::VibrationThreadEntryPoint(DWORD dwID)
-	{	
-		mtxSync.lock();
-		
-		ThreadRef.insert(std::make_pair(std::this_thread::get_id(), dwID));
-		
-		mtxSync.unlock();
-
-		// Initialization
-		hHidDevice[dwID] = CreateFile(
-			hidDevPath[dwID].c_str(),
-			GENERIC_WRITE | GENERIC_READ,
-			FILE_SHARE_WRITE | FILE_SHARE_READ,
-			NULL,
-			OPEN_EXISTING,
-			FILE_FLAG_OVERLAPPED,
-			NULL);
-
-		byte lastForceX = 0;
-		byte lastForceY = 0;
-
-		while (true) {
-			mtxSync.lock();
-
-			if (quitVibrationThread[dwID]) {
-				mtxSync.unlock();
-				break;
-			}
+	void VibrationController::AttachDevice(DWORD dwID, LPCWSTR path)
+	{
+		std::lock_guard<std::mutex> attachLock(mtxAttach);
 
-			DWORD frame = GetTickCount();
-			byte forceX = 0;
-			byte forceY = 0;
-
-			for (int k = 0; k < MAX_EFFECTS; k++) {
-				if (!VibEffects[k][dwID].isActive)
-					continue;
-
-				if (VibEffects[k][dwID].started) {
-
-					if (VibEffects[k][dwID].dwStopFrame != INFINITE) {
-
-						if (VibEffects[k][dwID].dwStopFrame <= frame) {
-							VibEffects[k][dwID].isActive = FALSE;
-						}
-						else {
-							forceX = MAXC(forceX, VibEffects[k][dwID].forceX);
-							forceY = MAXC(forceY, VibEffects[k][dwID].forceY);
-						}
-					}
-					else {
-						forceX = MAXC(forceX, VibEffects[k][dwID].forceX);
-						forceY = MAXC(forceY, VibEffects[k][dwID].forceY);
-					}
-				}
-				else {
-					if (VibEffects[k][dwID].dwStartFrame <= frame) {
-						VibEffects[k][dwID].started = TRUE;
-						
-						if (VibEffects[k][dwID].dwStopFrame != INFINITE) {
-							DWORD frmStart = VibEffects[k][dwID].dwStartFrame;
-							DWORD frmStop = VibEffects[k][dwID].dwStopFrame;
-
-							DWORD dt = frmStart <= frmStop ? frmStop - frmStart : frmStart + 100;
-
-							VibEffects[k][dwID].dwStopFrame = frame + dt;
-						}
-#ifdef DISABLE_INFINITE_VIBRATION
-						else {
-							VibEffects[k][dwID].dwStopFrame = frame + 1000;
-						}
-#endif
+		// The log and the trace run while any device is attached
+		bool first = registry.GetCount() == 0;
+		if (first) {
+			OpenLog();
+			OpenTrace();
+		}
 
+		DWORD dwPort = PortFromDevicePath(path, dwID);
+		DWORD rate = ReadMaxReportRate();
+		DWORD mode = ReadMixMode();
+		BinaryLog::Write(LOG_INFO, LOG_ATTACH, dwID, dwPort);
 
-						forceX = MAXC(forceX, VibEffects[k][dwID].forceX);
-						forceY = MAXC(forceY, VibEffects[k][dwID].forceY);
-					}
-				}
-			}
+		// Opens the device before taking the lock of the effect calls
+		std::unique_ptr<IReportTransport> transport(new HidTransport(path));
 
-			if (forceX != lastForceX || forceY != lastForceY) {
-				// Send the command
-				if (forceX == 0 && forceY == 0)
-					SendVibrationStop(hHidDevice[dwID], dwID);
-				else
-					SendVibrationForce(hHidDevice[dwID], forceX, forceY, dwID);
+		// A port of an earlier attach under the same ID sends its stop
+		// report before the new one starts
+		std::unique_ptr<DeviceRegistry::PortDevice> replaced;
+		{
+			std::lock_guard<std::mutex> lock(mtxSync);
+			replaced = registry.Unlink(dwID);
+		}
+		registry.Release(std::move(replaced));
 
-				lastForceX = forceX;
-				lastForceY = forceY;
-			}
+		std::lock_guard<std::mutex> lock(mtxSync);
+		trace.DeviceID(dwID, true, dwPort, rate, mode);
 
-			mtxSync.unlock();
+		VibrationPort& port = registry.Register(dwID, dwPort, std::move(transport));
+		port.SetMaxReportRate(rate);
+		port.SetMixMode((uint8_t)mode);
+	}
 
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
-		}
+	void VibrationController::DetachDevice(DWORD dwID)
+	{
+		std::lock_guard<std::mutex> attachLock(mtxAttach);
+
+		std::unique_ptr<DeviceRegistry::PortDevice> dev;
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mtxSync);
+			dev = registry.Unlink(dwID);
+			if (dev == NULL)
+				return;
 
-		if (hHidDevice[dwID] != NULL) {
-			SendVibrationStop(hHidDevice[dwID], dwID);
-			CloseHandle(hHidDevice[dwID]);
+			trace.DeviceID(dwID, false, 0, 0, 0);
+			last = registry.GetCount() == 0;
 		}
+
+		// Waits for the stop report to reach the device
+		registry.Release(std::move(dev));
+
+		if (last)
+			trace.Close();
+
+		BinaryLog::Write(LOG_INFO, LOG_DETACH, dwID);
+		if (last)
+			BinaryLog::Close();
 	}
 
-	void VibrationController::SetHidDevicePath(LPWSTR path, DWORD dwID)
+	HRESULT VibrationController::DownloadEffect(DWORD dwEffectID, LPDWORD pdwEffect, LPCDIEFFECT peff, DWORD dwFlags, DWORD dwID)
 	{
-		hidDevPath.push_back(path);
-		Reset(dwID);
+		EffectDesc eff;
+		eff.dwDuration = peff->dwDuration;
+		eff.dwGain = peff->dwGain;
+		eff.dwStartDelay = peff->dwStartDelay;
+		eff.cAxes = peff->cAxes;
+		eff.rglDirection = (const int32_t*)peff->rglDirection;
+		eff.cbTypeSpecificParams = peff->cbTypeSpecificParams;
+		eff.lpvTypeSpecificParams = peff->lpvTypeSpecificParams;
+		eff.lpEnvelope = (const Envelope*)peff->lpEnvelope;
+		eff.dwSamplePeriod = peff->dwSamplePeriod;
+
+		// DIEFFECT has no priority, ranked by duration
+		eff.dwPriority = 0;
+
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
+
+		// An evicted effect is downloaded again under a new handle
+		uint32_t dwHandle = *pdwEffect;
+		if (dwHandle != 0 && !port->IsEffectHandle(dwHandle))
+			dwHandle = 0;
+
+		bool downloaded = port->DownloadEffect(dwEffectID, eff, dwHandle, dwFlags);
+		trace.DownloadEffect(dwID, dwEffectID, eff, dwFlags, *pdwEffect, downloaded ? dwHandle : 0);
+		if (!downloaded)
+			return DIERR_DEVICEFULL;
+
+		*pdwEffect = dwHandle;
+		return S_OK;
 	}
 
-	void VibrationController::StartEffect(DWORD dwEffectID, LPCDIEFFECT peff, DWORD dwID)
+	HRESULT VibrationController::StartEffect(DWORD dwEffect, DWORD dwMode, DWORD dwCount, DWORD dwID)
 	{
-		mtxSync.lock();
-
-		int idx = -1;
-		// Reusing the same idx if effect was already created
-		for (int k = 0; k < MAX_EFFECTS; k++) {
-			if (VibEffects[k][dwID].dwEffectId == dwEffectID) {
-				idx = k;
-				break;
-			}
-		}
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
 
-		// Find a non-active idx
-		if (idx < 0) {
-			for (int k = 0; k < MAX_EFFECTS; k++) {
-				if (!VibEffects[k][dwID].isActive || k == MAX_EFFECTS - 1) {
-					idx = k;
-					break;
-				}
-			}
-		}
+		trace.StartEffect(dwID, dwEffect, dwMode, dwCount);
 
-		// Calculating intensity
-		byte forceX = 0xfe;
-		byte forceY = 0xfe;
+		if (!port->IsEffectHandle(dwEffect))
+			return DIERR_INVALIDPARAM;
 
-		byte magnitude = 0xfe;
-		if (peff->cbTypeSpecificParams == 4) {
-			LPDICONSTANTFORCE effParams = (LPDICONSTANTFORCE)peff->lpvTypeSpecificParams;
-			double mag = (((double)effParams->lMagnitude) + 10000.0) / 20000.0;
+		return port->StartEffect(dwEffect, dwMode & DIES_SOLO, dwCount) ? S_OK : DIERR_DEVICEFULL;
+	}
 
-			magnitude = (byte)(round(mag * 254.0));
-		}
+	HRESULT VibrationController::StopEffect(DWORD dwEffect, DWORD dwID)
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
 
-		if (peff->cAxes == 1) {
-			// If direction is negative, then it is a forceX
-			// Otherwise it is a forceY
-			LONG direction = peff->rglDirection[0];
-			static byte lastForceX = 0;
-			static byte lastForceY = 0;
+		trace.StopEffect(dwID, dwEffect);
 
-			forceX = lastForceX;
-			forceY = lastForceY;
+		// Nothing left to stop for an evicted effect
+		if (!port->IsEffectHandle(dwEffect))
+			return S_OK;
 
-			if (direction == -1) {
-				//forceX = lastForceX = (byte)(round((((double)peff->dwGain) / 10000.0) * 254.0));
-				forceX = lastForceX = magnitude;
-			}
-			else if (direction == 1) {
-				//forceY = lastForceY = (byte)(round((((double)peff->dwGain) / 10000.0) * 254.0));
-				forceY = lastForceY = magnitude;
-			}
+		return port->StopEffect(dwEffect) ? S_OK : DIERR_DEVICEFULL;
+	}
 
-		}
-		else {
-			if (peff->cAxes >= 1) {
-				LONG fx = peff->rglDirection[0];
-				//if (fx <= 1) fx = peff->dwGain;
-
-				if (fx > 0)
-					forceX = forceY = magnitude;
-				else
-					forceX = forceY = 0;
-			}
+	HRESULT VibrationController::DestroyEffect(DWORD dwEffect, DWORD dwID)
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
 
-			if (peff->cAxes >= 2) {
-				LONG fy = peff->rglDirection[1];
-				//if (fy <= 1) fy = peff->dwGain;
+		trace.DestroyEffect(dwID, dwEffect);
 
-				if (fy > 0)
-					forceY = magnitude;
-				else
-					forceY = 0;
-			}
-		}
+		if (!port->IsEffectHandle(dwEffect))
+			return S_OK;
 
+		return port->DestroyEffect(dwEffect) ? S_OK : DIERR_DEVICEFULL;
+	}
+
+	HRESULT VibrationController::StopAllEffects(DWORD dwID)
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
 
-		DWORD frame = GetTickCount();
+		trace.Command(dwID, DEVICE_STOP_ALL);
 
-		VibEffects[idx][dwID].forceX = forceX;
-		VibEffects[idx][dwID].forceY = forceY;
+		return port->StopAllEffects() ? S_OK : DIERR_DEVICEFULL;
+	}
+
+	HRESULT VibrationController::Reset(DWORD dwID)
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
 
-		VibEffects[idx][dwID].dwEffectId = dwEffectID;
-		VibEffects[idx][dwID].dwStartFrame = frame + (peff->dwStartDelay / 1000);
-		VibEffects[idx][dwID].dwStopFrame =
-			peff->dwDuration == INFINITE ? INFINITE : 
-			VibEffects[idx][dwID].dwStartFrame + (peff->dwDuration / 1000);
-		VibEffects[idx][dwID].isActive = TRUE;
-		VibEffects[idx][dwID].started = FALSE;
+		trace.Command(dwID, DEVICE_RESET);
 
-		mtxSync.unlock();
-		StartVibrationThread(dwID);
+		return port->Reset() ? S_OK : DIERR_DEVICEFULL;
 	}
 
-	void VibrationController::StopEffect(DWORD dwEffectID, DWORD dwID)
+	HRESULT VibrationController::Pause(DWORD dwID)
 	{
-		mtxSync.lock();
-		for (int k = 0; k < MAX_EFFECTS; k++) {
-			if (VibEffects[k][dwID].dwEffectId != dwEffectID)
-				continue;
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
 
-			VibEffects[k][dwID].dwStopFrame = 0;
-		}
-		
-		mtxSync.unlock();
+		trace.Command(dwID, DEVICE_PAUSE);
+
+		return port->Pause() ? S_OK : DIERR_DEVICEFULL;
 	}
 
-	void VibrationController::StopAllEffects(DWORD dwID)
+	HRESULT VibrationController::Continue(DWORD dwID)
 	{
-		mtxSync.lock();
-		for (int k = 0; k < MAX_EFFECTS; k++) {
-			VibEffects[k][dwID].dwStopFrame = 0;
-		}
-		mtxSync.unlock();
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
 
-		Reset(dwID);
+		trace.Command(dwID, DEVICE_CONTINUE);
+
+		return port->Continue() ? S_OK : DIERR_DEVICEFULL;
 	}
 
-	void VibrationController::Reset(DWORD dwID, std::thread* t)
-	{	
-		if (t == NULL)
-		{		
-			if (thrVibration[dwID] == NULL)
-				return;
+	HRESULT VibrationController::SetActuators(BOOL on, DWORD dwID)
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
 
-			quitVibrationThread[dwID] = true;
-			thrVibration[dwID]->join();
-			thrVibration[dwID].reset(NULL);
-
-			for (auto& ref : ThreadRef)
-			{
-				if (ref.second = dwID)
-				{
-					ThreadRef.erase(ref.first);
-					break; 
-				}
-			}
+		trace.Command(dwID, on ? DEVICE_ACTUATORS_ON : DEVICE_ACTUATORS_OFF);
+
+		return port->SetActuators(on != FALSE) ? S_OK : DIERR_DEVICEFULL;
+	}
+
+	HRESULT VibrationController::SetGain(DWORD dwGain, DWORD dwID)
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		VibrationPort* port = registry.Find(dwID);
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
+
+		trace.SetGain(dwID, dwGain);
+
+		port->SetGain(dwGain);
+		return S_OK;
+	}
+
+	// The status queries only read the snapshot the output thread publishes
+	// and find the port through a PortReader, so they never take mtxSync.
+	HRESULT VibrationController::GetEffectStatus(DWORD dwEffect, LPDWORD pdwStatus, DWORD dwID)
+	{
+		DeviceRegistry::PortReader reader(registry, dwID);
+		VibrationPort* port = reader.GetPort();
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
+
+		bool playing;
+		if (!port->GetEffectStatus(dwEffect, playing)) {
+			// Downloaded but not picked up by the output thread yet
+			if (!port->IsEffectHandle(dwEffect))
+				return DIERR_INVALIDPARAM;
+			playing = false;
 		}
-		else {
-			DWORD ldwID = ThreadRef[t->get_id()];
-			
-			if (thrVibration[ldwID] == NULL)
-				return;
-			
-			ThreadRef.erase(t->get_id());
-			quitVibrationThread[ldwID] = true;
-			thrVibration[ldwID]->join();
-			thrVibration[ldwID].reset(NULL);	
+
+		*pdwStatus = playing ? DIEGES_PLAYING : 0;
+		return S_OK;
+	}
+
+	HRESULT VibrationController::GetForceFeedbackState(LPDIDEVICESTATE pds, DWORD dwID)
+	{
+		DeviceRegistry::PortReader reader(registry, dwID);
+		VibrationPort* port = reader.GetPort();
+		if (port == NULL)
+			return DIERR_NOTINITIALIZED;
+
+		PortState state = port->GetState();
+		pds->dwState = state.dwState;
+		pds->dwLoad = state.dwLoad;
+		return S_OK;
+	}
+
+	// ESCAPE_GET_TELEMETRY is the only command, see Telemetry.h
+	HRESULT VibrationController::Escape(LPDIEFFESCAPE pesc, DWORD dwID)
+	{
+		if (pesc->dwCommand != ESCAPE_GET_TELEMETRY)
+			return DIERR_UNSUPPORTED;
+
+		if (pesc->lpvOutBuffer == NULL || pesc->cbOutBuffer < sizeof(PortTelemetry))
+			return DIERR_INVALIDPARAM;
+
+		PortTelemetry telemetry;
+		{
+			std::lock_guard<std::mutex> lock(mtxSync);
+			if (!registry.GetTelemetry(dwID, telemetry))
+				return DIERR_NOTINITIALIZED;
 		}
+
+		memcpy(pesc->lpvOutBuffer, &telemetry, sizeof(telemetry));
+		pesc->cbOutBuffer = sizeof(telemetry);
+		return S_OK;
 	}
 
 }
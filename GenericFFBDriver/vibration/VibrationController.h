@@ -1,42 +1,59 @@
 #pragma once
 #include "../stdafx.h"
-#include <string>
+#include "HidTransport.h"
+#include "../../VibrationCore/VibrationPort.h"
+#include "../../VibrationCore/OutputScheduler.h"
+#include "../../VibrationCore/DeviceRegistry.h"
+#include "../../VibrationCore/BinaryLog.h"
+#include "../../VibrationCore/EffectTrace.h"
 #include <mutex>
-#include <vector>
-#include <map>
 
 namespace vibration {
 
+	// COM side glue: opens the HID device of each attached port and forwards
+	// the DirectInput calls to its engine. Ports are keyed by the external
+	// ID given to DeviceID and all of them are serviced by one shared
+	// OutputScheduler thread.
 	class VibrationController
 	{
-		class VibrationThreadDeleter {
-		public:
-			void operator()(std::thread* t) const {
-				if (t->joinable()) {
-					VibrationController::Reset(0, t);
-				}
-				else
-					delete t;
-			}
-		};
-
-		static std::vector<std::wstring> hidDevPath;
+		// mtxSync guards the registry for the effect calls and keeps their
+		// trace records in order. Attach and detach are serialized by
+		// mtxAttach, taking mtxSync only to change the registry, so the
+		// effect calls never wait on device I/O. The status queries take no
+		// lock at all.
+		static std::mutex mtxAttach;
 		static std::mutex mtxSync;
-		static std::unique_ptr<std::thread, VibrationThreadDeleter> thrVibration[2];
+		static SteadyClock clock;
+		static OutputScheduler scheduler;
+		static DeviceRegistry registry;
+		static EffectTraceWriter trace;
 		
 		VibrationController();
 		~VibrationController();
 
-		static void StartVibrationThread(DWORD dwID);
-		static void VibrationThreadEntryPoint(DWORD dwID);
+		static DWORD ReadMaxReportRate();
+		static DWORD ReadMixMode();
+		static void OpenLog();
+		static void OpenTrace();
+		static DWORD PortFromDevicePath(LPCWSTR path, DWORD dwExternalID);
 
 	public:
-		static void SetHidDevicePath(LPWSTR path, DWORD dwID);
-		static void StartEffect(DWORD dwEffectID, LPCDIEFFECT peff, DWORD dwID);
-		static void StopEffect(DWORD dwEffectID, DWORD dwID);
-		static void StopAllEffects(DWORD dwID);
-		static void Reset(DWORD dwID, std::thread* t = NULL);
+		static void AttachDevice(DWORD dwID, LPCWSTR path);
+		static void DetachDevice(DWORD dwID);
+
+		static HRESULT DownloadEffect(DWORD dwEffectID, LPDWORD pdwEffect, LPCDIEFFECT peff, DWORD dwFlags, DWORD dwID);
+		static HRESULT StartEffect(DWORD dwEffect, DWORD dwMode, DWORD dwCount, DWORD dwID);
+		static HRESULT StopEffect(DWORD dwEffect, DWORD dwID);
+		static HRESULT DestroyEffect(DWORD dwEffect, DWORD dwID);
+		static HRESULT StopAllEffects(DWORD dwID);
+		static HRESULT Reset(DWORD dwID);
+		static HRESULT Pause(DWORD dwID);
+		static HRESULT Continue(DWORD dwID);
+		static HRESULT SetActuators(BOOL on, DWORD dwID);
+		static HRESULT SetGain(DWORD dwGain, DWORD dwID);
+		static HRESULT GetEffectStatus(DWORD dwEffect, LPDWORD pdwStatus, DWORD dwID);
+		static HRESULT GetForceFeedbackState(LPDIDEVICESTATE pds, DWORD dwID);
+		static HRESULT Escape(LPDIEFFESCAPE pesc, DWORD dwID);
 	};
 
 }
-
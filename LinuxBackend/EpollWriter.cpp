@@ -0,0 +1,213 @@
+#include "EpollWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace vibration {
+
+	static const int MAX_EVENTS = 16;
+
+	EpollWriter::EpollWriter()
+		: epfd(-1), wakefd(-1), quit(false), dispatchingFd(-1), waits(0)
+	{
+		epfd = epoll_create1(EPOLL_CLOEXEC);
+		wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (epfd < 0 || wakefd < 0) {
+			if (epfd >= 0)
+				close(epfd);
+			if (wakefd >= 0)
+				close(wakefd);
+			epfd = -1;
+			wakefd = -1;
+			return;
+		}
+
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = wakefd;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+
+		thrWriter = std::thread(&EpollWriter::ThreadEntryPoint, this);
+	}
+
+	EpollWriter::~EpollWriter()
+	{
+		if (epfd < 0)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mtxWaiters);
+			quit = true;
+		}
+		Wake();
+		thrWriter.join();
+
+		close(wakefd);
+		close(epfd);
+	}
+
+	bool EpollWriter::Post(int fd, IWritable& target)
+	{
+		if (epfd < 0)
+			return false;
+
+		{
+			std::lock_guard<std::mutex> lock(mtxWaiters);
+			posted.push_back({ fd, &target });
+		}
+		Wake();
+		return true;
+	}
+
+	bool EpollWriter::WaitWritable(int fd, IWritable& target)
+	{
+		if (epfd < 0)
+			return false;
+
+		std::lock_guard<std::mutex> lock(mtxWaiters);
+		std::vector<IWritable*>& list = waiters[fd];
+		list.push_back(&target);
+		waits++;
+
+		// The descriptor is armed by its first waiter; a dispatch takes the
+		// whole list
+		if (list.size() > 1)
+			return true;
+
+		epoll_event ev = {};
+		ev.events = EPOLLOUT | EPOLLONESHOT;
+		ev.data.fd = fd;
+
+		// A closed descriptor leaves the epoll set by itself, its number
+		// may come back for another file
+		bool armed = registered.count(fd) != 0 && epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+		if (!armed && epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			waiters.erase(fd);
+			return false;
+		}
+
+		registered.insert(fd);
+		return true;
+	}
+
+	bool EpollWriter::Cancel(int fd, IWritable& target)
+	{
+		std::unique_lock<std::mutex> lock(mtxWaiters);
+
+		// The writer thread itself cancels from within a callback
+		if (std::this_thread::get_id() != thrWriter.get_id())
+			cvDispatched.wait(lock, [this, fd] { return dispatchingFd != fd; });
+
+		for (auto pos = posted.begin(); pos != posted.end(); ++pos) {
+			if (pos->fd == fd && pos->target == &target) {
+				posted.erase(pos);
+				return true;
+			}
+		}
+
+		auto it = waiters.find(fd);
+		if (it == waiters.end())
+			return false;
+
+		std::vector<IWritable*>& list = it->second;
+		auto pos = std::find(list.begin(), list.end(), &target);
+		if (pos == list.end())
+			return false;
+
+		list.erase(pos);
+		if (list.empty()) {
+			waiters.erase(it);
+			registered.erase(fd);
+			epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+		}
+		return true;
+	}
+
+	void EpollWriter::ThreadEntryPoint()
+	{
+		epoll_event events[MAX_EVENTS];
+
+		while (true) {
+			int count = epoll_wait(epfd, events, MAX_EVENTS, -1);
+			if (count < 0) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+
+			for (int k = 0; k < count; k++) {
+				if (events[k].data.fd != wakefd) {
+					Dispatch(events[k].data.fd);
+					continue;
+				}
+
+				uint64_t value;
+				while (read(wakefd, &value, sizeof(value)) < 0 && errno == EINTR) {}
+				{
+					std::lock_guard<std::mutex> lock(mtxWaiters);
+					if (quit)
+						return;
+				}
+				DispatchPosted();
+			}
+		}
+	}
+
+	void EpollWriter::Dispatch(int fd)
+	{
+		std::vector<IWritable*> ready;
+		{
+			std::lock_guard<std::mutex> lock(mtxWaiters);
+			auto it = waiters.find(fd);
+			if (it == waiters.end())
+				return;
+
+			ready.swap(it->second);
+			waiters.erase(it);
+			dispatchingFd = fd;
+		}
+
+		// Targets that still cannot write wait again from here
+		for (IWritable* target : ready)
+			target->OnWritable();
+
+		{
+			std::lock_guard<std::mutex> lock(mtxWaiters);
+			dispatchingFd = -1;
+		}
+		cvDispatched.notify_all();
+	}
+
+	void EpollWriter::DispatchPosted()
+	{
+		while (true) {
+			Posted next;
+			{
+				std::lock_guard<std::mutex> lock(mtxWaiters);
+				if (posted.empty())
+					return;
+
+				next = posted.front();
+				posted.pop_front();
+				dispatchingFd = next.fd;
+			}
+
+			next.target->OnWritable();
+
+			{
+				std::lock_guard<std::mutex> lock(mtxWaiters);
+				dispatchingFd = -1;
+			}
+			cvDispatched.notify_all();
+		}
+	}
+
+	void EpollWriter::Wake()
+	{
+		uint64_t one = 1;
+		while (write(wakefd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+	}
+
+}
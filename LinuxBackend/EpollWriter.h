@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace vibration {
+
+	class IWritable
+	{
+	public:
+		virtual ~IWritable() {}
+		virtual void OnWritable() = 0;
+	};
+
+	// Runs the writes of its targets on one thread, so that callers never
+	// block in write(), and waits there for non-blocking descriptors that
+	// refused a write to accept data again. Any number of targets may wait
+	// on the same descriptor, such as the two ports of an adapter sharing
+	// its hidraw node; each is called once per Post or WaitWritable.
+	class EpollWriter
+	{
+	public:
+		EpollWriter();
+		~EpollWriter();
+
+		bool IsOpen() const { return epfd >= 0; }
+
+		// Calls target.OnWritable from the writer thread, in Post order,
+		// for a write to fd. False if the thread is not running.
+		bool Post(int fd, IWritable& target);
+
+		// Calls target.OnWritable from the writer thread once fd is
+		// writable. False if fd cannot be polled.
+		bool WaitWritable(int fd, IWritable& target);
+
+		// Forgets the post or the wait of target on fd, once no callback for
+		// fd runs. True if the target was still queued or waiting.
+		bool Cancel(int fd, IWritable& target);
+
+		// Times a write had to wait for its descriptor
+		uint64_t GetWaitCount() const { return waits; }
+
+	private:
+		struct Posted {
+			int fd;
+			IWritable* target;
+		};
+
+		void ThreadEntryPoint();
+		void Dispatch(int fd);
+		void DispatchPosted();
+		void Wake();
+
+		int epfd;
+		int wakefd;
+
+		std::mutex mtxWaiters;
+		std::condition_variable cvDispatched;
+		std::unordered_map<int, std::vector<IWritable*>> waiters;
+		std::deque<Posted> posted;
+		bool quit;
+
+		// Descriptors added to the epoll set, polled one shot
+		std::unordered_set<int> registered;
+		int dispatchingFd;
+
+		std::atomic<uint64_t> waits;
+		std::thread thrWriter;
+	};
+
+}
@@ -0,0 +1,235 @@
+#include "FFEffectTable.h"
+#include <cerrno>
+
+namespace vibration {
+
+	// ff_effect levels are signed 16-bit, envelope levels 0..0x7fff
+	static int32_t LevelFromFF(int32_t level)
+	{
+		int32_t scaled = level * 10000 / 0x7FFF;
+		return scaled < -10000 ? -10000 : scaled;
+	}
+
+	// Rumble magnitudes are 0..0xFFFF, off to full force
+	static int32_t LevelFromRumble(uint16_t magnitude)
+	{
+		return (int32_t)((uint32_t)magnitude * 20000 / 0xFFFF) - 10000;
+	}
+
+	static void SetEnvelope(const ff_envelope& in, Envelope& out)
+	{
+		out.dwSize = sizeof(Envelope);
+		out.dwAttackLevel = (uint32_t)LevelFromFF(in.attack_level > 0x7FFF ? 0x7FFF : in.attack_level);
+		out.dwAttackTime = in.attack_length * 1000u;
+		out.dwFadeLevel = (uint32_t)LevelFromFF(in.fade_level > 0x7FFF ? 0x7FFF : in.fade_level);
+		out.dwFadeTime = in.fade_length * 1000u;
+	}
+
+	FFEffectTable::FFEffectTable(VibrationPort& port)
+		: port(port), slots()
+	{
+	}
+
+	FFEffectTable::~FFEffectTable()
+	{
+		EraseAll();
+	}
+
+	bool FFEffectTable::Translate(const ff_effect& effect, FFTranslation& translation)
+	{
+		translation.count = 0;
+		translation.envelope = {};
+
+		// Times are in milliseconds, a length of 0 plays until stopped
+		EffectDesc desc = {};
+		desc.dwDuration = effect.replay.length != 0 ? effect.replay.length * 1000u : EFFECT_INFINITE;
+		desc.dwGain = 10000;
+		desc.dwStartDelay = effect.replay.delay * 1000u;
+
+		switch (effect.type) {
+		case FF_RUMBLE: {
+			// Strong is the big motor (second report force), weak the small
+			// one; cAxes 1 with 1 drives MOTOR_Y, with -1 MOTOR_X
+			uint16_t magnitudes[2] = { effect.u.rumble.strong_magnitude, effect.u.rumble.weak_magnitude };
+			translation.count = 2;
+			for (int k = 0; k < 2; k++) {
+				translation.directions[k][0] = k == 0 ? 1 : -1;
+				translation.constant[k].lMagnitude = LevelFromRumble(magnitudes[k]);
+				translation.dwEffectType[k] = EFFECT_CONSTANT;
+				translation.desc[k] = desc;
+				translation.desc[k].cAxes = 1;
+				translation.desc[k].rglDirection = translation.directions[k];
+				translation.desc[k].cbTypeSpecificParams = sizeof(ConstantForce);
+				translation.desc[k].lpvTypeSpecificParams = &translation.constant[k];
+			}
+			return true;
+		}
+
+		case FF_CONSTANT:
+			translation.constant[0].lMagnitude = LevelFromFF(effect.u.constant.level);
+			translation.dwEffectType[0] = EFFECT_CONSTANT;
+			desc.cbTypeSpecificParams = sizeof(ConstantForce);
+			desc.lpvTypeSpecificParams = &translation.constant[0];
+			SetEnvelope(effect.u.constant.envelope, translation.envelope);
+			break;
+
+		case FF_PERIODIC: {
+			const ff_periodic_effect& periodic = effect.u.periodic;
+			switch (periodic.waveform) {
+			case FF_SQUARE:
+				translation.dwEffectType[0] = EFFECT_SQUARE;
+				break;
+			case FF_TRIANGLE:
+				translation.dwEffectType[0] = EFFECT_TRIANGLE;
+				break;
+			case FF_SINE:
+				translation.dwEffectType[0] = EFFECT_SINE;
+				break;
+			case FF_SAW_UP:
+				translation.dwEffectType[0] = EFFECT_SAWTOOTH_UP;
+				break;
+			case FF_SAW_DOWN:
+				translation.dwEffectType[0] = EFFECT_SAWTOOTH_DOWN;
+				break;
+			default:
+				// FF_CUSTOM samples are not supported
+				return false;
+			}
+
+			// A negative magnitude is the waveform half a period later;
+			// the phase is a fraction of the period in 0..0xFFFF
+			int32_t magnitude = LevelFromFF(periodic.magnitude);
+			uint32_t phase = (uint32_t)periodic.phase * 36000 / 0x10000;
+			if (magnitude < 0) {
+				magnitude = -magnitude;
+				phase = (phase + 18000) % 36000;
+			}
+
+			translation.periodic.dwMagnitude = (uint32_t)magnitude;
+			translation.periodic.lOffset = LevelFromFF(periodic.offset);
+			translation.periodic.dwPhase = phase;
+			translation.periodic.dwPeriod = periodic.period * 1000u;
+			desc.cbTypeSpecificParams = sizeof(PeriodicForce);
+			desc.lpvTypeSpecificParams = &translation.periodic;
+			SetEnvelope(periodic.envelope, translation.envelope);
+			break;
+		}
+
+		default:
+			return false;
+		}
+
+		translation.count = 1;
+		translation.directions[0][0] = 1;
+		translation.directions[0][1] = 1;
+		translation.desc[0] = desc;
+		translation.desc[0].cAxes = 2;
+		translation.desc[0].rglDirection = translation.directions[0];
+
+		// An envelope left at zero is no envelope
+		const Envelope& env = translation.envelope;
+		if (env.dwAttackTime != 0 || env.dwFadeTime != 0)
+			translation.desc[0].lpEnvelope = &translation.envelope;
+		return true;
+	}
+
+	int FFEffectTable::Upload(const ff_effect& effect)
+	{
+		if (effect.id < 0 || (uint32_t)effect.id >= FF_EFFECTS_MAX)
+			return -EINVAL;
+
+		FFTranslation translation;
+		if (!Translate(effect, translation))
+			return -EINVAL;
+
+		Slot& slot = slots[effect.id];
+
+		// A rumble and a single effect do not share handles
+		bool update = slot.used && slot.count == translation.count;
+
+		uint32_t dwHandles[2] = {};
+		for (uint32_t k = 0; k < translation.count; k++) {
+			uint32_t dwHandle = update ? slot.dwHandles[k] : 0;
+			if (dwHandle != 0 && !port.IsEffectHandle(dwHandle))
+				dwHandle = 0;
+
+			if (!port.DownloadEffect(translation.dwEffectType[k], translation.desc[k], dwHandle, 0)) {
+				// The table keeps the previous effect, so undo what this
+				// upload did: destroy the effects it created and put the
+				// previous parameters back on the ones it updated
+				FFTranslation previous;
+				if (update)
+					Translate(slot.effect, previous);
+				for (uint32_t j = 0; j < k; j++) {
+					if (update && slot.dwHandles[j] == dwHandles[j])
+						port.DownloadEffect(previous.dwEffectType[j], previous.desc[j], dwHandles[j], DOWNLOAD_NORESTART);
+					else
+						port.DestroyEffect(dwHandles[j]);
+				}
+				return -ENOSPC;
+			}
+			dwHandles[k] = dwHandle;
+		}
+
+		if (slot.used && !update)
+			Erase(effect.id);
+
+		slot.used = true;
+		slot.count = translation.count;
+		slot.dwHandles[0] = dwHandles[0];
+		slot.dwHandles[1] = dwHandles[1];
+		slot.effect = effect;
+		return 0;
+	}
+
+	int FFEffectTable::Erase(int16_t id)
+	{
+		if (!IsUploaded(id))
+			return -EINVAL;
+
+		Slot& slot = slots[id];
+		for (uint32_t k = 0; k < slot.count; k++) {
+			if (port.IsEffectHandle(slot.dwHandles[k]))
+				port.DestroyEffect(slot.dwHandles[k]);
+		}
+
+		slot.used = false;
+		return 0;
+	}
+
+	void FFEffectTable::Play(int16_t id, int32_t count)
+	{
+		if (!IsUploaded(id))
+			return;
+
+		Slot& slot = slots[id];
+		for (uint32_t k = 0; k < slot.count; k++) {
+			if (!port.IsEffectHandle(slot.dwHandles[k]))
+				continue;
+
+			if (count > 0)
+				port.StartEffect(slot.dwHandles[k], 0, (uint32_t)count);
+			else
+				port.StopEffect(slot.dwHandles[k]);
+		}
+	}
+
+	void FFEffectTable::SetGain(uint16_t gain)
+	{
+		port.SetGain((uint32_t)gain * 10000 / 0xFFFF);
+	}
+
+	void FFEffectTable::EraseAll()
+	{
+		for (uint32_t id = 0; id < FF_EFFECTS_MAX; id++) {
+			if (slots[id].used)
+				Erase((int16_t)id);
+		}
+	}
+
+	bool FFEffectTable::IsUploaded(int16_t id) const
+	{
+		return id >= 0 && (uint32_t)id < FF_EFFECTS_MAX && slots[id].used;
+	}
+
+}
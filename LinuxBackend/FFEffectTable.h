@@ -0,0 +1,74 @@
+#pragma once
+#include "VibrationPort.h"
+#include <linux/input.h>
+
+namespace vibration {
+
+	// Effects a uinput device offers (uinput_setup::ff_effects_max)
+	const uint32_t FF_EFFECTS_MAX = 16;
+
+	// An ff_effect as effects of the engine. A rumble becomes one constant
+	// effect per motor; FF_CONSTANT and FF_PERIODIC map one to one and
+	// drive both motors, the direction of the force having no meaning on a
+	// gamepad. desc points into the translation, which is not copyable.
+	struct FFTranslation {
+		FFTranslation() = default;
+		FFTranslation(const FFTranslation&) = delete;
+		FFTranslation& operator=(const FFTranslation&) = delete;
+
+		uint32_t count;
+		uint32_t dwEffectType[2];
+		EffectDesc desc[2];
+
+		int32_t directions[2][2];
+		ConstantForce constant[2];
+		PeriodicForce periodic;
+		Envelope envelope;
+	};
+
+	// Effect table of one port for the evdev force feedback API: effects
+	// uploaded with EVIOCSFF (UI_FF_UPLOAD on the uinput side), erased,
+	// and played or stopped by EV_FF events. Ids are the slots the kernel
+	// assigns, below FF_EFFECTS_MAX.
+	//
+	// Not thread-safe: the uinput event loop makes every call.
+	class FFEffectTable
+	{
+	public:
+		FFEffectTable(VibrationPort& port);
+		~FFEffectTable();
+
+		// 0, or the negative errno returned to EVIOCSFF. A playing effect
+		// restarts with its new parameters, as with ff-memless.
+		int Upload(const ff_effect& effect);
+		int Erase(int16_t id);
+
+		// EV_FF with an effect id: count plays, 0 stops
+		void Play(int16_t id, int32_t count);
+
+		// EV_FF FF_GAIN, 0..0xFFFF
+		void SetGain(uint16_t gain);
+
+		// Destroys every effect, when the device goes away
+		void EraseAll();
+
+		bool IsUploaded(int16_t id) const;
+
+		// False for types and waveforms the engine does not play
+		static bool Translate(const ff_effect& effect, FFTranslation& translation);
+
+	private:
+		struct Slot {
+			bool used;
+			uint32_t count;
+			uint32_t dwHandles[2];
+
+			// As uploaded, to restore it when an update fails halfway
+			ff_effect effect;
+		};
+
+		VibrationPort& port;
+		Slot slots[FF_EFFECTS_MAX];
+	};
+
+}
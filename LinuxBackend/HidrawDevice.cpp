@@ -0,0 +1,94 @@
+#include "HidrawDevice.h"
+#include <algorithm>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+
+namespace vibration {
+
+	// HID_ID=<bus>:<vendor>:<product>, 4, 8 and 8 hex digits
+	static bool ParseHidID(const std::string& value, uint16_t& vendorID, uint16_t& productID)
+	{
+		size_t first = value.find(':');
+		size_t second = first == std::string::npos ? first : value.find(':', first + 1);
+		if (second == std::string::npos)
+			return false;
+
+		char* end;
+		unsigned long vendor = strtoul(value.c_str() + first + 1, &end, 16);
+		if (*end != ':')
+			return false;
+		unsigned long product = strtoul(value.c_str() + second + 1, &end, 16);
+		if (*end != '\0')
+			return false;
+
+		vendorID = (uint16_t)vendor;
+		productID = (uint16_t)product;
+		return vendor <= 0xFFFF && product <= 0xFFFF;
+	}
+
+	std::vector<HidrawNode> FindHidrawNodes(uint16_t vendorID, uint16_t productID,
+		const std::string& sysfsRoot, const std::string& devRoot)
+	{
+		std::vector<std::pair<unsigned long, HidrawNode>> numbered;
+		std::vector<HidrawNode> nodes;
+
+		std::string classPath = sysfsRoot + "/class/hidraw";
+		DIR* dir = opendir(classPath.c_str());
+		if (dir == NULL)
+			return nodes;
+
+		while (dirent* entry = readdir(dir)) {
+			std::string node = entry->d_name;
+			if (node.compare(0, 6, "hidraw") != 0)
+				continue;
+
+			std::ifstream uevent(classPath + "/" + node + "/device/uevent");
+			if (!uevent.is_open())
+				continue;
+
+			HidrawNode found;
+			bool matches = false;
+			std::string line;
+			while (std::getline(uevent, line)) {
+				size_t eq = line.find('=');
+				if (eq == std::string::npos)
+					continue;
+
+				std::string key = line.substr(0, eq);
+				std::string value = line.substr(eq + 1);
+				uint16_t vendor, product;
+				if (key == "HID_ID")
+					matches = ParseHidID(value, vendor, product) && vendor == vendorID && product == productID;
+				else if (key == "HID_NAME")
+					found.name = value;
+				else if (key == "HID_PHYS")
+					found.phys = value;
+			}
+
+			if (!matches)
+				continue;
+
+			found.devicePath = devRoot + "/" + node;
+			numbered.emplace_back(strtoul(node.c_str() + 6, NULL, 10), found);
+		}
+		closedir(dir);
+
+		// readdir has no order; hidraw2 before hidraw10
+		std::sort(numbered.begin(), numbered.end(),
+			[](const std::pair<unsigned long, HidrawNode>& a, const std::pair<unsigned long, HidrawNode>& b) {
+				return a.first < b.first;
+			});
+
+		for (auto& entry : numbered)
+			nodes.push_back(entry.second);
+		return nodes;
+	}
+
+	int OpenHidraw(const std::string& devicePath)
+	{
+		return open(devicePath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	}
+
+}
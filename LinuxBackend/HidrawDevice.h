@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vibration {
+
+	// The Twin USB Joystick adapter
+	const uint16_t ADAPTER_VENDOR_ID = 0x0810;
+	const uint16_t ADAPTER_PRODUCT_ID = 0x0001;
+
+	struct HidrawNode {
+		// /dev/hidrawN
+		std::string devicePath;
+
+		// HID_NAME and HID_PHYS of the HID device (USB path and interface)
+		std::string name;
+		std::string phys;
+	};
+
+	// hidraw nodes whose HID device has the given VID/PID, read from
+	// <sysfsRoot>/class/hidraw/*/device/uevent and ordered by node number.
+	// The roots are replaceable so a fake tree can stand in for sysfs.
+	std::vector<HidrawNode> FindHidrawNodes(uint16_t vendorID, uint16_t productID,
+		const std::string& sysfsRoot = "/sys", const std::string& devRoot = "/dev");
+
+	// Opens a node for non-blocking writes; -1 on failure, with errno set
+	int OpenHidraw(const std::string& devicePath);
+
+}
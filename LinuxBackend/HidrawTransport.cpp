@@ -0,0 +1,56 @@
+#include "HidrawTransport.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace vibration {
+
+	HidrawTransport::HidrawTransport(int fd, EpollWriter& writer)
+		: fd(fd), writer(writer), reportSize(0), completion(NULL)
+	{
+	}
+
+	HidrawTransport::~HidrawTransport()
+	{
+		if (writer.Cancel(fd, *this))
+			completion->OnWriteComplete(false);
+	}
+
+	bool HidrawTransport::BeginWrite(const uint8_t* buff, size_t buffsz, IWriteCompletion& completion)
+	{
+		if (buffsz > sizeof(report))
+			return false;
+
+		memcpy(report, buff, buffsz);
+		reportSize = buffsz;
+		this->completion = &completion;
+
+		return writer.Post(fd, *this);
+	}
+
+	void HidrawTransport::OnWritable()
+	{
+		WriteResult result = TryWrite();
+		if (result != WRITE_WAITING)
+			completion->OnWriteComplete(result == WRITE_DONE);
+	}
+
+	HidrawTransport::WriteResult HidrawTransport::TryWrite()
+	{
+		ssize_t written;
+		do {
+			written = write(fd, report, reportSize);
+		} while (written < 0 && errno == EINTR);
+
+		// hidraw takes a report whole or not at all
+		if (written == (ssize_t)reportSize)
+			return WRITE_DONE;
+
+		if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return writer.WaitWritable(fd, *this) ? WRITE_WAITING : WRITE_FAILED;
+
+		// ENODEV once the adapter is unplugged
+		return WRITE_FAILED;
+	}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "EpollWriter.h"
+#include "ReportTransport.h"
+#include "Report.h"
+
+namespace vibration {
+
+	// Writes reports to a hidraw node from the EpollWriter thread: hidraw
+	// ignores O_NONBLOCK for writes, so write() may block until the report
+	// reaches the device. The report goes out as is, its first byte
+	// (port + 1) being the report ID. A node that refuses the write is
+	// waited on by the EpollWriter; meanwhile the AsyncReportSink in front
+	// keeps only the latest forces.
+	//
+	// The descriptor is not owned: both ports of an adapter write to the
+	// same node and it must outlive their transports.
+	class HidrawTransport : public IReportTransport, private IWritable
+	{
+	public:
+		HidrawTransport(int fd, EpollWriter& writer);
+
+		// Completes a write still waiting for the node as failed
+		~HidrawTransport();
+
+		// Only queues the report for the writer thread
+		bool BeginWrite(const uint8_t* buff, size_t buffsz, IWriteCompletion& completion) override;
+
+	private:
+		enum WriteResult {
+			WRITE_DONE,
+			WRITE_WAITING,
+			WRITE_FAILED,
+		};
+
+		void OnWritable() override;
+		WriteResult TryWrite();
+
+		int fd;
+		EpollWriter& writer;
+
+		uint8_t report[REPORT_SIZE];
+		size_t reportSize;
+		IWriteCompletion* completion;
+	};
+
+}
@@ -0,0 +1,302 @@
+// Checks the force feedback frontend without uinput: ff_effect uploads as
+// the kernel hands them to RumbleDaemon, translated and played through
+// FFEffectTable on a Simulation port, report by report, then timed end to
+// end from Upload and Play to the report read from a socketpair standing
+// in for the hidraw node. Exits with 1 on a failure.
+//
+//   FFCheck [uploads]
+
+#include "DeviceRegistry.h"
+#include "EpollWriter.h"
+#include "FFEffectTable.h"
+#include "HidrawTransport.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	const uint64_t ORIGIN = 5000000000ull;
+
+	int failures = 0;
+
+	bool Check(bool ok, const char* what) {
+		if (!ok) {
+			printf("FAIL %s\n", what);
+			failures++;
+		}
+		return ok;
+	}
+
+	uint64_t NowNs() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count();
+	}
+
+	// Report force of a rumble magnitude, as FFEffectTable translates it
+	uint8_t RumbleForce(uint16_t magnitude) {
+		return ForceFromLevel((int32_t)((uint32_t)magnitude * 20000 / 0xFFFF) - 10000);
+	}
+
+	ff_effect Rumble(int16_t id, uint16_t strong, uint16_t weak, uint16_t length) {
+		ff_effect effect = {};
+		effect.type = FF_RUMBLE;
+		effect.id = id;
+		effect.u.rumble.strong_magnitude = strong;
+		effect.u.rumble.weak_magnitude = weak;
+		effect.replay.length = length;
+		return effect;
+	}
+
+	ff_effect Periodic(int16_t id, uint16_t waveform, int16_t magnitude, uint16_t phase, uint16_t period) {
+		ff_effect effect = {};
+		effect.type = FF_PERIODIC;
+		effect.id = id;
+		effect.u.periodic.waveform = waveform;
+		effect.u.periodic.magnitude = magnitude;
+		effect.u.periodic.phase = phase;
+		effect.u.periodic.period = period;
+		effect.replay.length = 1000;
+		return effect;
+	}
+
+	void Translation() {
+		FFTranslation t;
+
+		ff_effect rumble = Rumble(0, 0xFFFF, 0x8000, 250);
+		rumble.replay.delay = 20;
+		Check(FFEffectTable::Translate(rumble, t) && t.count == 2
+			&& t.dwEffectType[0] == EFFECT_CONSTANT && t.dwEffectType[1] == EFFECT_CONSTANT,
+			"translation: rumble is two constant effects");
+		Check(t.desc[0].cAxes == 1 && t.desc[0].rglDirection[0] == 1 && t.constant[0].lMagnitude == 10000
+			&& t.desc[1].cAxes == 1 && t.desc[1].rglDirection[0] == -1 && t.constant[1].lMagnitude == 0,
+			"translation: rumble strong and weak motors");
+		Check(t.desc[0].dwDuration == 250000 && t.desc[1].dwStartDelay == 20000 && t.desc[0].lpEnvelope == NULL,
+			"translation: rumble times");
+
+		ff_effect constant = {};
+		constant.type = FF_CONSTANT;
+		constant.u.constant.level = -0x8000;
+		constant.u.constant.envelope.attack_length = 100;
+		constant.u.constant.envelope.attack_level = 0x7FFF;
+		Check(FFEffectTable::Translate(constant, t) && t.count == 1 && t.dwEffectType[0] == EFFECT_CONSTANT
+			&& t.constant[0].lMagnitude == -10000 && t.desc[0].dwDuration == EFFECT_INFINITE && t.desc[0].cAxes == 2,
+			"translation: constant level");
+		Check(t.desc[0].lpEnvelope == &t.envelope && t.envelope.dwAttackTime == 100000
+			&& t.envelope.dwAttackLevel == 10000 && t.envelope.dwFadeTime == 0,
+			"translation: constant envelope");
+
+		// Negative magnitude: same waveform half a period later
+		ff_effect periodic = Periodic(0, FF_TRIANGLE, -0x4000, 0x4000, 40);
+		periodic.u.periodic.offset = 0x7FFF;
+		Check(FFEffectTable::Translate(periodic, t) && t.dwEffectType[0] == EFFECT_TRIANGLE
+			&& t.periodic.dwMagnitude == 5000 && t.periodic.dwPhase == 27000 && t.periodic.dwPeriod == 40000
+			&& t.periodic.lOffset == 10000 && t.desc[0].lpEnvelope == NULL,
+			"translation: periodic");
+
+		const uint16_t waveforms[] = { FF_SQUARE, FF_SINE, FF_SAW_UP, FF_SAW_DOWN };
+		const uint32_t types[] = { EFFECT_SQUARE, EFFECT_SINE, EFFECT_SAWTOOTH_UP, EFFECT_SAWTOOTH_DOWN };
+		bool same = true;
+		for (int k = 0; k < 4; k++)
+			same = same && FFEffectTable::Translate(Periodic(0, waveforms[k], 0x7FFF, 0, 100), t) && t.dwEffectType[0] == types[k];
+		Check(same, "translation: waveforms");
+
+		ff_effect spring = {};
+		spring.type = FF_SPRING;
+		Check(!FFEffectTable::Translate(Periodic(0, FF_CUSTOM, 0x7FFF, 0, 100), t) && !FFEffectTable::Translate(spring, t),
+			"translation: unsupported effects");
+	}
+
+	void Playback() {
+		Simulation sim(ORIGIN);
+		VibrationPort& port = sim.AddPort(0);
+		FFEffectTable table(port);
+
+		// Strong motor only, for its length
+		Check(table.Upload(Rumble(0, 0xFFFF, 0, 200)) == 0 && table.IsUploaded(0), "playback: upload");
+		table.Play(0, 1);
+		sim.Sync();
+		sim.Advance(1000000);
+
+		const std::vector<SimReport>& reports = sim.GetReports(0);
+		Check(reports.size() == 2 && reports[0].time == ORIGIN && reports[0].data[0] == 1
+			&& reports[0].GetForceY() == FORCE_MAX && reports[0].GetForceX() == 0,
+			"playback: strong motor");
+		Check(reports.size() == 2 && reports[1].time == ORIGIN + 200000
+			&& reports[1].GetForceY() == 0 && reports[1].GetForceX() == 0,
+			"playback: stopped after its length");
+
+		// An update of a playing effect restarts it with the new magnitudes
+		sim.ClearReports();
+		uint64_t start = sim.Now();
+		table.Upload(Rumble(0, 0, 0xFFFF, 0));
+		table.Play(0, 1);
+		sim.Sync();
+		sim.Advance(100000);
+		table.Upload(Rumble(0, 0xFFFF, 0xFFFF, 0));
+		sim.Sync();
+		sim.Advance(100000);
+		Check(reports.size() == 2 && reports[0].time == start && reports[0].GetForceX() == FORCE_MAX
+			&& reports[0].GetForceY() == 0, "playback: weak motor");
+		Check(reports.size() == 2 && reports[1].time == start + 100000 && reports[1].GetForceX() == FORCE_MAX
+			&& reports[1].GetForceY() == FORCE_MAX, "playback: update while playing");
+
+		// Device gain
+		sim.ClearReports();
+		table.SetGain(0x8000);
+		sim.Sync();
+		Check(reports.size() == 1 && reports[0].GetForceX() < FORCE_MAX && reports[0].GetForceX() > FORCE_MAX / 3,
+			"playback: gain");
+		table.SetGain(0xFFFF);
+
+		// Erasing a playing effect stops it
+		sim.ClearReports();
+		Check(table.Erase(0) == 0 && !table.IsUploaded(0), "playback: erase");
+		sim.Sync();
+		Check(reports.size() == 1 && reports[0].GetForceX() == 0 && reports[0].GetForceY() == 0,
+			"playback: erase stops the effect");
+		Check(table.Erase(0) == -EINVAL, "playback: erase twice");
+
+		// A slot reused for another type, then stopped by EV_FF 0
+		sim.ClearReports();
+		start = sim.Now();
+		table.Upload(Rumble(3, 0xFFFF, 0xFFFF, 0));
+		ff_effect periodic = Periodic(3, FF_SQUARE, 0x7FFF, 0, 100);
+		periodic.replay.length = 0;
+		Check(table.Upload(periodic) == 0, "playback: type change");
+		table.Play(3, 1);
+		sim.Sync();
+		sim.Advance(20000);
+		table.Play(3, 0);
+		sim.Sync();
+		Check(reports.size() == 2 && reports[0].time == start && reports[0].GetForceX() == FORCE_MAX
+			&& reports[0].GetForceY() == FORCE_MAX, "playback: square wave");
+		Check(reports.size() == 2 && reports[1].time == start + 20000 && reports[1].GetForceX() == 0,
+			"playback: stopped");
+
+		// A repeat count plays the effect again after its delay
+		sim.ClearReports();
+		start = sim.Now();
+		ff_effect repeated = Rumble(5, 0xFFFF, 0xFFFF, 100);
+		repeated.replay.delay = 50;
+		table.Upload(repeated);
+		table.Play(5, 2);
+		sim.Sync();
+		sim.Advance(1000000);
+		Check(reports.size() == 4 && reports[0].time == start + 50000 && reports[0].GetForceX() == FORCE_MAX
+			&& reports[1].time == start + 150000 && reports[1].GetForceX() == 0
+			&& reports[2].time == start + 200000 && reports[2].GetForceY() == FORCE_MAX
+			&& reports[3].time == start + 300000 && reports[3].GetForceY() == 0, "playback: repeat count");
+
+		// Ids the kernel would not pass, and effects the engine cannot play
+		Check(table.Upload(Rumble(-1, 1, 1, 0)) == -EINVAL && table.Upload(Rumble(FF_EFFECTS_MAX, 1, 1, 0)) == -EINVAL,
+			"playback: bad id");
+		Check(table.Upload(Periodic(4, FF_CUSTOM, 0x7FFF, 0, 100)) == -EINVAL && !table.IsUploaded(4),
+			"playback: custom waveform");
+		table.Play(9, 1);
+
+		table.EraseAll();
+		Check(!table.IsUploaded(3), "playback: erase all");
+	}
+
+	// Upload and play to the report on the node, through the registry and
+	// the output thread as in the daemon
+	void Latency(int uploads) {
+		int fds[2];
+		if (!Check(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0,
+			"latency: socketpair"))
+			return;
+
+		// Read time by report forces, big motor in the high byte
+		std::unique_ptr<std::atomic<uint64_t>[]> readAt(new std::atomic<uint64_t>[0x10000]());
+		std::atomic<bool> stop(false);
+		std::thread reader([&] {
+			while (!stop) {
+				uint8_t buff[8];
+				ssize_t n = recv(fds[1], buff, sizeof(buff), 0);
+				if (n == REPORT_SIZE && buff[0] == 1) {
+					readAt[buff[3] << 8 | buff[4]] = NowNs();
+				}
+				else if (n < 0) {
+					std::this_thread::sleep_for(std::chrono::microseconds(20));
+				}
+			}
+		});
+
+		std::vector<uint64_t> latencies;
+		{
+			EpollWriter writer;
+			SteadyClock clock;
+			OutputScheduler scheduler(clock);
+			DeviceRegistry registry(clock, scheduler);
+
+			std::unique_ptr<IReportTransport> transport(new HidrawTransport(fds[0], writer));
+			VibrationPort& port = registry.Register(0, 0, std::move(transport));
+			FFEffectTable table(port);
+
+			// Forces differing from the previous upload, one upload at a
+			// time as EVIOCSFF does
+			for (int k = 0; k < uploads; k++) {
+				uint16_t strong = (uint16_t)((k % 200 + 20) * 0x140);
+				uint16_t weak = (uint16_t)((k / 200 % 200 + 20) * 0x140);
+				uint16_t key = (uint16_t)(RumbleForce(strong) << 8 | RumbleForce(weak));
+				readAt[key] = 0;
+
+				uint64_t start = NowNs();
+				table.Upload(Rumble(0, strong, weak, 0));
+				table.Play(0, 1);
+
+				auto deadline = BenchClock::now() + std::chrono::milliseconds(200);
+				while (readAt[key] == 0 && BenchClock::now() < deadline)
+					std::this_thread::yield();
+				if (readAt[key] != 0)
+					latencies.push_back(readAt[key] - start);
+			}
+
+			table.EraseAll();
+		}
+		stop = true;
+		reader.join();
+		close(fds[0]);
+		close(fds[1]);
+
+		Check(latencies.size() == (size_t)uploads, "latency: every upload reached the node");
+		if (latencies.empty())
+			return;
+
+		std::sort(latencies.begin(), latencies.end());
+		printf("upload to report: %zu uploads, p50 %.1f us, p99 %.1f us, max %.1f us\n", latencies.size(),
+			latencies[latencies.size() / 2] / 1000.0, latencies[latencies.size() * 99 / 100] / 1000.0,
+			latencies.back() / 1000.0);
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	int uploads = argc > 1 ? atoi(argv[1]) : 1000;
+	if (uploads < 1 || uploads > 40000)
+		uploads = 1000;
+
+	// A closed stand-in node raises SIGPIPE on write
+	signal(SIGPIPE, SIG_IGN);
+
+	Translation();
+	Playback();
+	Latency(uploads);
+
+	printf("%s\n", failures == 0 ? "ok" : "FAILED");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,282 @@
+// Checks the hidraw backend without an adapter: discovery against a fake
+// sysfs tree, and the byte stream and write rate of HidrawTransport behind
+// AsyncReportSink with a socketpair standing in for the hidraw node. The
+// reading end takes one report per millisecond, like the interrupt
+// endpoint, while both ports send forces far faster; the writes must
+// wait on the EpollWriter, coalesce to the latest forces and keep up with
+// the reader. Exits with 1 on a failure.
+//
+//   HidrawCheck [updates per port]
+
+#include "EpollWriter.h"
+#include "HidrawDevice.h"
+#include "HidrawTransport.h"
+#include "AsyncReportSink.h"
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	const auto READ_INTERVAL = std::chrono::milliseconds(1);
+
+	int failures = 0;
+
+	bool Check(bool ok, const char* what) {
+		if (!ok) {
+			printf("FAIL %s\n", what);
+			failures++;
+		}
+		return ok;
+	}
+
+	void WriteFile(const std::string& path, const char* text) {
+		std::ofstream file(path);
+		file << text;
+	}
+
+	void Discovery() {
+		char root[] = "/tmp/HidrawCheck.XXXXXX";
+		if (!Check(mkdtemp(root) != NULL, "discovery: temporary directory"))
+			return;
+
+		const char* nodes[] = { "hidraw0", "hidraw10", "hidraw2" };
+		const char* uevents[] = {
+			"DRIVER=hid-generic\nHID_ID=0003:0000046D:0000C21D\nHID_NAME=Logitech Gamepad\n",
+			"DRIVER=hid-generic\nHID_ID=0003:00000810:00000001\nHID_NAME=Twin USB Joystick\nHID_PHYS=usb-0000:00:14.0-3/input0\n",
+			"DRIVER=hid-generic\nHID_ID=0003:00000810:00000001\nHID_NAME=Twin USB Joystick\nHID_PHYS=usb-0000:00:14.0-1/input0\n",
+		};
+
+		std::string classPath = std::string(root) + "/class";
+		mkdir(classPath.c_str(), 0700);
+		mkdir((classPath + "/hidraw").c_str(), 0700);
+		for (int k = 0; k < 3; k++) {
+			std::string node = classPath + "/hidraw/" + nodes[k];
+			mkdir(node.c_str(), 0700);
+			mkdir((node + "/device").c_str(), 0700);
+			WriteFile(node + "/device/uevent", uevents[k]);
+		}
+
+		std::vector<HidrawNode> found = FindHidrawNodes(ADAPTER_VENDOR_ID, ADAPTER_PRODUCT_ID, root, "/dev");
+		Check(found.size() == 2 && found[0].devicePath == "/dev/hidraw2" && found[1].devicePath == "/dev/hidraw10"
+			&& found[0].name == "Twin USB Joystick" && found[0].phys == "usb-0000:00:14.0-1/input0",
+			"discovery: adapters by VID/PID in node order");
+		Check(FindHidrawNodes(0x046D, 0xC21D, root).size() == 1, "discovery: other device");
+		Check(FindHidrawNodes(ADAPTER_VENDOR_ID, ADAPTER_PRODUCT_ID, std::string(root) + "/missing").empty(),
+			"discovery: no sysfs");
+
+		for (int k = 0; k < 3; k++) {
+			std::string node = classPath + "/hidraw/" + nodes[k];
+			unlink((node + "/device/uevent").c_str());
+			rmdir((node + "/device").c_str());
+			rmdir(node.c_str());
+		}
+		rmdir((classPath + "/hidraw").c_str());
+		rmdir(classPath.c_str());
+		rmdir(root);
+	}
+
+	// Both ports of the adapter on one node, as with the real hidraw device
+	struct Adapter {
+		Adapter(int fd, EpollWriter& writer) {
+			for (int p = 0; p < 2; p++) {
+				transports[p].reset(new HidrawTransport(fd, writer));
+				sinks[p].reset(new AsyncReportSink(*transports[p]));
+			}
+		}
+
+		// Same order as DeviceRegistry::Release
+		~Adapter() {
+			for (int p = 0; p < 2; p++) {
+				sinks[p]->Drain(std::chrono::milliseconds(100));
+				transports[p].reset();
+				sinks[p].reset();
+			}
+		}
+
+		std::unique_ptr<HidrawTransport> transports[2];
+		std::unique_ptr<AsyncReportSink> sinks[2];
+	};
+
+	bool OpenNode(int fds[2]) {
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0)
+			return false;
+
+		// Smallest buffer the kernel allows, a handful of reports
+		int size = 1;
+		setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+		return true;
+	}
+
+	void ByteStream() {
+		int fds[2];
+		if (!Check(OpenNode(fds), "byte stream: socketpair"))
+			return;
+
+		EpollWriter writer;
+		{
+			Adapter adapter(fds[0], writer);
+			SendVibrationForce(*adapter.sinks[0], 0x12, 0x34, 0);
+			SendVibrationStop(*adapter.sinks[1], 1);
+		}
+
+		uint8_t read0[8] = {}, read1[8] = {};
+		ssize_t n0 = recv(fds[1], read0, sizeof(read0), 0);
+		ssize_t n1 = recv(fds[1], read1, sizeof(read1), 0);
+		const uint8_t force[REPORT_SIZE] = { 0x01, 0x01, 0x00, 0x34, 0x12 };
+		const uint8_t stop[REPORT_SIZE] = { 0x02, 0x01, 0x00, 0x00, 0x00 };
+		Check(n0 == REPORT_SIZE && memcmp(read0, force, REPORT_SIZE) == 0, "byte stream: force report");
+		Check(n1 == REPORT_SIZE && memcmp(read1, stop, REPORT_SIZE) == 0, "byte stream: stop report");
+		Check(recv(fds[1], read0, sizeof(read0), 0) < 0, "byte stream: nothing else");
+
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	void Coalescing(int updates) {
+		int fds[2];
+		if (!Check(OpenNode(fds), "coalescing: socketpair"))
+			return;
+
+		EpollWriter writer;
+		std::vector<std::vector<uint16_t>> received(2);
+		bool sequenceOk = true;
+		bool readerDone = false;
+		BenchClock::time_point firstRead, lastRead;
+		uint64_t reads = 0;
+
+		std::thread reader([&] {
+			BenchClock::time_point idleSince = BenchClock::now();
+			while (true) {
+				uint8_t buff[8];
+				ssize_t n = recv(fds[1], buff, sizeof(buff), 0);
+				auto now = BenchClock::now();
+				if (n == REPORT_SIZE && (buff[0] == 1 || buff[0] == 2)) {
+					if (reads++ == 0)
+						firstRead = now;
+					lastRead = now;
+					idleSince = now;
+					received[buff[0] - 1].push_back((uint16_t)(buff[3] << 8 | buff[4]));
+				}
+				else if (n >= 0) {
+					sequenceOk = false;
+				}
+				else if (now - idleSince > std::chrono::milliseconds(300)) {
+					break;
+				}
+				std::this_thread::sleep_for(READ_INTERVAL);
+			}
+			readerDone = true;
+		});
+
+		OutputStats stats[2];
+		auto t0 = BenchClock::now();
+		{
+			Adapter adapter(fds[0], writer);
+
+			// Spread over about a second so the rate settles
+			auto interval = std::chrono::nanoseconds(1000000000ll / updates);
+			auto next = t0;
+			for (int k = 1; k <= updates; k++) {
+				for (uint32_t p = 0; p < 2; p++)
+					SendVibrationForce(*adapter.sinks[p], (uint8_t)k, (uint8_t)(k >> 8), p);
+				next += interval;
+				std::this_thread::sleep_until(next);
+			}
+
+			for (int p = 0; p < 2; p++) {
+				Check(adapter.sinks[p]->Drain(std::chrono::seconds(2)), "coalescing: drained");
+				stats[p] = adapter.sinks[p]->GetStats();
+			}
+		}
+		reader.join();
+
+		double seconds = std::chrono::duration<double>(lastRead - firstRead).count();
+		double rate = seconds > 0 ? (reads - 1) / seconds : 0;
+		double readerRate = 1.0 / std::chrono::duration<double>(READ_INTERVAL).count();
+
+		for (int p = 0; p < 2; p++) {
+			const std::vector<uint16_t>& values = received[p];
+			bool increasing = true;
+			for (size_t k = 1; k < values.size(); k++)
+				increasing = increasing && values[k] > values[k - 1];
+
+			Check(readerDone && sequenceOk && increasing, "coalescing: reports in order");
+			Check(!values.empty() && values.back() == (uint16_t)updates, "coalescing: latest forces delivered");
+			Check(values.size() < (size_t)updates && stats[p].reportsCoalesced > 0, "coalescing: updates merged");
+			Check(stats[p].writesFailed == 0 && stats[p].writesStarted == values.size(), "coalescing: every write delivered");
+
+			printf("port %d: %d updates, %zu reports, %llu coalesced\n", p, updates, values.size(),
+				(unsigned long long)stats[p].reportsCoalesced);
+		}
+
+		// The writer keeps the node busy: the rate is set by the reader
+		Check(writer.GetWaitCount() > 0, "coalescing: writes waited for the node");
+		Check(rate > readerRate * 0.5 && rate < readerRate * 1.1, "coalescing: write rate follows the node");
+		printf("%.0f reports/s for a node read at up to %.0f/s, %llu waits\n", rate, readerRate,
+			(unsigned long long)writer.GetWaitCount());
+
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	void Unplugged() {
+		int fds[2];
+		if (!Check(OpenNode(fds), "unplugged: socketpair"))
+			return;
+
+		EpollWriter writer;
+		Adapter adapter(fds[0], writer);
+
+		// A write left waiting on a full node is failed by the transport.
+		// Writes run on the writer thread, the updates are spaced so that
+		// they do not all coalesce.
+		for (int k = 0; k < 64 && writer.GetWaitCount() == 0; k++) {
+			SendVibrationForce(*adapter.sinks[0], (uint8_t)k, 0, 0);
+			std::this_thread::sleep_for(READ_INTERVAL);
+		}
+		Check(!adapter.sinks[0]->Drain(std::chrono::milliseconds(20)), "unplugged: node full");
+		adapter.transports[0].reset();
+		Check(adapter.sinks[0]->GetStats().writesFailed == 1, "unplugged: waiting write failed");
+
+		// The node going away fails the write instead of hanging
+		close(fds[1]);
+		SendVibrationForce(*adapter.sinks[1], 1, 1, 1);
+		Check(adapter.sinks[1]->Drain(std::chrono::milliseconds(100))
+			&& adapter.sinks[1]->GetStats().writesFailed == 1, "unplugged: write failed");
+
+		close(fds[0]);
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	int updates = argc > 1 ? atoi(argv[1]) : 20000;
+	if (updates < 2 || updates > 65535)
+		updates = 20000;
+
+	// A closed stand-in node raises SIGPIPE on write
+	signal(SIGPIPE, SIG_IGN);
+
+	Discovery();
+	ByteStream();
+	Coalescing(updates);
+	Unplugged();
+
+	printf("%s\n", failures == 0 ? "ok" : "FAILED");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+// Exposes each port of the adapters found through hidraw as a uinput
+// device with force feedback (FF_RUMBLE, FF_PERIODIC, FF_CONSTANT, FF_GAIN),
+// so games and emulators using the evdev API (EVIOCSFF, EV_FF) drive the
+// motors through the same effect engine as the Windows driver.
+//
+//   RumbleDaemon [--device /dev/hidrawN] [--rate reports/s] [--mix mode]
+//
+// Without --device every VID_0810&PID_0001 adapter is used. --rate is the
+// MaxReportRate (125 by default) and --mix the MixMode. SIGUSR1 prints the
+// upload to report latency of each port, by stage, which is also printed
+// on exit.
+
+#include "DeviceRegistry.h"
+#include "EpollWriter.h"
+#include "FFEffectTable.h"
+#include "HidrawDevice.h"
+#include "HidrawTransport.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace vibration;
+
+namespace {
+
+	const uint32_t DEFAULT_MAX_REPORT_RATE = 125;
+
+	const int FF_BITS[] = {
+		FF_RUMBLE, FF_PERIODIC, FF_CONSTANT,
+		FF_SQUARE, FF_TRIANGLE, FF_SINE, FF_SAW_UP, FF_SAW_DOWN,
+		FF_GAIN,
+	};
+
+	struct FFDevice {
+		int fd;
+		uint32_t dwID;
+		std::unique_ptr<FFEffectTable> table;
+	};
+
+	int CreateFFDevice(const char* name) {
+		int fd = open("/dev/uinput", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0)
+			return -1;
+
+		bool ok = ioctl(fd, UI_SET_EVBIT, EV_FF) == 0;
+		for (int bit : FF_BITS)
+			ok = ok && ioctl(fd, UI_SET_FFBIT, bit) == 0;
+
+		uinput_setup setup = {};
+		setup.id.bustype = BUS_VIRTUAL;
+		setup.id.vendor = ADAPTER_VENDOR_ID;
+		setup.id.product = ADAPTER_PRODUCT_ID;
+		snprintf(setup.name, sizeof(setup.name), "%s", name);
+		setup.ff_effects_max = FF_EFFECTS_MAX;
+
+		if (!ok || ioctl(fd, UI_DEV_SETUP, &setup) != 0 || ioctl(fd, UI_DEV_CREATE) != 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	void DestroyFFDevice(FFDevice& dev) {
+		dev.table.reset();
+		ioctl(dev.fd, UI_DEV_DESTROY);
+		close(dev.fd);
+	}
+
+	// Uploads and erases block the caller of EVIOCSFF / EVIOCRMFF until
+	// they are answered
+	void HandleEvents(FFDevice& dev) {
+		input_event events[64];
+		while (true) {
+			ssize_t n = read(dev.fd, events, sizeof(events));
+			if (n <= 0)
+				return;
+
+			for (size_t k = 0; k < (size_t)n / sizeof(input_event); k++) {
+				const input_event& ev = events[k];
+
+				if (ev.type == EV_UINPUT && ev.code == UI_FF_UPLOAD) {
+					uinput_ff_upload upload = {};
+					upload.request_id = ev.value;
+					if (ioctl(dev.fd, UI_BEGIN_FF_UPLOAD, &upload) != 0)
+						continue;
+					upload.retval = dev.table->Upload(upload.effect);
+					ioctl(dev.fd, UI_END_FF_UPLOAD, &upload);
+				}
+				else if (ev.type == EV_UINPUT && ev.code == UI_FF_ERASE) {
+					uinput_ff_erase erase = {};
+					erase.request_id = ev.value;
+					if (ioctl(dev.fd, UI_BEGIN_FF_ERASE, &erase) != 0)
+						continue;
+					erase.retval = dev.table->Erase((int16_t)erase.effect_id);
+					ioctl(dev.fd, UI_END_FF_ERASE, &erase);
+				}
+				else if (ev.type == EV_FF && ev.code == FF_GAIN) {
+					dev.table->SetGain((uint16_t)ev.value);
+				}
+				else if (ev.type == EV_FF) {
+					dev.table->Play((int16_t)ev.code, ev.value);
+				}
+			}
+		}
+	}
+
+	void PrintLatency(DeviceRegistry& registry, const std::vector<FFDevice>& devices) {
+		for (const FFDevice& dev : devices) {
+			std::unique_ptr<PortTelemetry> telemetry(new PortTelemetry());
+			if (!registry.GetTelemetry(dev.dwID, *telemetry))
+				continue;
+
+			const PortTelemetry& t = *telemetry;
+			fprintf(stderr, "port %u: %llu reports, us p50/p99 call to mix %llu/%llu, mix to write %llu/%llu,"
+				" write %llu/%llu, %llu failed writes\n", dev.dwID,
+				(unsigned long long)t.reportsSent,
+				(unsigned long long)LatencyHistogram::Percentile(t.callToMix, 0.5),
+				(unsigned long long)LatencyHistogram::Percentile(t.callToMix, 0.99),
+				(unsigned long long)LatencyHistogram::Percentile(t.mixToWrite, 0.5),
+				(unsigned long long)LatencyHistogram::Percentile(t.mixToWrite, 0.99),
+				(unsigned long long)LatencyHistogram::Percentile(t.writeDuration, 0.5),
+				(unsigned long long)LatencyHistogram::Percentile(t.writeDuration, 0.99),
+				(unsigned long long)t.writesFailed);
+		}
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const char* device = NULL;
+	uint32_t rate = DEFAULT_MAX_REPORT_RATE;
+	uint32_t mixMode = MIX_MAX;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+			device = argv[++i];
+		else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+			rate = (uint32_t)strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc)
+			mixMode = (uint32_t)strtoul(argv[++i], NULL, 10);
+		else {
+			fprintf(stderr, "usage: %s [--device /dev/hidrawN] [--rate reports/s] [--mix mode]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (mixMode >= MIX_MODE_COUNT)
+		mixMode = MIX_MAX;
+
+	std::vector<std::string> paths;
+	if (device != NULL) {
+		paths.push_back(device);
+	}
+	else {
+		for (const HidrawNode& node : FindHidrawNodes(ADAPTER_VENDOR_ID, ADAPTER_PRODUCT_ID))
+			paths.push_back(node.devicePath);
+	}
+	if (paths.empty()) {
+		fprintf(stderr, "no VID_%04X&PID_%04X adapter found\n", ADAPTER_VENDOR_ID, ADAPTER_PRODUCT_ID);
+		return 1;
+	}
+
+	// Signals are read from the event loop
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+	int sigfd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+	// The transports wait on the writer, which outlives the registry
+	EpollWriter writer;
+	SteadyClock clock;
+	OutputScheduler scheduler(clock);
+	std::unique_ptr<DeviceRegistry> registry(new DeviceRegistry(clock, scheduler));
+
+	std::vector<int> nodes;
+	std::vector<FFDevice> devices;
+	for (size_t n = 0; n < paths.size(); n++) {
+		int fd = OpenHidraw(paths[n]);
+		if (fd < 0) {
+			fprintf(stderr, "%s: %s\n", paths[n].c_str(), strerror(errno));
+			continue;
+		}
+		nodes.push_back(fd);
+
+		for (uint32_t p = 0; p < 2; p++) {
+			uint32_t dwID = (uint32_t)n * 2 + p;
+			std::unique_ptr<IReportTransport> transport(new HidrawTransport(fd, writer));
+			VibrationPort& port = registry->Register(dwID, p, std::move(transport));
+			port.SetMaxReportRate(rate);
+			port.SetMixMode((uint8_t)mixMode);
+
+			char name[UINPUT_MAX_NAME_SIZE];
+			snprintf(name, sizeof(name), "Twin USB Joystick %u port %u rumble", (unsigned)n, p + 1);
+			FFDevice dev;
+			dev.fd = CreateFFDevice(name);
+			if (dev.fd < 0) {
+				fprintf(stderr, "/dev/uinput: %s\n", strerror(errno));
+				continue;
+			}
+			dev.dwID = dwID;
+			dev.table.reset(new FFEffectTable(port));
+			devices.push_back(std::move(dev));
+			fprintf(stderr, "%s: port %u as \"%s\"\n", paths[n].c_str(), p + 1, name);
+		}
+	}
+
+	bool quit = devices.empty();
+	while (!quit) {
+		std::vector<pollfd> fds(devices.size() + 1);
+		for (size_t k = 0; k < devices.size(); k++)
+			fds[k] = { devices[k].fd, POLLIN, 0 };
+		fds.back() = { sigfd, POLLIN, 0 };
+
+		if (poll(fds.data(), fds.size(), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (size_t k = 0; k < devices.size(); k++) {
+			if (fds[k].revents & POLLIN)
+				HandleEvents(devices[k]);
+		}
+
+		if (fds.back().revents & POLLIN) {
+			signalfd_siginfo info;
+			if (read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+				PrintLatency(*registry, devices);
+				quit = info.ssi_signo != SIGUSR1;
+			}
+		}
+	}
+
+	// Effects are destroyed before the ports send their stop report
+	for (FFDevice& dev : devices)
+		DestroyFFDevice(dev);
+	registry.reset();
+	for (int fd : nodes)
+		close(fd);
+	close(sigfd);
+
+	return 0;
+}
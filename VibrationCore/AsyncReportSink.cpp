@@ -0,0 +1,117 @@
+#include "AsyncReportSink.h"
+#include <cstring>
+
+namespace vibration {
+
+	AsyncReportSink::AsyncReportSink(IReportTransport& transport)
+		: transport(transport), inFlight(false), hasPending(false), closed(false), stats()
+	{
+	}
+
+	AsyncReportSink::~AsyncReportSink()
+	{
+		// The completion of the last write still calls back into the sink
+		std::unique_lock<std::mutex> lock(mtxOutput);
+		closed = true;
+		cvIdle.wait(lock, [this] { return !inFlight; });
+	}
+
+	void AsyncReportSink::SendReport(const uint8_t* buff, size_t buffsz)
+	{
+		if (buffsz != REPORT_SIZE)
+			return;
+
+		std::chrono::steady_clock::time_point queued = std::chrono::steady_clock::now();
+
+		std::unique_lock<std::mutex> lock(mtxOutput);
+		if (closed)
+			return;
+
+		if (inFlight) {
+			// Older queued forces are stale, only the latest goes out
+			if (hasPending)
+				stats.reportsCoalesced++;
+
+			memcpy(pendingReport, buff, REPORT_SIZE);
+			pendingQueued = queued;
+			hasPending = true;
+			return;
+		}
+
+		memcpy(inFlightReport, buff, REPORT_SIZE);
+		inFlightQueued = queued;
+		inFlight = true;
+		lock.unlock();
+
+		StartWrite();
+	}
+
+	// Called without mtxOutput held: the transport may complete inline
+	void AsyncReportSink::StartWrite()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtxOutput);
+			writeStart = std::chrono::steady_clock::now();
+			stats.writesStarted++;
+			mixToWrite.Record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+				writeStart - inFlightQueued).count());
+		}
+
+		if (!transport.BeginWrite(inFlightReport, REPORT_SIZE, *this))
+			OnWriteComplete(false);
+	}
+
+	void AsyncReportSink::OnWriteComplete(bool success)
+	{
+		std::unique_lock<std::mutex> lock(mtxOutput);
+
+		uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - writeStart).count();
+		stats.lastWriteMicros = us;
+		stats.totalWriteMicros += us;
+		if (us > stats.maxWriteMicros)
+			stats.maxWriteMicros = us;
+		writeDuration.Record(us);
+		if (!success)
+			stats.writesFailed++;
+
+		if (!hasPending || closed) {
+			inFlight = false;
+			hasPending = false;
+			cvIdle.notify_all();
+			return;
+		}
+
+		memcpy(inFlightReport, pendingReport, REPORT_SIZE);
+		inFlightQueued = pendingQueued;
+		hasPending = false;
+		lock.unlock();
+
+		StartWrite();
+	}
+
+	bool AsyncReportSink::Drain(std::chrono::milliseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(mtxOutput);
+		bool idle = cvIdle.wait_for(lock, timeout, [this] { return !inFlight; });
+		closed = true;
+		return idle;
+	}
+
+	OutputStats AsyncReportSink::GetStats()
+	{
+		std::lock_guard<std::mutex> lock(mtxOutput);
+		return stats;
+	}
+
+	void AsyncReportSink::GetTelemetry(PortTelemetry& telemetry)
+	{
+		std::lock_guard<std::mutex> lock(mtxOutput);
+		telemetry.writesStarted = stats.writesStarted;
+		telemetry.writesFailed = stats.writesFailed;
+		telemetry.reportsCoalesced = stats.reportsCoalesced;
+		mixToWrite.CopyTo(telemetry.mixToWrite);
+		writeDuration.CopyTo(telemetry.writeDuration);
+	}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "ReportSink.h"
+#include "ReportTransport.h"
+#include "Report.h"
+#include "Telemetry.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace vibration {
+
+	struct OutputStats {
+		uint64_t writesStarted;
+		uint64_t writesFailed;
+		uint64_t reportsCoalesced;
+
+		// Time from BeginWrite to its completion
+		uint64_t lastWriteMicros;
+		uint64_t maxWriteMicros;
+		uint64_t totalWriteMicros;
+	};
+
+	// Output stage between the mixer and an asynchronous transport. At most
+	// one report is in flight; a report sent while a write is pending replaces
+	// the queued one, so a slow endpoint only ever receives the latest forces
+	// and never stalls the mixing pass.
+	//
+	// The transport must signal or cancel its last write before the sink is
+	// destroyed.
+	class AsyncReportSink : public IReportSink, private IWriteCompletion
+	{
+	public:
+		AsyncReportSink(IReportTransport& transport);
+		~AsyncReportSink();
+
+		void SendReport(const uint8_t* buff, size_t buffsz) override;
+
+		// Waits for the queued and in-flight reports, then stops starting
+		// new writes so the transport can be released.
+		bool Drain(std::chrono::milliseconds timeout);
+
+		OutputStats GetStats();
+
+		// Fills the output stage counters and the mix to write and write
+		// duration histograms
+		void GetTelemetry(PortTelemetry& telemetry);
+
+	private:
+		void OnWriteComplete(bool success) override;
+		void StartWrite();
+
+		IReportTransport& transport;
+
+		std::mutex mtxOutput;
+		std::condition_variable cvIdle;
+		bool inFlight;
+		bool hasPending;
+		bool closed;
+		uint8_t inFlightReport[REPORT_SIZE];
+		uint8_t pendingReport[REPORT_SIZE];
+		std::chrono::steady_clock::time_point writeStart;
+
+		// When the mixer handed over each report
+		std::chrono::steady_clock::time_point inFlightQueued;
+		std::chrono::steady_clock::time_point pendingQueued;
+
+		OutputStats stats;
+		LatencyHistogram mixToWrite;
+		LatencyHistogram writeDuration;
+	};
+
+}
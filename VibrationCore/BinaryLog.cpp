@@ -0,0 +1,277 @@
+#include "BinaryLog.h"
+#include "Telemetry.h"
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace vibration {
+
+	static_assert((LOG_RING_RECORDS & (LOG_RING_RECORDS - 1)) == 0, "LOG_RING_RECORDS must be a power of two");
+
+	static const LogEventFormat EVENT_FORMATS[LOG_EVENT_COUNT] = {
+		{ "Session", { "magic", "version", "wallLow", "wallHigh" } },
+		{ "Dropped", { "thread", "count" } },
+		{ "DeviceID", { "dwDIVer", "dwExternalID", "fBegin", "dwInternalId" } },
+		{ "GetVersions", {} },
+		{ "Escape", { "dwID", "dwCommand" } },
+		{ "SetGain", { "dwID", "dwGain" } },
+		{ "SendForceFeedbackCommand", { "dwID", "dwCommand" } },
+		{ "GetForceFeedbackState", { "dwID" } },
+		{ "DownloadEffect", { "dwID", "dwEffectID", "dwEffect", "dwFlags" } },
+		{ "DestroyEffect", { "dwID", "dwEffect" } },
+		{ "StartEffect", { "dwID", "dwEffect", "dwMode", "dwCount" } },
+		{ "StopEffect", { "dwID", "dwEffect" } },
+		{ "GetEffectStatus", { "dwID", "dwEffect" } },
+		{ "CallFailed", { "event", "hr", "dwID" } },
+		{ "Attach", { "dwID", "port" } },
+		{ "Detach", { "dwID" } },
+	};
+
+	static const LogEventFormat UNKNOWN_FORMAT = { "Unknown", { "a0", "a1", "a2", "a3" } };
+
+	const LogEventFormat& GetLogEventFormat(uint16_t event)
+	{
+		return event < LOG_EVENT_COUNT ? EVENT_FORMATS[event] : UNKNOWN_FORMAT;
+	}
+
+	static uint32_t CurrentThreadID()
+	{
+#ifdef _WIN32
+		return GetCurrentThreadId();
+#else
+		return (uint32_t)syscall(SYS_gettid);
+#endif
+	}
+
+	// Single producer (the owning thread), single consumer (the flusher)
+	struct BinaryLog::Ring {
+		Ring() : owned(true), thread(0), next(NULL), head(0), tailSeen(0), dropped(0), tail(0), droppedReported(0) {}
+
+		std::atomic<bool> owned;
+		std::atomic<uint32_t> thread;
+		Ring* next;
+
+		// Producer side; tailSeen saves reading the line of the flusher
+		// until the ring looks full
+		alignas(64) std::atomic<uint32_t> head;
+		uint32_t tailSeen;
+		std::atomic<uint64_t> dropped;
+
+		alignas(64) std::atomic<uint32_t> tail;
+		uint64_t droppedReported;
+
+		LogRecord records[LOG_RING_RECORDS];
+	};
+
+	// Gives the ring of a thread back when it exits
+	struct BinaryLog::RingHolder {
+		RingHolder() : ring(NULL) {}
+		~RingHolder() {
+			if (ring != NULL)
+				ring->owned.store(false, std::memory_order_release);
+		}
+
+		Ring* ring;
+	};
+
+	struct BinaryLog::Flusher {
+		Flusher() : quit(false) {}
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool quit;
+		std::ofstream file;
+		std::thread thread;
+	};
+
+	std::atomic<uint8_t> BinaryLog::currentLevel(LOG_OFF);
+	std::atomic<IClock*> BinaryLog::clock(NULL);
+	std::atomic<BinaryLog::Ring*> BinaryLog::rings(NULL);
+	std::mutex BinaryLog::mtxOpen;
+	BinaryLog::Flusher* BinaryLog::flusher = NULL;
+
+	bool BinaryLog::Open(const char* path, uint8_t level, IClock& clock)
+	{
+		std::lock_guard<std::mutex> lock(mtxOpen);
+		if (flusher != NULL) {
+			currentLevel.store(level, std::memory_order_relaxed);
+			return true;
+		}
+
+		Flusher* flush = new Flusher();
+		flush->file.open(path, std::ios_base::binary | std::ios_base::app);
+		if (!flush->file.is_open()) {
+			delete flush;
+			return false;
+		}
+
+		// Ties the monotonic record times to the wall clock
+		uint64_t wall = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+
+		LogRecord session = {};
+		session.time = clock.Now();
+		session.thread = CurrentThreadID();
+		session.event = LOG_SESSION;
+		session.level = LOG_ERROR;
+		session.argCount = 4;
+		session.args[0] = LOG_MAGIC;
+		session.args[1] = LOG_FORMAT_VERSION;
+		session.args[2] = (uint32_t)wall;
+		session.args[3] = (uint32_t)(wall >> 32);
+		flush->file.write((const char*)&session, sizeof(session));
+		flush->file.flush();
+
+		BinaryLog::clock.store(&clock, std::memory_order_relaxed);
+		flush->thread = std::thread(FlushThread, std::ref(*flush));
+		flusher = flush;
+
+		currentLevel.store(level, std::memory_order_relaxed);
+		return true;
+	}
+
+	void BinaryLog::Close()
+	{
+		std::lock_guard<std::mutex> lock(mtxOpen);
+		if (flusher == NULL)
+			return;
+
+		currentLevel.store(LOG_OFF, std::memory_order_relaxed);
+
+		{
+			std::lock_guard<std::mutex> lockFlush(flusher->mtx);
+			flusher->quit = true;
+		}
+		flusher->cv.notify_one();
+		flusher->thread.join();
+
+		// Records written before the level changed; a record still being
+		// written stays in its ring until the next Open
+		Drain(flusher->file);
+
+		delete flusher;
+		flusher = NULL;
+	}
+
+	uint64_t BinaryLog::GetDroppedCount()
+	{
+		uint64_t count = 0;
+		for (Ring* ring = rings.load(std::memory_order_acquire); ring != NULL; ring = ring->next)
+			count += ring->dropped.load(std::memory_order_relaxed);
+		return count;
+	}
+
+	void BinaryLog::Append(uint8_t level, uint16_t event, uint8_t argCount,
+		uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+	{
+		static thread_local RingHolder holder;
+
+		Ring* ring = holder.ring;
+		if (ring == NULL) {
+			ring = ClaimRing();
+			holder.ring = ring;
+		}
+
+		uint32_t head = ring->head.load(std::memory_order_relaxed);
+		if (head - ring->tailSeen == LOG_RING_RECORDS) {
+			ring->tailSeen = ring->tail.load(std::memory_order_acquire);
+			if (head - ring->tailSeen == LOG_RING_RECORDS) {
+				CounterAdd(ring->dropped);
+				return;
+			}
+		}
+
+		LogRecord& record = ring->records[head & (LOG_RING_RECORDS - 1)];
+		record.time = clock.load(std::memory_order_relaxed)->Now();
+		record.thread = ring->thread.load(std::memory_order_relaxed);
+		record.event = event;
+		record.level = level;
+		record.argCount = argCount;
+		record.args[0] = a0;
+		record.args[1] = a1;
+		record.args[2] = a2;
+		record.args[3] = a3;
+
+		ring->head.store(head + 1, std::memory_order_release);
+	}
+
+	BinaryLog::Ring* BinaryLog::ClaimRing()
+	{
+		Ring* ring;
+		for (ring = rings.load(std::memory_order_acquire); ring != NULL; ring = ring->next) {
+			bool owned = false;
+			if (!ring->owned.load(std::memory_order_relaxed)
+				&& ring->owned.compare_exchange_strong(owned, true, std::memory_order_acquire))
+				break;
+		}
+
+		if (ring == NULL) {
+			ring = new Ring();
+			ring->next = rings.load(std::memory_order_relaxed);
+			while (!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)) {
+			}
+		}
+
+		ring->thread.store(CurrentThreadID(), std::memory_order_relaxed);
+		return ring;
+	}
+
+	void BinaryLog::FlushThread(Flusher& flush)
+	{
+		std::unique_lock<std::mutex> lock(flush.mtx);
+		while (!flush.quit) {
+			flush.cv.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+
+			lock.unlock();
+			Drain(flush.file);
+			lock.lock();
+		}
+	}
+
+	// Flusher thread, or Close once it has stopped
+	void BinaryLog::Drain(std::ofstream& file)
+	{
+		for (Ring* ring = rings.load(std::memory_order_acquire); ring != NULL; ring = ring->next) {
+			uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+			uint32_t head = ring->head.load(std::memory_order_acquire);
+
+			// Written in at most two pieces, around the end of the ring
+			while (tail != head) {
+				uint32_t index = tail & (LOG_RING_RECORDS - 1);
+				uint32_t count = head - tail;
+				if (count > LOG_RING_RECORDS - index)
+					count = LOG_RING_RECORDS - index;
+
+				file.write((const char*)&ring->records[index], count * sizeof(LogRecord));
+				tail += count;
+			}
+			ring->tail.store(tail, std::memory_order_release);
+
+			uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+			if (dropped != ring->droppedReported) {
+				LogRecord record = {};
+				record.time = clock.load(std::memory_order_relaxed)->Now();
+				record.thread = ring->thread.load(std::memory_order_relaxed);
+				record.event = LOG_DROPPED;
+				record.level = LOG_ERROR;
+				record.argCount = 2;
+				record.args[0] = record.thread;
+				record.args[1] = (uint32_t)(dropped - ring->droppedReported);
+				file.write((const char*)&record, sizeof(record));
+
+				ring->droppedReported = dropped;
+			}
+		}
+
+		file.flush();
+	}
+
+}
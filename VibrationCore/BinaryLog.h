@@ -0,0 +1,146 @@
+#pragma once
+#include "Clock.h"
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+
+namespace vibration {
+
+	// Levels of the log; records above the level set by Open are dropped at
+	// the call site for the cost of one relaxed load
+	enum LogLevel : uint8_t {
+		LOG_OFF,
+		LOG_ERROR,
+		LOG_INFO,
+		LOG_TRACE,
+	};
+
+	// What a record is; the decoder prints its arguments by this
+	enum LogEvent : uint16_t {
+		// First record of each Open: LOG_MAGIC, LOG_FORMAT_VERSION, and the
+		// wall clock of the record time in microseconds since 1970 (low, high)
+		LOG_SESSION,
+
+		// Records lost because the ring of a thread was full: thread, count
+		LOG_DROPPED,
+
+		// IDirectInputEffectDriver calls and their arguments
+		LOG_DEVICE_ID,
+		LOG_GET_VERSIONS,
+		LOG_ESCAPE,
+		LOG_SET_GAIN,
+		LOG_SEND_COMMAND,
+		LOG_GET_FF_STATE,
+		LOG_DOWNLOAD_EFFECT,
+		LOG_DESTROY_EFFECT,
+		LOG_START_EFFECT,
+		LOG_STOP_EFFECT,
+		LOG_GET_EFFECT_STATUS,
+
+		// A call above returned a failure: event, HRESULT, dwID
+		LOG_CALL_FAILED,
+
+		// Port opened on attach: dwID, port index
+		LOG_ATTACH,
+		LOG_DETACH,
+
+		LOG_EVENT_COUNT
+	};
+
+	const uint32_t LOG_MAGIC = 0x474c4256;	// "VBLG"
+	const uint32_t LOG_FORMAT_VERSION = 1;
+	const uint32_t LOG_MAX_ARGS = 4;
+
+	// Records each thread can hold before the flusher drains them
+	const uint32_t LOG_RING_RECORDS = 1024;
+	const uint32_t LOG_FLUSH_INTERVAL_MS = 20;
+
+	// Fixed-size record, as written to the file
+	struct LogRecord {
+		uint64_t time;
+		uint32_t thread;
+		uint16_t event;
+		uint8_t level;
+		uint8_t argCount;
+		uint32_t args[LOG_MAX_ARGS];
+	};
+	static_assert(sizeof(LogRecord) == 32, "LogRecord is the file format");
+
+	struct LogEventFormat {
+		const char* name;
+		const char* args[LOG_MAX_ARGS];
+	};
+
+	// Name and argument names of an event, for the decoder
+	const LogEventFormat& GetLogEventFormat(uint16_t event);
+
+	// Process wide binary log. Each thread writes records into a ring of its
+	// own without locking or allocating; a flusher thread drains the rings
+	// into the file every LOG_FLUSH_INTERVAL_MS. When a ring is full the
+	// record is dropped and counted, the caller never waits.
+	//
+	// Rings are claimed on the first record of a thread and released to
+	// later threads when it exits, so their number follows the peak count
+	// of logging threads. They live until the process ends.
+	class BinaryLog
+	{
+	public:
+		// Appends to the file at path; false if it cannot be opened. Times
+		// come from clock, which must outlive the log.
+		static bool Open(const char* path, uint8_t level, IClock& clock);
+
+		// Writes out what the rings hold and stops the flusher
+		static void Close();
+
+		static bool IsEnabled(uint8_t level) {
+			return level <= currentLevel.load(std::memory_order_relaxed);
+		}
+
+		static void Write(uint8_t level, uint16_t event) {
+			if (IsEnabled(level))
+				Append(level, event, 0, 0, 0, 0, 0);
+		}
+		static void Write(uint8_t level, uint16_t event, uint32_t a0) {
+			if (IsEnabled(level))
+				Append(level, event, 1, a0, 0, 0, 0);
+		}
+		static void Write(uint8_t level, uint16_t event, uint32_t a0, uint32_t a1) {
+			if (IsEnabled(level))
+				Append(level, event, 2, a0, a1, 0, 0);
+		}
+		static void Write(uint8_t level, uint16_t event, uint32_t a0, uint32_t a1, uint32_t a2) {
+			if (IsEnabled(level))
+				Append(level, event, 3, a0, a1, a2, 0);
+		}
+		static void Write(uint8_t level, uint16_t event, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+			if (IsEnabled(level))
+				Append(level, event, 4, a0, a1, a2, a3);
+		}
+
+		// Records lost to full rings since the process started
+		static uint64_t GetDroppedCount();
+
+	private:
+		struct Ring;
+		struct RingHolder;
+		struct Flusher;
+
+		static void Append(uint8_t level, uint16_t event, uint8_t argCount,
+			uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+		static Ring* ClaimRing();
+		static void FlushThread(Flusher& flush);
+		static void Drain(std::ofstream& file);
+
+		static std::atomic<uint8_t> currentLevel;
+		static std::atomic<IClock*> clock;
+		static std::atomic<Ring*> rings;
+
+		// Taken by Open and Close. The flusher is left running if the
+		// process ends without Close, so it is not destroyed under it by
+		// the static destructors.
+		static std::mutex mtxOpen;
+		static Flusher* flusher;
+	};
+
+}
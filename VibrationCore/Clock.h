@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+
+namespace vibration {
+
+	// Monotonic time source used for all effect timing, in microseconds
+	// from an arbitrary origin. Called from the caller and output threads.
+	class IClock
+	{
+	public:
+		virtual ~IClock() {}
+		virtual uint64_t Now() = 0;
+	};
+
+	// Times are compared through their signed difference, so they keep
+	// ordering correctly across a wrap of the counter
+	inline int64_t TimeDiff(uint64_t a, uint64_t b) {
+		return (int64_t)(a - b);
+	}
+	inline bool TimeReached(uint64_t now, uint64_t time) {
+		return TimeDiff(now, time) >= 0;
+	}
+
+	class SteadyClock : public IClock
+	{
+	public:
+		uint64_t Now() override {
+			return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	};
+
+}
@@ -0,0 +1,172 @@
+#include "DeviceRegistry.h"
+#include <thread>
+
+namespace vibration {
+
+	// How long a released port may take to deliver its stop report
+	static const std::chrono::milliseconds RELEASE_TIMEOUT(500);
+
+	DeviceRegistry::DeviceRegistry(IClock& clock, OutputScheduler& scheduler)
+		: clock(clock), scheduler(scheduler), readerHead(NULL)
+	{
+	}
+
+	DeviceRegistry::~DeviceRegistry()
+	{
+		UnregisterAll();
+
+		ReaderEntry* entry = readerHead.load();
+		while (entry != NULL) {
+			ReaderEntry* next = entry->next;
+			delete entry;
+			entry = next;
+		}
+	}
+
+	DeviceRegistry::PortReader::PortReader(DeviceRegistry& registry, uint32_t dwExternalID)
+		: entry(registry.FindEntry(dwExternalID)), port(NULL)
+	{
+		// Either Release sees the reader or the reader sees the port gone
+		if (entry != NULL) {
+			entry->readers.fetch_add(1);
+			port = entry->port.load();
+		}
+	}
+
+	DeviceRegistry::PortReader::~PortReader()
+	{
+		if (entry != NULL)
+			entry->readers.fetch_sub(1);
+	}
+
+	DeviceRegistry::ReaderEntry* DeviceRegistry::FindEntry(uint32_t dwExternalID) const
+	{
+		for (ReaderEntry* entry = readerHead.load(); entry != NULL; entry = entry->next) {
+			if (entry->dwExternalID == dwExternalID)
+				return entry;
+		}
+
+		return NULL;
+	}
+
+	VibrationPort& DeviceRegistry::Register(uint32_t dwExternalID, uint32_t dwPort, std::unique_ptr<IReportTransport> transport)
+	{
+		Unregister(dwExternalID);
+
+		std::unique_ptr<PortDevice> dev(new PortDevice());
+		dev->dwExternalID = dwExternalID;
+		dev->transport = std::move(transport);
+		dev->sink.reset(new AsyncReportSink(*dev->transport));
+		dev->port.reset(new VibrationPort(dwPort, clock, *dev->sink));
+
+		VibrationPort& port = *dev->port;
+		index[dwExternalID] = devices.size();
+		devices.push_back(std::move(dev));
+
+		scheduler.AddPort(port);
+
+		// Registrations are serialized, only readers run alongside
+		ReaderEntry* entry = FindEntry(dwExternalID);
+		if (entry == NULL) {
+			entry = new ReaderEntry();
+			entry->dwExternalID = dwExternalID;
+			entry->port = NULL;
+			entry->readers = 0;
+			entry->next = readerHead.load();
+			readerHead.store(entry);
+		}
+		entry->port.store(&port);
+
+		return port;
+	}
+
+	bool DeviceRegistry::Unregister(uint32_t dwExternalID)
+	{
+		std::unique_ptr<PortDevice> dev = Unlink(dwExternalID);
+		if (dev == NULL)
+			return false;
+
+		Release(std::move(dev));
+		return true;
+	}
+
+	std::unique_ptr<DeviceRegistry::PortDevice> DeviceRegistry::Unlink(uint32_t dwExternalID)
+	{
+		auto it = index.find(dwExternalID);
+		if (it == index.end())
+			return NULL;
+
+		size_t idx = it->second;
+		index.erase(it);
+		std::unique_ptr<PortDevice> dev = std::move(devices[idx]);
+		FindEntry(dwExternalID)->port.store(NULL);
+
+		// Keeps the entries dense
+		if (idx != devices.size() - 1) {
+			devices[idx] = std::move(devices.back());
+			index[devices[idx]->dwExternalID] = idx;
+		}
+		devices.pop_back();
+
+		return dev;
+	}
+
+	void DeviceRegistry::Release(std::unique_ptr<PortDevice> dev)
+	{
+		if (dev != NULL)
+			ReleaseDevice(*dev);
+	}
+
+	void DeviceRegistry::UnregisterAll()
+	{
+		for (ReaderEntry* entry = readerHead.load(); entry != NULL; entry = entry->next)
+			entry->port.store(NULL);
+
+		for (auto& dev : devices)
+			ReleaseDevice(*dev);
+
+		devices.clear();
+		index.clear();
+	}
+
+	VibrationPort* DeviceRegistry::Find(uint32_t dwExternalID)
+	{
+		auto it = index.find(dwExternalID);
+		if (it == index.end())
+			return NULL;
+
+		return devices[it->second]->port.get();
+	}
+
+	bool DeviceRegistry::GetTelemetry(uint32_t dwExternalID, PortTelemetry& telemetry)
+	{
+		auto it = index.find(dwExternalID);
+		if (it == index.end())
+			return false;
+
+		PortDevice& dev = *devices[it->second];
+		telemetry.dwSize = sizeof(PortTelemetry);
+		telemetry.dwVersion = TELEMETRY_VERSION;
+		dev.port->GetTelemetry(telemetry);
+		dev.sink->GetTelemetry(telemetry);
+		return true;
+	}
+
+	void DeviceRegistry::ReleaseDevice(PortDevice& dev)
+	{
+		// Readers that found the port before Unlink only copy its status
+		ReaderEntry* entry = FindEntry(dev.dwExternalID);
+		while (entry != NULL && entry->readers.load() != 0)
+			std::this_thread::yield();
+
+		// Queues the stop report; the scheduler keeps servicing the other ports
+		scheduler.RemovePort(*dev.port);
+		dev.port.reset();
+
+		// Lets the stop report reach the device, then cancels what is left
+		dev.sink->Drain(RELEASE_TIMEOUT);
+		dev.transport.reset();
+		dev.sink.reset();
+	}
+
+}
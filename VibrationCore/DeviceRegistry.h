@@ -0,0 +1,100 @@
+#pragma once
+#include "Clock.h"
+#include "ReportTransport.h"
+#include "AsyncReportSink.h"
+#include "VibrationPort.h"
+#include "OutputScheduler.h"
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace vibration {
+
+	// Per-port state of every attached adapter, keyed by the DirectInput
+	// external ID. Entries are stored densely and created/released with the
+	// device, so any number of adapters can be attached side by side.
+	//
+	// Not thread-safe: callers serialize access and must not post to a port
+	// while it is being unregistered. Release is the exception, it only
+	// touches the unlinked port and the scheduler. PortReader runs at any time.
+	class DeviceRegistry
+	{
+		struct ReaderEntry;
+
+	public:
+		struct PortDevice {
+			uint32_t dwExternalID;
+			std::unique_ptr<IReportTransport> transport;
+			std::unique_ptr<AsyncReportSink> sink;
+			std::unique_ptr<VibrationPort> port;
+		};
+
+		// Lock-free lookup for calls that run alongside all the others,
+		// such as the status queries. The port stays valid while the reader
+		// exists, Release waits for it.
+		class PortReader
+		{
+		public:
+			PortReader(DeviceRegistry& registry, uint32_t dwExternalID);
+			~PortReader();
+
+			PortReader(const PortReader&) = delete;
+			PortReader& operator=(const PortReader&) = delete;
+
+			// NULL for an unknown ID
+			VibrationPort* GetPort() const { return port; }
+
+		private:
+			ReaderEntry* entry;
+			VibrationPort* port;
+		};
+
+		DeviceRegistry(IClock& clock, OutputScheduler& scheduler);
+		~DeviceRegistry();
+
+		// Creates the output stage and engine of a port and registers it
+		// with the scheduler, replacing any port with the same external ID.
+		// dwPort is the port index within the adapter.
+		VibrationPort& Register(uint32_t dwExternalID, uint32_t dwPort, std::unique_ptr<IReportTransport> transport);
+
+		// Sends the stop report and releases the port
+		bool Unregister(uint32_t dwExternalID);
+		void UnregisterAll();
+
+		// Unregister in two steps for callers serializing the registry with
+		// a lock of their own: Unlink takes the port out under that lock
+		// (NULL for an unknown ID) and Release, which waits for the stop
+		// report to reach the device, runs once the lock is dropped.
+		std::unique_ptr<PortDevice> Unlink(uint32_t dwExternalID);
+		void Release(std::unique_ptr<PortDevice> dev);
+
+		VibrationPort* Find(uint32_t dwExternalID);
+		size_t GetCount() const { return devices.size(); }
+
+		// Counters and latency histograms of the port and its output stage
+		bool GetTelemetry(uint32_t dwExternalID, PortTelemetry& telemetry);
+
+	private:
+		// Port of an external ID for PortReader. Created on the first
+		// Register of the ID and kept until the registry goes away, so
+		// readers walk the list without a lock.
+		struct ReaderEntry {
+			uint32_t dwExternalID;
+			std::atomic<VibrationPort*> port;
+			std::atomic<uint32_t> readers;
+			ReaderEntry* next;
+		};
+
+		ReaderEntry* FindEntry(uint32_t dwExternalID) const;
+		void ReleaseDevice(PortDevice& dev);
+
+		IClock& clock;
+		OutputScheduler& scheduler;
+
+		std::vector<std::unique_ptr<PortDevice>> devices;
+		std::unordered_map<uint32_t, size_t> index;
+		std::atomic<ReaderEntry*> readerHead;
+	};
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "EffectParams.h"
+#include <cstdint>
+
+namespace vibration {
+
+	enum CommandType : uint8_t {
+		CMD_DOWNLOAD_EFFECT,
+		CMD_START_EFFECT,
+		CMD_STOP_EFFECT,
+		CMD_DESTROY_EFFECT,
+		CMD_STOP_ALL,
+		CMD_RESET,
+		CMD_PAUSE,
+		CMD_CONTINUE,
+		CMD_SET_ACTUATORS
+	};
+
+	// Same values as DIEP_START, DIEP_NORESTART and DIES_SOLO
+	const uint32_t DOWNLOAD_START = 0x20000000;
+	const uint32_t DOWNLOAD_NORESTART = 0x40000000;
+	const uint32_t START_SOLO = 0x00000001;
+
+	// Effect command posted by the DirectInput callers to the output thread.
+	// Parameters are decoded on the caller side so the output thread only
+	// has to apply them to the effect pool.
+	struct EffectCommand {
+		uint8_t type;
+		// CMD_SET_ACTUATORS: nonzero to turn them on
+		uint32_t dwFlags;
+		uint32_t dwHandle;
+
+		// CMD_START_EFFECT: plays, EFFECT_INFINITE to repeat until stopped
+		uint32_t dwIterations;
+
+		// Caller time of the command
+		uint64_t time;
+
+		// CMD_DOWNLOAD_EFFECT only
+		EffectParams params;
+	};
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+
+namespace vibration {
+
+	// Same value as INFINITE on Windows
+	const uint32_t EFFECT_INFINITE = 0xFFFFFFFF;
+
+	// dwEffectID values registered by CDllRegistrar
+	enum EffectType : uint32_t {
+		EFFECT_CONSTANT = 0,
+		EFFECT_RAMP = 1,
+		EFFECT_SQUARE = 2,
+		EFFECT_SINE = 3,
+		EFFECT_TRIANGLE = 4,
+		EFFECT_SAWTOOTH_UP = 5,
+		EFFECT_SAWTOOTH_DOWN = 6,
+		EFFECT_SPRING = 7,
+		EFFECT_DAMPER = 8,
+		EFFECT_INERTIA = 9,
+		EFFECT_FRICTION = 10,
+		EFFECT_CUSTOM = 0x100
+	};
+
+	// Layout compatible with DIENVELOPE
+	struct Envelope {
+		uint32_t dwSize;
+		uint32_t dwAttackLevel;
+		uint32_t dwAttackTime;
+		uint32_t dwFadeLevel;
+		uint32_t dwFadeTime;
+	};
+
+	// Platform-neutral copy of the DIEFFECT fields used by the engine.
+	// Times are in microseconds, as in DirectInput.
+	struct EffectDesc {
+		uint32_t dwDuration;
+		uint32_t dwGain;
+		uint32_t dwStartDelay;
+		uint32_t cAxes;
+		const int32_t* rglDirection;
+		uint32_t cbTypeSpecificParams;
+		const void* lpvTypeSpecificParams;
+		const Envelope* lpEnvelope;
+		uint32_t dwSamplePeriod;
+
+		// Rank of the effect for MIX_PRIORITY, 1..255. 0 ranks effects with
+		// a finite duration (impacts) above infinite ones (ambient loops).
+		uint32_t dwPriority;
+	};
+
+	// Layout compatible with DICONSTANTFORCE
+	struct ConstantForce {
+		int32_t lMagnitude;
+	};
+
+	// Layout compatible with DIRAMPFORCE
+	struct RampForce {
+		int32_t lStart;
+		int32_t lEnd;
+	};
+
+	// Layout compatible with DICUSTOMFORCE
+	struct CustomForce {
+		uint32_t cChannels;
+		uint32_t dwSamplePeriod;
+		uint32_t cSamples;
+		const int32_t* rglForceData;
+	};
+
+	// Layout compatible with DIPERIODIC
+	struct PeriodicForce {
+		uint32_t dwMagnitude;
+		int32_t lOffset;
+		uint32_t dwPhase;
+		uint32_t dwPeriod;
+	};
+
+}
@@ -0,0 +1,179 @@
+#include "EffectHandles.h"
+
+namespace vibration {
+
+	EffectHandles::EffectHandles()
+		: freeHead(0), useCounter(0), epoch(0), policy(EVICT_LEAST_RECENTLY_USED)
+	{
+		for (uint32_t k = 0; k < EFFECT_POOL_SIZE; k++) {
+			slots[k].dwHandle = 0;
+			slots[k].gen = 0;
+			slots[k].lastUse = 0;
+			slots[k].magnitude = 0;
+			slots[k].epoch = 0;
+		}
+
+		// Lowest slots on top
+		for (uint32_t k = EFFECT_POOL_SIZE; k-- > 0;)
+			PushFree(k);
+	}
+
+	void EffectHandles::PushFree(uint32_t slot)
+	{
+		uint64_t head = freeHead.load(std::memory_order_relaxed);
+		uint64_t next;
+		do {
+			slots[slot].nextFree.store((uint32_t)head, std::memory_order_relaxed);
+			next = (((head >> 32) + 1) << 32) | (slot + 1);
+		} while (!freeHead.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	bool EffectHandles::PopFree(uint32_t& slot)
+	{
+		uint64_t head = freeHead.load(std::memory_order_acquire);
+		while ((uint32_t)head != 0) {
+			uint32_t top = (uint32_t)head - 1;
+			uint64_t next = (((head >> 32) + 1) << 32) | slots[top].nextFree.load(std::memory_order_relaxed);
+
+			if (freeHead.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) {
+				slot = top;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Only called by the thread that owns the slot
+	uint32_t EffectHandles::NextHandle(uint32_t slot)
+	{
+		uint32_t gen = slots[slot].gen.load(std::memory_order_relaxed) + 1;
+		slots[slot].gen.store(gen, std::memory_order_relaxed);
+		return MakeEffectHandle(slot, gen);
+	}
+
+	bool EffectHandles::Evict(uint32_t& slot, uint32_t& dwEvicted)
+	{
+		bool byMagnitude = policy == EVICT_LOWEST_MAGNITUDE;
+
+		// Only runs when every slot is taken
+		uint32_t victim = EFFECT_POOL_SIZE;
+		int32_t victimUse = 0;
+		uint8_t victimMagnitude = 0;
+		uint32_t now = useCounter.load(std::memory_order_relaxed);
+
+		for (uint32_t k = 0; k < EFFECT_POOL_SIZE; k++) {
+			if (slots[k].dwHandle.load(std::memory_order_relaxed) == 0)
+				continue;
+
+			// Touched after now was read
+			int32_t age = (int32_t)(now - slots[k].lastUse.load(std::memory_order_relaxed));
+			if (age < 0)
+				age = 0;
+
+			uint8_t magnitude = slots[k].magnitude.load(std::memory_order_relaxed);
+
+			bool better = victim == EFFECT_POOL_SIZE;
+			if (!better && byMagnitude && magnitude != victimMagnitude)
+				better = magnitude < victimMagnitude;
+			else if (!better)
+				better = age > victimUse;
+
+			if (better) {
+				victim = k;
+				victimUse = age;
+				victimMagnitude = magnitude;
+			}
+		}
+
+		if (victim == EFFECT_POOL_SIZE)
+			return false;
+
+		// Two callers may pick the same victim; the exchange decides
+		uint32_t dwOld = slots[victim].dwHandle.load(std::memory_order_relaxed);
+		uint32_t dwNew = MakeEffectHandle(victim, EffectHandleGen(dwOld) + 1);
+		if (dwOld == 0 || !slots[victim].dwHandle.compare_exchange_strong(dwOld, dwNew))
+			return false;
+
+		slots[victim].gen.store(EffectHandleGen(dwNew), std::memory_order_relaxed);
+
+		slot = victim;
+		dwEvicted = dwOld;
+		return true;
+	}
+
+	uint32_t EffectHandles::Allocate(uint8_t magnitude, uint32_t& dwEvicted)
+	{
+		dwEvicted = 0;
+
+		uint32_t slot;
+		for (;;) {
+			if (PopFree(slot)) {
+				slots[slot].dwHandle.store(NextHandle(slot));
+				break;
+			}
+
+			// Lost the victim to another caller or a release; look again
+			if (Evict(slot, dwEvicted))
+				break;
+		}
+
+		slots[slot].epoch.store(epoch.load());
+
+		uint32_t dwHandle = slots[slot].dwHandle.load(std::memory_order_relaxed);
+		Touch(dwHandle, magnitude);
+		return dwHandle;
+	}
+
+	bool EffectHandles::IsCurrent(uint32_t dwHandle) const
+	{
+		uint32_t slot = EffectHandleSlot(dwHandle);
+		return slot < EFFECT_POOL_SIZE && slots[slot].dwHandle.load(std::memory_order_relaxed) == dwHandle;
+	}
+
+	void EffectHandles::Touch(uint32_t dwHandle)
+	{
+		if (!IsCurrent(dwHandle))
+			return;
+
+		Slot& s = slots[EffectHandleSlot(dwHandle)];
+		s.lastUse.store(useCounter.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void EffectHandles::Touch(uint32_t dwHandle, uint8_t magnitude)
+	{
+		if (!IsCurrent(dwHandle))
+			return;
+
+		Touch(dwHandle);
+		slots[EffectHandleSlot(dwHandle)].magnitude.store(magnitude, std::memory_order_relaxed);
+	}
+
+	void EffectHandles::Release(uint32_t dwHandle)
+	{
+		uint32_t slot = EffectHandleSlot(dwHandle);
+		if (slot >= EFFECT_POOL_SIZE)
+			return;
+
+		// Fails if the slot was evicted in the meantime; it then still
+		// belongs to the new handle
+		uint32_t expected = dwHandle;
+		if (slots[slot].dwHandle.compare_exchange_strong(expected, 0))
+			PushFree(slot);
+	}
+
+	void EffectHandles::ReleaseAll()
+	{
+		// A handle allocated while the slots are scanned either is seen
+		// with an older epoch and released, or posts its download after
+		// the reset command
+		uint32_t current = epoch.fetch_add(1) + 1;
+
+		for (uint32_t k = 0; k < EFFECT_POOL_SIZE; k++) {
+			uint32_t dwHandle = slots[k].dwHandle.load();
+			if (dwHandle != 0 && (int32_t)(slots[k].epoch.load() - current) < 0)
+				Release(dwHandle);
+		}
+	}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "EffectPool.h"
+#include <atomic>
+
+namespace vibration {
+
+	// Effect to replace when DownloadEffect needs a handle and the pool is full
+	enum EvictionPolicy : uint8_t {
+		EVICT_LEAST_RECENTLY_USED,
+		EVICT_LOWEST_MAGNITUDE
+	};
+
+	// Caller side handle allocation of an EffectPool. Free slots are kept in
+	// a lock-free stack so DownloadEffect hands out a handle without waiting
+	// for the output thread; slots only go back to it once the output thread
+	// has destroyed their effect.
+	class EffectHandles
+	{
+	public:
+		EffectHandles();
+
+		// New handle for an effect. When the pool is full the victim chosen
+		// by the eviction policy is reused under a new generation and its
+		// old handle is returned through dwEvicted (0 otherwise).
+		uint32_t Allocate(uint8_t magnitude, uint32_t& dwEvicted);
+
+		bool IsCurrent(uint32_t dwHandle) const;
+
+		// Records a download or start for the eviction policy
+		void Touch(uint32_t dwHandle);
+		void Touch(uint32_t dwHandle, uint8_t magnitude);
+
+		// Gives back the slot of a destroyed effect; no-op for stale handles
+		void Release(uint32_t dwHandle);
+
+		// Releases every handle allocated before the call (DISFFC_RESET), on
+		// the caller side once the reset command is posted. Handles
+		// allocated by concurrent or later calls are kept, their download
+		// is posted behind the reset.
+		void ReleaseAll();
+
+		void SetEvictionPolicy(EvictionPolicy policy) { this->policy = policy; }
+
+	private:
+		struct Slot {
+			std::atomic<uint32_t> dwHandle;
+			std::atomic<uint32_t> gen;
+			std::atomic<uint32_t> nextFree;
+			std::atomic<uint32_t> lastUse;
+			std::atomic<uint8_t> magnitude;
+
+			// ReleaseAll epoch the handle was allocated in
+			std::atomic<uint32_t> epoch;
+		};
+
+		void PushFree(uint32_t slot);
+		bool PopFree(uint32_t& slot);
+		bool Evict(uint32_t& slot, uint32_t& dwEvicted);
+		uint32_t NextHandle(uint32_t slot);
+
+		Slot slots[EFFECT_POOL_SIZE];
+
+		// ABA tag in the high 32 bits, slot + 1 of the top in the low ones
+		std::atomic<uint64_t> freeHead;
+
+		std::atomic<uint32_t> useCounter;
+		std::atomic<uint32_t> epoch;
+		std::atomic<EvictionPolicy> policy;
+	};
+
+}
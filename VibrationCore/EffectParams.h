@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+
+namespace vibration {
+
+	class SampleBuffer;
+
+	enum EffectKind : uint8_t {
+		KIND_CONSTANT,
+		KIND_PERIODIC,
+		KIND_RAMP,
+		KIND_CUSTOM
+	};
+
+	// Same order as EFFECT_SQUARE..EFFECT_SAWTOOTH_DOWN
+	enum Waveform : uint8_t {
+		WAVE_SQUARE,
+		WAVE_SINE,
+		WAVE_TRIANGLE,
+		WAVE_SAWTOOTH_UP,
+		WAVE_SAWTOOTH_DOWN,
+		WAVE_COUNT
+	};
+
+	// Motors driven by an effect
+	const uint8_t MOTOR_X = 0x01;
+	const uint8_t MOTOR_Y = 0x02;
+
+	// Effect parameters decoded on the caller thread. Levels are in
+	// DirectInput units (-10000..10000).
+	struct EffectParams {
+		uint8_t kind;
+		uint8_t waveform;
+		uint8_t motors;
+
+		// Higher ranks silence lower ones under MIX_PRIORITY
+		uint8_t priority;
+
+		// Level of a constant effect, amplitude of a periodic one, largest
+		// absolute level of a ramp
+		int32_t lMagnitude;
+		int32_t lOffset;
+
+		// Levels at the start and end of a ramp
+		int32_t lRampStart;
+		int32_t lRampEnd;
+
+		// Hundredths of a degree
+		uint32_t dwPhase;
+
+		// Microseconds
+		uint32_t dwPeriod;
+
+		// Samples of a custom force, one per channel and sample period. The
+		// holder of the params owns a reference.
+		SampleBuffer* samples;
+		uint32_t dwSamplePeriod;
+
+		// Microseconds
+		uint32_t dwStartDelay;
+		uint32_t dwDuration;
+
+		// 0..10000, scales the motor forces of the effect
+		uint32_t dwGain;
+
+		// Envelope of the magnitude, levels 0..10000 and times in
+		// microseconds
+		bool hasEnvelope;
+		uint32_t dwAttackLevel;
+		uint32_t dwAttackTime;
+		uint32_t dwFadeLevel;
+		uint32_t dwFadeTime;
+	};
+
+	inline int32_t ClampLevel(int32_t level) {
+		return level < -10000 ? -10000 : level > 10000 ? 10000 : level;
+	}
+
+	// Strongest force of a single effect
+	const uint8_t FORCE_MAX = 0xfe;
+
+	// Motor force of a level: -10000 is off, 10000 is 0xfe
+	inline uint8_t ForceFromLevel(int32_t level) {
+		return (uint8_t)(((ClampLevel(level) + 10000) * 254 + 10000) / 20000);
+	}
+
+	// Gain in Q16 so scaling a force is a multiply and a shift
+	inline uint32_t GainToQ16(uint32_t dwGain) {
+		return ((dwGain > 10000 ? 10000 : dwGain) * 65536 + 5000) / 10000;
+	}
+
+	inline uint8_t ScaleForce(uint8_t force, uint32_t gainQ16) {
+		return (uint8_t)((force * gainQ16 + 32768) >> 16);
+	}
+
+}
@@ -0,0 +1,495 @@
+#include "EffectPool.h"
+#include "EffectDesc.h"
+#include "WaveTables.h"
+#include "SampleBuffer.h"
+#include <cstddef>
+
+#define DISABLE_INFINITE_VIBRATION
+
+// Fixed point unit of the ramp and envelope levels
+#define Q32 4294967296ll
+
+#define MAXC(a, b) ((a) > (b) ? (a) : (b))
+#define MINC(a, b) ((a) < (b) ? (a) : (b))
+
+namespace vibration {
+
+	EffectPool::EffectPool()
+		: mixMode(MIX_MAX)
+	{
+		for (uint32_t k = 0; k < EFFECT_POOL_SIZE; k++)
+			effects[k].params.samples = NULL;
+
+		Clear();
+	}
+
+	EffectPool::~EffectPool()
+	{
+		Clear();
+	}
+
+	void EffectPool::ReleaseSamples(VibrationEff& eff)
+	{
+		if (eff.params.samples != NULL) {
+			eff.params.samples->Release();
+			eff.params.samples = NULL;
+		}
+	}
+
+	void EffectPool::Clear()
+	{
+		for (uint32_t k = 0; k < EFFECT_POOL_SIZE; k++) {
+			ReleaseSamples(effects[k]);
+			effects[k].dwHandle = 0;
+			effects[k].isActive = false;
+			effects[k].started = false;
+			effects[k].dirty = true;
+			dirtySlots[k] = k;
+		}
+		activeCount = 0;
+		downloadedCount = 0;
+		dirtyCount = EFFECT_POOL_SIZE;
+		paused = false;
+	}
+
+	void EffectPool::MarkDirty(VibrationEff& eff)
+	{
+		if (!eff.dirty) {
+			eff.dirty = true;
+			dirtySlots[dirtyCount++] = (uint32_t)(&eff - effects);
+		}
+	}
+
+	void EffectPool::ClearDirty()
+	{
+		for (uint32_t i = 0; i < dirtyCount; i++)
+			effects[dirtySlots[i]].dirty = false;
+		dirtyCount = 0;
+	}
+
+	VibrationEff* EffectPool::Lookup(uint32_t dwHandle)
+	{
+		uint32_t slot = EffectHandleSlot(dwHandle);
+		if (slot >= EFFECT_POOL_SIZE || effects[slot].dwHandle != dwHandle)
+			return NULL;
+
+		return &effects[slot];
+	}
+
+	void EffectPool::Activate(VibrationEff& eff)
+	{
+		if (eff.isActive)
+			return;
+
+		eff.isActive = true;
+		eff.activeIdx = activeCount;
+		active[activeCount++] = EffectHandleSlot(eff.dwHandle);
+		MarkDirty(eff);
+	}
+
+	void EffectPool::Deactivate(VibrationEff& eff)
+	{
+		if (!eff.isActive)
+			return;
+
+		// Swap with the last active effect
+		uint32_t last = active[--activeCount];
+		active[eff.activeIdx] = last;
+		effects[last].activeIdx = eff.activeIdx;
+
+		eff.isActive = false;
+		eff.started = false;
+		MarkDirty(eff);
+	}
+
+	VibrationEff& EffectPool::Download(uint32_t dwHandle, const EffectParams& params)
+	{
+		VibrationEff& eff = effects[EffectHandleSlot(dwHandle)];
+
+		if (eff.dwHandle != dwHandle) {
+			Deactivate(eff);
+			if (eff.dwHandle == 0)
+				downloadedCount++;
+
+			eff.dwHandle = dwHandle;
+			MarkDirty(eff);
+		}
+
+		// The samples reference moves from the params to the slot
+		SampleBuffer* oldSamples = eff.params.samples;
+		eff.params = params;
+		if (oldSamples != NULL)
+			oldSamples->Release();
+
+		// Updated samples of a playing effect may be shorter
+		if (params.kind == KIND_CUSTOM && eff.isActive && eff.sampleIdx >= params.samples->GetFrames())
+			eff.sampleIdx = 0;
+
+		eff.gainQ16 = GainToQ16(params.dwGain);
+
+		uint8_t force = ScaleForce(ForceFromLevel(params.lMagnitude), eff.gainQ16);
+		eff.forceX = (params.motors & MOTOR_X) ? force : 0;
+		eff.forceY = (params.motors & MOTOR_Y) ? force : 0;
+
+		eff.waveTable = GetWaveTable(params.waveform);
+
+		// 2^64 per period, at least two microseconds per period. Rounded up
+		// so a half period lands on the second half of the table.
+		eff.phaseStep = 0;
+		if (params.kind == KIND_PERIODIC && params.dwPeriod != 0)
+			eff.phaseStep = params.dwPeriod < 2 ? 0x8000000000000000ull : UINT64_MAX / params.dwPeriod + 1;
+
+		// Spread over the whole duration; an infinite ramp holds its start
+		eff.rampStep = 0;
+		if (params.kind == KIND_RAMP && params.dwDuration != 0 && params.dwDuration != EFFECT_INFINITE)
+			eff.rampStep = ((params.lRampEnd - params.lRampStart) * Q32) / params.dwDuration;
+
+		return eff;
+	}
+
+	bool EffectPool::IsInfiniteLimited()
+	{
+#ifdef DISABLE_INFINITE_VIBRATION
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	uint8_t EffectPool::PeakForce(const EffectParams& params)
+	{
+		if (params.motors == 0)
+			return 0;
+
+		int32_t level = params.lMagnitude;
+		if (params.kind == KIND_PERIODIC)
+			level = params.lOffset + (level < 0 ? -level : level);
+		else if (params.kind == KIND_RAMP)
+			level = MAXC(params.lRampStart, params.lRampEnd);
+
+		return ForceFromLevel(level);
+	}
+
+	void EffectPool::Start(uint32_t dwHandle, uint64_t now, uint32_t iterations)
+	{
+		VibrationEff* eff = Lookup(dwHandle);
+		if (eff == NULL)
+			return;
+
+		if (paused)
+			now = pauseTime;
+
+		eff->startTime = now + eff->params.dwStartDelay;
+		eff->started = false;
+		eff->iterations = iterations != 0 ? iterations : 1;
+		Activate(*eff);
+	}
+
+	void EffectPool::Stop(uint32_t dwHandle)
+	{
+		VibrationEff* eff = Lookup(dwHandle);
+		if (eff != NULL)
+			Deactivate(*eff);
+	}
+
+	bool EffectPool::Destroy(uint32_t dwHandle)
+	{
+		VibrationEff* eff = Lookup(dwHandle);
+		if (eff == NULL)
+			return false;
+
+		Deactivate(*eff);
+		ReleaseSamples(*eff);
+		MarkDirty(*eff);
+		eff->dwHandle = 0;
+		downloadedCount--;
+		return true;
+	}
+
+	void EffectPool::StopAll()
+	{
+		while (activeCount > 0)
+			Deactivate(effects[active[activeCount - 1]]);
+	}
+
+	void EffectPool::Pause(uint64_t now)
+	{
+		if (paused)
+			return;
+
+		paused = true;
+		pauseTime = now;
+	}
+
+	void EffectPool::Resume(uint64_t now)
+	{
+		if (!paused)
+			return;
+
+		paused = false;
+
+		// Everything the effects are timed on moves forward
+		uint64_t shift = now - pauseTime;
+		for (uint32_t i = 0; i < activeCount; i++) {
+			VibrationEff& eff = effects[active[i]];
+
+			if (!eff.started) {
+				eff.startTime += shift;
+				continue;
+			}
+
+			eff.stopTime += shift;
+			eff.envEndTime += shift;
+			eff.lastTime += shift;
+		}
+	}
+
+	// Envelope magnitude relative to the sustain magnitude in Q16; a
+	// sustain of 0 has the envelope relative to full strength
+	static uint32_t EnvelopeGain(const VibrationEff& eff)
+	{
+		int64_t level = eff.envLevel >> 32;
+		if (level <= 0)
+			return 0;
+
+		int32_t sustain = eff.params.lMagnitude < 0 ? -eff.params.lMagnitude : eff.params.lMagnitude;
+		return (uint32_t)((level << 16) / (sustain != 0 ? sustain : 10000));
+	}
+
+	// Force scaled by the envelope; above the sustain it saturates
+	static uint8_t ScaleEnvelope(uint8_t force, uint32_t envQ16)
+	{
+		uint64_t scaled = ((uint64_t)force * envQ16 + 32768) >> 16;
+		return (uint8_t)MINC(scaled, (uint64_t)FORCE_MAX);
+	}
+
+	// Starts an envelope stage at the given time, skipping the ones that
+	// are empty. Levels are set exactly at each stage boundary so the
+	// per-microsecond steps never drift across stages.
+	void EffectPool::EnterEnvelopeStage(VibrationEff& eff, uint8_t stage, uint64_t time)
+	{
+		const EffectParams& params = eff.params;
+		int32_t sustain = params.lMagnitude < 0 ? -params.lMagnitude : params.lMagnitude;
+		int32_t attackLevel = (int32_t)params.dwAttackLevel;
+
+		// Fade only applies to effects with a finite duration
+		bool hasFade = params.dwFadeTime != 0 && params.dwDuration != 0 && params.dwDuration != EFFECT_INFINITE;
+		uint32_t fadeTime = MINC(params.dwFadeTime, params.dwDuration);
+		uint64_t fadeStart = eff.stopTime - fadeTime;
+
+		if (stage == ENV_ATTACK && params.dwAttackTime > 0 && (!hasFade || fadeStart != time)) {
+			// A fade starting early cuts the attack short
+			uint64_t attackTime = params.dwAttackTime;
+			if (hasFade && fadeStart - time < attackTime)
+				attackTime = fadeStart - time;
+
+			eff.envStage = ENV_ATTACK;
+			eff.envLevel = attackLevel * Q32;
+			eff.envStep = ((sustain - attackLevel) * Q32) / params.dwAttackTime;
+			eff.envEndTime = time + attackTime;
+			eff.envHasEnd = true;
+			return;
+		}
+
+		if (stage != ENV_FADE && !(hasFade && fadeStart == time)) {
+			eff.envStage = ENV_SUSTAIN;
+			eff.envLevel = sustain * Q32;
+			eff.envStep = 0;
+			eff.envEndTime = fadeStart;
+			eff.envHasEnd = hasFade;
+			return;
+		}
+
+		// Fades from where the attack got to
+		int32_t level = sustain;
+		uint32_t elapsed = params.dwDuration - fadeTime;
+		if (elapsed < params.dwAttackTime)
+			level = attackLevel + (int32_t)(((int64_t)(sustain - attackLevel) * elapsed) / params.dwAttackTime);
+
+		eff.envStage = ENV_FADE;
+		eff.envLevel = level * Q32;
+		eff.envStep = (((int32_t)params.dwFadeLevel - level) * Q32) / fadeTime;
+		eff.envHasEnd = false;
+	}
+
+	void EffectPool::StepEnvelope(VibrationEff& eff, uint64_t now)
+	{
+		uint64_t from = eff.lastTime;
+
+		while (eff.envHasEnd && TimeReached(now, eff.envEndTime)) {
+			from = eff.envEndTime;
+			EnterEnvelopeStage(eff, eff.envStage + 1, from);
+		}
+
+		eff.envLevel += eff.envStep * TimeDiff(now, from);
+	}
+
+	// Advances a custom force to the sample played at the given time and
+	// returns the time of the next sample
+	uint64_t EffectPool::StepSamples(VibrationEff& eff, uint64_t now, int32_t& levelX, int32_t& levelY)
+	{
+		const SampleBuffer* samples = eff.params.samples;
+		uint32_t period = eff.params.dwSamplePeriod;
+
+		// The samples repeat for the whole duration
+		uint64_t elapsed = eff.samplePhase + (uint64_t)TimeDiff(now, eff.lastTime);
+		if (elapsed >= period) {
+			eff.sampleIdx = (eff.sampleIdx + elapsed / period) % samples->GetFrames();
+			elapsed %= period;
+		}
+		eff.samplePhase = elapsed;
+
+		const int32_t* sample = samples->GetSamples() + eff.sampleIdx * samples->GetChannels();
+		levelX = ClampLevel(sample[0]);
+		levelY = samples->GetChannels() > 1 ? ClampLevel(sample[1]) : levelX;
+
+		return now + (period - elapsed);
+	}
+
+	void EffectPool::SetMixMode(uint8_t mode)
+	{
+		mixMode = mode < MIX_MODE_COUNT ? mode : (uint8_t)MIX_MAX;
+	}
+
+	bool EffectPool::Mix(uint64_t now, uint8_t& forceX, uint8_t& forceY, uint64_t& nextTime)
+	{
+		if (paused) {
+			forceX = 0;
+			forceY = 0;
+			return false;
+		}
+
+		switch (mixMode) {
+		case MIX_SATURATING_SUM:
+			return MixWith<SaturatingSumMix>(now, forceX, forceY, nextTime);
+		case MIX_WEIGHTED_SUM:
+			return MixWith<WeightedSumMix>(now, forceX, forceY, nextTime);
+		case MIX_PRIORITY:
+			return MixWith<PriorityMix>(now, forceX, forceY, nextTime);
+		default:
+			return MixWith<MaxMix>(now, forceX, forceY, nextTime);
+		}
+	}
+
+	template <typename Policy>
+	bool EffectPool::MixWith(uint64_t now, uint8_t& forceX, uint8_t& forceY, uint64_t& nextTime)
+	{
+		Policy mix;
+
+		bool hasDeadline = false;
+		auto deadline = [&](uint64_t time) {
+			if (!hasDeadline || TimeDiff(time, nextTime) < 0)
+				nextTime = time;
+			hasDeadline = true;
+		};
+
+		// Walked backwards so Deactivate only moves visited effects
+		for (uint32_t i = activeCount; i-- > 0;) {
+			VibrationEff& eff = effects[active[i]];
+
+			// A play that ended starts over after the start delay, as with
+			// ff-memless; an INFINITE one only ends when it is limited
+			if (eff.started && eff.hasStop && TimeReached(now, eff.stopTime)
+				&& eff.iterations > 1 && eff.params.dwDuration != EFFECT_INFINITE) {
+				if (eff.iterations != EFFECT_INFINITE)
+					eff.iterations--;
+				eff.startTime = eff.stopTime + eff.params.dwStartDelay;
+				eff.started = false;
+			}
+
+			if (!eff.started) {
+				if (!TimeReached(now, eff.startTime)) {
+					deadline(eff.startTime);
+					continue;
+				}
+
+				eff.started = true;
+
+				// dwPhase is in hundredths of a degree
+				eff.phase = (((uint64_t)(eff.params.dwPhase % 36000) << 32) / 36000) << 32;
+				eff.lastTime = now;
+				eff.rampLevel = eff.params.lRampStart * Q32;
+				eff.sampleIdx = 0;
+				eff.samplePhase = 0;
+				eff.envEndTime = now;
+				eff.envHasEnd = false;
+
+				eff.hasStop = true;
+				if (eff.params.dwDuration != EFFECT_INFINITE) {
+					eff.stopTime = now + eff.params.dwDuration;
+				}
+#ifdef DISABLE_INFINITE_VIBRATION
+				else {
+					eff.stopTime = now + INFINITE_VIBRATION_US;
+				}
+#else
+				else {
+					eff.stopTime = now;
+					eff.hasStop = false;
+				}
+#endif
+
+				if (eff.params.hasEnvelope)
+					EnterEnvelopeStage(eff, ENV_ATTACK, now);
+			}
+
+			if (eff.hasStop) {
+				if (TimeReached(now, eff.stopTime)) {
+					Deactivate(eff);
+					continue;
+				}
+
+				deadline(eff.stopTime);
+			}
+
+			uint8_t effForceX = eff.forceX;
+			uint8_t effForceY = eff.forceY;
+
+			if (eff.params.kind != KIND_CONSTANT) {
+				int32_t level = eff.params.lMagnitude;
+				if (eff.params.kind == KIND_PERIODIC) {
+					eff.phase += eff.phaseStep * (uint64_t)TimeDiff(now, eff.lastTime);
+					level = eff.params.lOffset + ((level * WaveSample(eff.waveTable, eff.phase)) >> 15);
+
+					if (eff.phaseStep != 0)
+						deadline(now + EFFECT_TICK_US);
+				}
+				else if (eff.params.kind == KIND_RAMP) {
+					eff.rampLevel += eff.rampStep * TimeDiff(now, eff.lastTime);
+					level = (int32_t)(eff.rampLevel >> 32);
+
+					if (eff.rampStep != 0)
+						deadline(now + EFFECT_TICK_US);
+				}
+
+				int32_t levelY = level;
+				if (eff.params.kind == KIND_CUSTOM)
+					deadline(StepSamples(eff, now, level, levelY));
+
+				effForceX = (eff.params.motors & MOTOR_X) ? ScaleForce(ForceFromLevel(level), eff.gainQ16) : 0;
+				effForceY = (eff.params.motors & MOTOR_Y) ? ScaleForce(ForceFromLevel(levelY), eff.gainQ16) : 0;
+			}
+
+			if (eff.params.hasEnvelope) {
+				StepEnvelope(eff, now);
+
+				uint32_t envQ16 = EnvelopeGain(eff);
+				effForceX = ScaleEnvelope(effForceX, envQ16);
+				effForceY = ScaleEnvelope(effForceY, envQ16);
+
+				if (eff.envHasEnd)
+					deadline(eff.envEndTime);
+				if (eff.envStep != 0)
+					deadline(now + EFFECT_TICK_US);
+			}
+
+			eff.lastTime = now;
+
+			mix.Add(effForceX, effForceY, eff.params.priority);
+		}
+
+		mix.Result(forceX, forceY);
+		return hasDeadline;
+	}
+
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include "EffectParams.h"
+#include "MixPolicy.h"
+#include "Clock.h"
+#include <cstdint>
+
+namespace vibration {
+
+	// Effects per port
+	const uint32_t EFFECT_POOL_SIZE = 256;
+
+	// Mixing period in microseconds while an effect whose force changes
+	// over time plays, one report at the default MaxReportRate
+	const uint32_t EFFECT_TICK_US = 8000;
+
+	// Under DISABLE_INFINITE_VIBRATION (EffectPool.cpp), effects with an
+	// INFINITE duration stop after INFINITE_VIBRATION_US instead of playing
+	// until stopped
+	const uint32_t INFINITE_VIBRATION_US = 1000000;
+
+	// Effect handles returned through pdwEffect: slot + 1 in the low 16 bits,
+	// generation of the slot in the high 16 bits. Never 0.
+	inline uint32_t MakeEffectHandle(uint32_t slot, uint32_t gen) {
+		return ((gen & 0xFFFF) << 16) | (slot + 1);
+	}
+	inline uint32_t EffectHandleSlot(uint32_t dwHandle) {
+		return (dwHandle & 0xFFFF) - 1;
+	}
+	inline uint32_t EffectHandleGen(uint32_t dwHandle) {
+		return dwHandle >> 16;
+	}
+
+	enum EnvelopeStage : uint8_t {
+		ENV_ATTACK,
+		ENV_SUSTAIN,
+		ENV_FADE
+	};
+
+	struct VibrationEff {
+		uint32_t dwHandle;
+		EffectParams params;
+
+		// Times on the port clock. An effect without stop time plays
+		// until stopped.
+		uint64_t startTime;
+		uint64_t stopTime;
+		bool hasStop;
+
+		// Plays left including the current one, EFFECT_INFINITE to repeat
+		// until stopped. Each one waits for the start delay again.
+		uint32_t iterations;
+
+		// Forces of a constant effect
+		uint8_t forceX;
+		uint8_t forceY;
+
+		// Effect gain in Q16
+		uint32_t gainQ16;
+
+		uint64_t lastTime;
+
+		// Phase accumulator of a periodic effect, stepped by the
+		// microseconds elapsed since the last mix
+		const int16_t* waveTable;
+		uint64_t phase;
+		uint64_t phaseStep;
+
+		// Level of a ramp in Q32, stepped the same way
+		int64_t rampLevel;
+		int64_t rampStep;
+
+		// Sample of a custom force and microseconds spent on it
+		uint32_t sampleIdx;
+		uint64_t samplePhase;
+
+		// Envelope magnitude in Q32, stepped the same way until the end of
+		// the stage, if it has one. It scales the forces relative to the
+		// sustain magnitude, so an envelope at 0 turns the motors off.
+		uint8_t envStage;
+		int64_t envLevel;
+		int64_t envStep;
+		uint64_t envEndTime;
+		bool envHasEnd;
+
+		bool isActive;
+		bool started;
+		uint32_t activeIdx;
+
+		// Handle or activity changed since the last ClearDirty
+		bool dirty;
+	};
+
+	// Downloaded effects of a single port. Handles map to their slot in O(1)
+	// and only the started effects are kept in the active list that Mix
+	// walks. Output thread only.
+	class EffectPool
+	{
+	public:
+		EffectPool();
+		~EffectPool();
+
+		void Clear();
+
+		// Stores the effect parameters. A handle that is not the one of the
+		// slot (new or evicted effect) reinitializes the slot.
+		VibrationEff& Download(uint32_t dwHandle, const EffectParams& params);
+
+		// Ignored for stale handles. The effect plays iterations times
+		// (at least once), EFFECT_INFINITE repeating it until stopped.
+		void Start(uint32_t dwHandle, uint64_t now, uint32_t iterations = 1);
+		void Stop(uint32_t dwHandle);
+		bool Destroy(uint32_t dwHandle);
+		void StopAll();
+
+		// Freezes every effect where it is at the given time; Mix returns
+		// no force until Resume shifts all their times by the time spent
+		// paused. Effects started in between start on Resume.
+		void Pause(uint64_t now);
+		void Resume(uint64_t now);
+		bool IsPaused() const { return paused; }
+
+		VibrationEff* Lookup(uint32_t dwHandle);
+		uint32_t GetActiveCount() const { return activeCount; }
+		uint32_t GetDownloadedCount() const { return downloadedCount; }
+
+		// Slots whose handle or activity changed, for publishing the status
+		uint32_t GetDirtyCount() const { return dirtyCount; }
+		uint32_t GetDirtySlot(uint32_t i) const { return dirtySlots[i]; }
+		const VibrationEff& GetSlot(uint32_t slot) const { return effects[slot]; }
+		void ClearDirty();
+
+		// Advances the effects to the given time and returns the mixed forces.
+		// Returns false when no effect has a pending start or stop time and
+		// none changes over time, otherwise nextTime is the earliest time
+		// the forces may change.
+		bool Mix(uint64_t now, uint8_t& forceX, uint8_t& forceY, uint64_t& nextTime);
+
+		// MixMode used by Mix, MIX_MAX by default
+		void SetMixMode(uint8_t mode);
+		uint8_t GetMixMode() const { return mixMode; }
+
+		// Strongest force the effect can request, for the eviction policy
+		static uint8_t PeakForce(const EffectParams& params);
+
+		// Whether INFINITE effects stop after INFINITE_VIBRATION_US
+		static bool IsInfiniteLimited();
+
+	private:
+		template <typename Policy>
+		bool MixWith(uint64_t now, uint8_t& forceX, uint8_t& forceY, uint64_t& nextTime);
+
+		static uint64_t StepSamples(VibrationEff& eff, uint64_t now, int32_t& levelX, int32_t& levelY);
+		void ReleaseSamples(VibrationEff& eff);
+		void EnterEnvelopeStage(VibrationEff& eff, uint8_t stage, uint64_t time);
+		void StepEnvelope(VibrationEff& eff, uint64_t now);
+		void MarkDirty(VibrationEff& eff);
+		void Activate(VibrationEff& eff);
+		void Deactivate(VibrationEff& eff);
+
+		VibrationEff effects[EFFECT_POOL_SIZE];
+		uint32_t active[EFFECT_POOL_SIZE];
+		uint32_t activeCount;
+		uint32_t downloadedCount;
+
+		bool paused;
+		uint64_t pauseTime;
+
+		uint8_t mixMode;
+
+		uint32_t dirtySlots[EFFECT_POOL_SIZE];
+		uint32_t dirtyCount;
+	};
+
+}
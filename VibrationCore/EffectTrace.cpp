@@ -0,0 +1,477 @@
+#include "EffectTrace.h"
+#include <chrono>
+#include <cstring>
+
+// Bounds of a record the reader accepts
+#define TRACE_MAX_PAYLOAD (16 * 1024 * 1024)
+#define TRACE_MAX_AXES 32
+
+namespace vibration {
+
+	static_assert((TRACE_RING_BYTES & (TRACE_RING_BYTES - 1)) == 0, "TRACE_RING_BYTES must be a power of two");
+
+	static const uint32_t HEADER_BYTES = 16;
+
+	static void EncodeHeader(uint8_t* header, uint64_t time, uint16_t type, uint32_t size)
+	{
+		uint16_t reserved = 0;
+		memcpy(header, &time, 8);
+		memcpy(header + 8, &type, 2);
+		memcpy(header + 10, &reserved, 2);
+		memcpy(header + 12, &size, 4);
+	}
+
+	EffectTraceWriter::EffectTraceWriter()
+		: open(false), busy(0), clock(NULL), recordTime(0), recordType(0), dropped(0),
+		head(0), tail(0), quit(false)
+	{
+	}
+
+	EffectTraceWriter::~EffectTraceWriter()
+	{
+		Close();
+	}
+
+	bool EffectTraceWriter::Open(const char* path, IClock& clock)
+	{
+		std::lock_guard<std::mutex> lock(mtxOpen);
+		CloseLocked();
+
+		file.open(path, std::ios_base::binary | std::ios_base::app);
+		if (!file.is_open())
+			return false;
+
+		// Written ahead of any record call
+		uint8_t session[HEADER_BYTES + 8];
+		EncodeHeader(session, clock.Now(), TRACE_SESSION, 8);
+		memcpy(session + HEADER_BYTES, &TRACE_MAGIC, 4);
+		memcpy(session + HEADER_BYTES + 4, &TRACE_FORMAT_VERSION, 4);
+		file.write((const char*)session, sizeof(session));
+		file.flush();
+
+		if (ring == NULL)
+			ring.reset(new uint8_t[TRACE_RING_BYTES]);
+		this->clock = &clock;
+		dropped = 0;
+		quit = false;
+		flusher = std::thread(&EffectTraceWriter::FlushThread, this);
+
+		open.store(true);
+		return true;
+	}
+
+	void EffectTraceWriter::Close()
+	{
+		std::lock_guard<std::mutex> lock(mtxOpen);
+		CloseLocked();
+	}
+
+	void EffectTraceWriter::CloseLocked()
+	{
+		if (!open.load())
+			return;
+
+		open.store(false);
+		while (busy.load() != 0)
+			std::this_thread::yield();
+
+		{
+			std::lock_guard<std::mutex> lockFlush(mtxFlush);
+			quit = true;
+		}
+		cvFlush.notify_one();
+		flusher.join();
+
+		// What the flusher left, then the records the ring could not take
+		// since the last one that fit
+		Drain();
+		if (dropped != 0) {
+			uint8_t record[HEADER_BYTES + 4];
+			EncodeHeader(record, clock->Now(), TRACE_DROPPED, 4);
+			memcpy(record + HEADER_BYTES, &dropped, 4);
+			file.write((const char*)record, sizeof(record));
+			dropped = 0;
+		}
+
+		file.close();
+		clock = NULL;
+	}
+
+	void EffectTraceWriter::DeviceID(uint32_t dwID, bool fBegin, uint32_t dwPort, uint32_t dwMaxReportRate, uint32_t dwMixMode)
+	{
+		if (!Begin(TRACE_DEVICE_ID))
+			return;
+
+		Put(dwID);
+		Put(fBegin ? 1 : 0);
+		Put(dwPort);
+		Put(dwMaxReportRate);
+		Put(dwMixMode);
+		End();
+	}
+
+	void EffectTraceWriter::DownloadEffect(uint32_t dwID, uint32_t dwEffectType, const EffectDesc& eff, uint32_t dwFlags,
+		uint32_t dwEffect, uint32_t dwResult)
+	{
+		if (!Begin(TRACE_DOWNLOAD_EFFECT))
+			return;
+
+		const CustomForce* custom = NULL;
+		if (dwEffectType == EFFECT_CUSTOM && eff.cbTypeSpecificParams == sizeof(CustomForce))
+			custom = (const CustomForce*)eff.lpvTypeSpecificParams;
+
+		uint32_t cAxes = eff.rglDirection != NULL ? eff.cAxes : 0;
+		uint32_t cbTypeSpecific = eff.lpvTypeSpecificParams != NULL ? eff.cbTypeSpecificParams : 0;
+
+		uint32_t flags = 0;
+		if (eff.lpEnvelope != NULL)
+			flags |= TRACE_HAS_ENVELOPE;
+		if (custom != NULL)
+			flags |= TRACE_CUSTOM_FORCE;
+
+		Put(dwID);
+		Put(dwEffectType);
+		Put(dwFlags);
+		Put(dwEffect);
+		Put(dwResult);
+		Put(eff.dwDuration);
+		Put(eff.dwGain);
+		Put(eff.dwStartDelay);
+		Put(eff.dwSamplePeriod);
+		Put(eff.dwPriority);
+		Put(cAxes);
+		Put(flags);
+		Put(cbTypeSpecific);
+
+		Put(eff.rglDirection, cAxes * sizeof(int32_t));
+		if (eff.lpEnvelope != NULL)
+			Put(eff.lpEnvelope, sizeof(Envelope));
+
+		// The samples are stored in place of the pointer to them
+		if (custom != NULL) {
+			uint32_t cSamples = custom->rglForceData != NULL ? custom->cSamples : 0;
+			Put(custom->cChannels);
+			Put(custom->dwSamplePeriod);
+			Put(cSamples);
+			Put(custom->rglForceData, cSamples * sizeof(int32_t));
+		}
+		else {
+			Put(eff.lpvTypeSpecificParams, cbTypeSpecific);
+		}
+		End();
+	}
+
+	void EffectTraceWriter::StartEffect(uint32_t dwID, uint32_t dwEffect, uint32_t dwMode, uint32_t dwCount)
+	{
+		if (!Begin(TRACE_START_EFFECT))
+			return;
+
+		Put(dwID);
+		Put(dwEffect);
+		Put(dwMode);
+		Put(dwCount);
+		End();
+	}
+
+	void EffectTraceWriter::StopEffect(uint32_t dwID, uint32_t dwEffect)
+	{
+		if (!Begin(TRACE_STOP_EFFECT))
+			return;
+
+		Put(dwID);
+		Put(dwEffect);
+		End();
+	}
+
+	void EffectTraceWriter::DestroyEffect(uint32_t dwID, uint32_t dwEffect)
+	{
+		if (!Begin(TRACE_DESTROY_EFFECT))
+			return;
+
+		Put(dwID);
+		Put(dwEffect);
+		End();
+	}
+
+	void EffectTraceWriter::Command(uint32_t dwID, uint32_t dwCommand)
+	{
+		if (!Begin(TRACE_COMMAND))
+			return;
+
+		Put(dwID);
+		Put(dwCommand);
+		End();
+	}
+
+	void EffectTraceWriter::SetGain(uint32_t dwID, uint32_t dwGain)
+	{
+		if (!Begin(TRACE_SET_GAIN))
+			return;
+
+		Put(dwID);
+		Put(dwGain);
+		End();
+	}
+
+	bool EffectTraceWriter::Begin(uint16_t type)
+	{
+		busy.fetch_add(1);
+		if (!open.load()) {
+			busy.fetch_sub(1);
+			return false;
+		}
+
+		recordTime = clock->Now();
+		recordType = type;
+		payload.clear();
+		return true;
+	}
+
+	void EffectTraceWriter::Put(const void* data, size_t size)
+	{
+		if (size == 0)
+			return;
+
+		size_t offset = payload.size();
+		payload.resize(offset + (size + 3) / 4, 0);
+		memcpy(&payload[offset], data, size);
+	}
+
+	void EffectTraceWriter::End()
+	{
+		if (dropped != 0 && Push(recordTime, TRACE_DROPPED, &dropped, 4))
+			dropped = 0;
+		if (dropped != 0 || !Push(recordTime, recordType, payload.data(), (uint32_t)(payload.size() * sizeof(uint32_t))))
+			dropped++;
+
+		// Attach and detach are rare and mark where a session starts or
+		// ends, the flusher writes them out right away
+		if (recordType == TRACE_DEVICE_ID)
+			cvFlush.notify_one();
+
+		busy.fetch_sub(1);
+	}
+
+	bool EffectTraceWriter::Push(uint64_t time, uint16_t type, const void* data, uint32_t size)
+	{
+		uint64_t position = head.load(std::memory_order_relaxed);
+		uint64_t space = TRACE_RING_BYTES - (position - tail.load(std::memory_order_acquire));
+		if ((uint64_t)HEADER_BYTES + size > space)
+			return false;
+
+		uint8_t header[HEADER_BYTES];
+		EncodeHeader(header, time, type, size);
+		CopyIn(position, header, HEADER_BYTES);
+		CopyIn(position + HEADER_BYTES, data, size);
+
+		head.store(position + HEADER_BYTES + size, std::memory_order_release);
+		return true;
+	}
+
+	// Written in at most two pieces, around the end of the ring
+	void EffectTraceWriter::CopyIn(uint64_t position, const void* data, uint32_t size)
+	{
+		uint32_t index = (uint32_t)(position & (TRACE_RING_BYTES - 1));
+		uint32_t first = size < TRACE_RING_BYTES - index ? size : TRACE_RING_BYTES - index;
+		if (first != 0)
+			memcpy(&ring[index], data, first);
+		if (size != first)
+			memcpy(&ring[0], (const uint8_t*)data + first, size - first);
+	}
+
+	void EffectTraceWriter::FlushThread()
+	{
+		std::unique_lock<std::mutex> lock(mtxFlush);
+		while (!quit) {
+			cvFlush.wait_for(lock, std::chrono::milliseconds(TRACE_FLUSH_INTERVAL_MS));
+
+			lock.unlock();
+			Drain();
+			lock.lock();
+		}
+	}
+
+	// Flusher thread, or Close once it has stopped
+	void EffectTraceWriter::Drain()
+	{
+		uint64_t position = tail.load(std::memory_order_relaxed);
+		uint64_t end = head.load(std::memory_order_acquire);
+		if (position == end)
+			return;
+
+		while (position != end) {
+			uint32_t index = (uint32_t)(position & (TRACE_RING_BYTES - 1));
+			uint64_t count = end - position;
+			if (count > TRACE_RING_BYTES - index)
+				count = TRACE_RING_BYTES - index;
+
+			file.write((const char*)&ring[index], (std::streamsize)count);
+			position += count;
+		}
+		tail.store(position, std::memory_order_release);
+
+		file.flush();
+	}
+
+	EffectTraceReader::EffectTraceReader()
+		: corrupt(false), position(0), envelope(), custom()
+	{
+	}
+
+	bool EffectTraceReader::Open(const char* path)
+	{
+		file.open(path, std::ios_base::binary);
+		if (!file.is_open())
+			return false;
+
+		TraceRecord record;
+		if (!Next(record) || record.type != TRACE_SESSION) {
+			file.close();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool EffectTraceReader::Next(TraceRecord& record)
+	{
+		memset(&record, 0, sizeof(record));
+
+		uint8_t header[16];
+		if (!file.read((char*)header, sizeof(header))) {
+			corrupt = file.gcount() != 0;
+			return false;
+		}
+
+		uint32_t size;
+		memcpy(&record.time, header, 8);
+		memcpy(&record.type, header + 8, 2);
+		memcpy(&size, header + 12, 4);
+
+		corrupt = true;
+		if (size % 4 != 0 || size > TRACE_MAX_PAYLOAD)
+			return false;
+
+		payload.resize(size / 4);
+		position = 0;
+		if (size != 0 && !file.read((char*)payload.data(), size))
+			return false;
+
+		switch (record.type) {
+		case TRACE_SESSION: {
+			uint32_t magic, version;
+			if (!Get(magic) || !Get(version) || magic != TRACE_MAGIC || version != TRACE_FORMAT_VERSION)
+				return false;
+			break;
+		}
+
+		case TRACE_DEVICE_ID:
+			if (!Get(record.dwID) || !Get(record.fBegin) || !Get(record.dwPort)
+				|| !Get(record.dwMaxReportRate) || !Get(record.dwMixMode))
+				return false;
+			break;
+
+		case TRACE_DOWNLOAD_EFFECT: {
+			EffectDesc& eff = record.eff;
+			uint32_t flags;
+			if (!Get(record.dwID) || !Get(record.dwEffectType) || !Get(record.dwFlags)
+				|| !Get(record.dwEffect) || !Get(record.dwResult) || !Get(eff.dwDuration)
+				|| !Get(eff.dwGain) || !Get(eff.dwStartDelay) || !Get(eff.dwSamplePeriod)
+				|| !Get(eff.dwPriority) || !Get(eff.cAxes) || !Get(flags) || !Get(eff.cbTypeSpecificParams))
+				return false;
+
+			if (eff.cAxes > TRACE_MAX_AXES)
+				return false;
+			directions.resize(eff.cAxes);
+			if (!Get(directions.data(), eff.cAxes * sizeof(int32_t)))
+				return false;
+			eff.rglDirection = eff.cAxes != 0 ? directions.data() : NULL;
+
+			if (flags & TRACE_HAS_ENVELOPE) {
+				if (!Get(&envelope, sizeof(envelope)))
+					return false;
+				eff.lpEnvelope = &envelope;
+			}
+
+			if (flags & TRACE_CUSTOM_FORCE) {
+				uint32_t cSamples;
+				if (!Get(custom.cChannels) || !Get(custom.dwSamplePeriod) || !Get(cSamples)
+					|| cSamples > payload.size() - position)
+					return false;
+
+				samples.resize(cSamples);
+				Get(samples.data(), cSamples * sizeof(int32_t));
+				custom.cSamples = cSamples;
+				custom.rglForceData = cSamples != 0 ? samples.data() : NULL;
+
+				// Pointer size of this build
+				eff.cbTypeSpecificParams = sizeof(CustomForce);
+				eff.lpvTypeSpecificParams = &custom;
+			}
+			else if (eff.cbTypeSpecificParams != 0) {
+				if (eff.cbTypeSpecificParams > (payload.size() - position) * sizeof(uint32_t))
+					return false;
+				typeSpecific.resize((eff.cbTypeSpecificParams + 3) / 4);
+				Get(typeSpecific.data(), eff.cbTypeSpecificParams);
+				eff.lpvTypeSpecificParams = typeSpecific.data();
+			}
+			break;
+		}
+
+		case TRACE_START_EFFECT:
+			if (!Get(record.dwID) || !Get(record.dwEffect) || !Get(record.dwFlags) || !Get(record.dwCount))
+				return false;
+			break;
+
+		case TRACE_STOP_EFFECT:
+		case TRACE_DESTROY_EFFECT:
+			if (!Get(record.dwID) || !Get(record.dwEffect))
+				return false;
+			break;
+
+		case TRACE_COMMAND:
+			if (!Get(record.dwID) || !Get(record.dwCommand))
+				return false;
+			break;
+
+		case TRACE_SET_GAIN:
+			if (!Get(record.dwID) || !Get(record.dwGain))
+				return false;
+			break;
+
+		case TRACE_DROPPED:
+			if (!Get(record.dwCount))
+				return false;
+			break;
+
+		default:
+			// Newer record types are skipped
+			break;
+		}
+
+		corrupt = false;
+		return true;
+	}
+
+	bool EffectTraceReader::Get(uint32_t& value)
+	{
+		if (position >= payload.size())
+			return false;
+
+		value = payload[position++];
+		return true;
+	}
+
+	bool EffectTraceReader::Get(void* data, size_t size)
+	{
+		size_t words = (size + 3) / 4;
+		if (words > payload.size() - position)
+			return false;
+
+		if (size != 0)
+			memcpy(data, &payload[position], size);
+		position += words;
+		return true;
+	}
+
+}
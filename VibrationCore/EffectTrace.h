@@ -0,0 +1,206 @@
+#pragma once
+#include "Clock.h"
+#include "EffectDesc.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vibration {
+
+	// SendForceFeedbackCommand values, same as DISFFC_*
+	enum DeviceCommand : uint32_t {
+		DEVICE_RESET = 0x01,
+		DEVICE_STOP_ALL = 0x02,
+		DEVICE_PAUSE = 0x04,
+		DEVICE_CONTINUE = 0x08,
+		DEVICE_ACTUATORS_ON = 0x10,
+		DEVICE_ACTUATORS_OFF = 0x20,
+	};
+
+	// A trace file is a sequence of records in call order: a 16 byte header
+	// (uint64 time in microseconds, uint16 type, uint16 reserved, uint32
+	// payload size) and a payload of little endian uint32 fields. Each Open
+	// appends a TRACE_SESSION record first.
+	const uint32_t TRACE_MAGIC = 0x52544256;	// "VBTR"
+	const uint32_t TRACE_FORMAT_VERSION = 1;
+
+	enum TraceRecordType : uint16_t {
+		// TRACE_MAGIC, TRACE_FORMAT_VERSION
+		TRACE_SESSION,
+
+		// dwID, fBegin, dwPort, dwMaxReportRate, dwMixMode
+		TRACE_DEVICE_ID,
+
+		// dwID, dwEffectType, dwFlags, dwEffect, dwResult, dwDuration, dwGain,
+		// dwStartDelay, dwSamplePeriod, dwPriority, cAxes, TraceEffectFlags,
+		// cbTypeSpecificParams, then the directions, the Envelope and the
+		// type specific parameters padded to 4 bytes. A CustomForce is
+		// stored as cChannels, dwSamplePeriod, cSamples and the samples.
+		TRACE_DOWNLOAD_EFFECT,
+
+		// dwID, dwEffect, dwMode, dwCount
+		TRACE_START_EFFECT,
+
+		// dwID, dwEffect
+		TRACE_STOP_EFFECT,
+		TRACE_DESTROY_EFFECT,
+
+		// dwID, dwCommand (DeviceCommand)
+		TRACE_COMMAND,
+
+		// dwID, dwGain
+		TRACE_SET_GAIN,
+
+		// dwCount: records lost to a full ring in place of this one
+		TRACE_DROPPED,
+	};
+
+	enum TraceEffectFlags : uint32_t {
+		TRACE_HAS_ENVELOPE = 0x01,
+		TRACE_CUSTOM_FORCE = 0x02,
+	};
+
+	// One decoded record; only the fields of its type are set
+	struct TraceRecord {
+		uint16_t type;
+		uint64_t time;
+		uint32_t dwID;
+
+		// TRACE_DEVICE_ID: attach (fBegin) or detach, and the settings the
+		// port was opened with
+		uint32_t fBegin;
+		uint32_t dwPort;
+		uint32_t dwMaxReportRate;
+		uint32_t dwMixMode;
+
+		// Effect calls. dwEffect is the handle passed in, dwResult the one
+		// DownloadEffect returned (0 if it failed); dwFlags holds the
+		// DownloadEffect flags or the StartEffect mode. dwCount is also
+		// the count of TRACE_DROPPED.
+		uint32_t dwEffect;
+		uint32_t dwEffectType;
+		uint32_t dwFlags;
+		uint32_t dwCount;
+		uint32_t dwResult;
+		EffectDesc eff;
+
+		// TRACE_COMMAND, TRACE_SET_GAIN
+		uint32_t dwCommand;
+		uint32_t dwGain;
+	};
+
+	// Bytes of records the writer holds before the flusher drains them
+	const uint32_t TRACE_RING_BYTES = 1 << 20;
+	const uint32_t TRACE_FLUSH_INTERVAL_MS = 20;
+
+	// Records the effect calls of the driver with the time they were made.
+	// A record call only copies the record into a ring, which a flusher
+	// thread writes to the file every TRACE_FLUSH_INTERVAL_MS, so callers
+	// never wait on the file. Records that do not fit are dropped and
+	// counted by a TRACE_DROPPED record ahead of the next one.
+	//
+	// The record calls are not thread-safe: callers serialize them, and
+	// they then appear in the order they were applied. Open and Close may
+	// run alongside them. Nothing is recorded while closed.
+	class EffectTraceWriter
+	{
+	public:
+		EffectTraceWriter();
+		~EffectTraceWriter();
+
+		// Appends to the file at path; false if it cannot be opened. The
+		// clock must stay valid until Close.
+		bool Open(const char* path, IClock& clock);
+
+		// Writes out what the ring holds and stops the flusher
+		void Close();
+		bool IsOpen() const { return open.load(); }
+
+		void DeviceID(uint32_t dwID, bool fBegin, uint32_t dwPort, uint32_t dwMaxReportRate, uint32_t dwMixMode);
+		void DownloadEffect(uint32_t dwID, uint32_t dwEffectType, const EffectDesc& eff, uint32_t dwFlags,
+			uint32_t dwEffect, uint32_t dwResult);
+		void StartEffect(uint32_t dwID, uint32_t dwEffect, uint32_t dwMode, uint32_t dwCount);
+		void StopEffect(uint32_t dwID, uint32_t dwEffect);
+		void DestroyEffect(uint32_t dwID, uint32_t dwEffect);
+		void Command(uint32_t dwID, uint32_t dwCommand);
+		void SetGain(uint32_t dwID, uint32_t dwGain);
+
+	private:
+		// False, recording nothing, while closed
+		bool Begin(uint16_t type);
+		void Put(uint32_t value) { payload.push_back(value); }
+		void Put(const void* data, size_t size);
+		void End();
+
+		bool Push(uint64_t time, uint16_t type, const void* data, uint32_t size);
+		void CopyIn(uint64_t position, const void* data, uint32_t size);
+		void CloseLocked();
+		void FlushThread();
+		void Drain();
+
+		// Either Close sees a record call in progress or the call sees the
+		// trace closed
+		std::atomic<bool> open;
+		std::atomic<uint32_t> busy;
+		IClock* clock;
+
+		// Record being built, and records lost since the last one that fit
+		uint64_t recordTime;
+		uint16_t recordType;
+		std::vector<uint32_t> payload;
+		uint32_t dropped;
+
+		// Single producer (the serialized record calls), single consumer
+		// (the flusher). Allocated by the first Open.
+		std::unique_ptr<uint8_t[]> ring;
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+
+		// Taken by Open and Close
+		std::mutex mtxOpen;
+
+		std::mutex mtxFlush;
+		std::condition_variable cvFlush;
+		bool quit;
+		std::ofstream file;
+		std::thread flusher;
+	};
+
+	class EffectTraceReader
+	{
+	public:
+		EffectTraceReader();
+
+		// False if the file is missing or does not start with a session of
+		// this version
+		bool Open(const char* path);
+
+		// False at the end of the trace or on a malformed record, in which
+		// case IsCorrupt tells them apart. The pointers of record.eff stay
+		// valid until the next call.
+		bool Next(TraceRecord& record);
+		bool IsCorrupt() const { return corrupt; }
+
+	private:
+		bool Get(uint32_t& value);
+		bool Get(void* data, size_t size);
+
+		std::ifstream file;
+		bool corrupt;
+
+		std::vector<uint32_t> payload;
+		size_t position;
+
+		std::vector<int32_t> directions;
+		Envelope envelope;
+		std::vector<uint32_t> typeSpecific;
+		std::vector<int32_t> samples;
+		CustomForce custom;
+	};
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "EffectParams.h"
+#include <cstdint>
+
+namespace vibration {
+
+	// How the forces of the playing effects combine into the motor forces
+	enum MixMode : uint8_t {
+		// Strongest effect per motor
+		MIX_MAX,
+
+		// Forces add up to FORCE_MAX
+		MIX_SATURATING_SUM,
+
+		// Strongest effect per motor plus MIX_WEIGHT of all the others,
+		// up to FORCE_MAX
+		MIX_WEIGHTED_SUM,
+
+		// Only the effects of the highest priority play, strongest per motor
+		MIX_PRIORITY,
+
+		MIX_MODE_COUNT
+	};
+
+	// Share of the weaker effects under MIX_WEIGHTED_SUM, in Q16
+	const uint32_t MIX_WEIGHT_Q16 = 0x8000;
+
+	// Combine steps of each MixMode. The mixer adds the forces of every
+	// playing effect and reads the result once; it is instantiated for each
+	// policy, so the combine step is inlined in its loop.
+	class MaxMix
+	{
+	public:
+		MaxMix() : x(0), y(0) {}
+
+		void Add(uint8_t forceX, uint8_t forceY, uint8_t /* priority */) {
+			x = forceX > x ? forceX : x;
+			y = forceY > y ? forceY : y;
+		}
+
+		void Result(uint8_t& forceX, uint8_t& forceY) const {
+			forceX = x;
+			forceY = y;
+		}
+
+	private:
+		uint8_t x;
+		uint8_t y;
+	};
+
+	class SaturatingSumMix
+	{
+	public:
+		SaturatingSumMix() : x(0), y(0) {}
+
+		void Add(uint8_t forceX, uint8_t forceY, uint8_t /* priority */) {
+			x += forceX;
+			y += forceY;
+		}
+
+		void Result(uint8_t& forceX, uint8_t& forceY) const {
+			forceX = (uint8_t)(x < FORCE_MAX ? x : FORCE_MAX);
+			forceY = (uint8_t)(y < FORCE_MAX ? y : FORCE_MAX);
+		}
+
+	private:
+		uint32_t x;
+		uint32_t y;
+	};
+
+	class WeightedSumMix
+	{
+	public:
+		WeightedSumMix() : sumX(0), sumY(0), maxX(0), maxY(0) {}
+
+		void Add(uint8_t forceX, uint8_t forceY, uint8_t /* priority */) {
+			sumX += forceX;
+			sumY += forceY;
+			maxX = forceX > maxX ? forceX : maxX;
+			maxY = forceY > maxY ? forceY : maxY;
+		}
+
+		void Result(uint8_t& forceX, uint8_t& forceY) const {
+			uint32_t x = maxX + (((sumX - maxX) * MIX_WEIGHT_Q16 + 32768) >> 16);
+			uint32_t y = maxY + (((sumY - maxY) * MIX_WEIGHT_Q16 + 32768) >> 16);
+			forceX = (uint8_t)(x < FORCE_MAX ? x : FORCE_MAX);
+			forceY = (uint8_t)(y < FORCE_MAX ? y : FORCE_MAX);
+		}
+
+	private:
+		uint32_t sumX;
+		uint32_t sumY;
+		uint8_t maxX;
+		uint8_t maxY;
+	};
+
+	class PriorityMix
+	{
+	public:
+		PriorityMix() : top(0), x(0), y(0) {}
+
+		// Effects of a higher priority replace what was mixed so far. The
+		// top starts at 0, so the lowest priority always counts.
+		void Add(uint8_t forceX, uint8_t forceY, uint8_t priority) {
+			if (priority > top) {
+				top = priority;
+				x = 0;
+				y = 0;
+			}
+			else if (priority < top) {
+				return;
+			}
+
+			x = forceX > x ? forceX : x;
+			y = forceY > y ? forceY : y;
+		}
+
+		void Result(uint8_t& forceX, uint8_t& forceY) const {
+			forceX = x;
+			forceY = y;
+		}
+
+	private:
+		uint8_t top;
+		uint8_t x;
+		uint8_t y;
+	};
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace vibration {
+
+	// Bounded lock-free multi-producer / single-consumer ring.
+	// Each cell carries a sequence number telling whether it is free for the
+	// producer of that lap or ready for the consumer (D. Vyukov's bounded queue).
+	template <typename T, size_t Capacity>
+	class MpscRing
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+		struct Cell {
+			std::atomic<size_t> sequence;
+			T data;
+		};
+
+	public:
+		MpscRing() : enqueuePos(0), dequeuePos(0) {
+			for (size_t i = 0; i < Capacity; i++)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		MpscRing(const MpscRing&) = delete;
+		MpscRing& operator=(const MpscRing&) = delete;
+
+		// Any thread. Returns false when the ring is full.
+		bool TryPush(const T& value) {
+			Cell* cell;
+			size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+			while (true) {
+				cell = &cells[pos & (Capacity - 1)];
+				size_t seq = cell->sequence.load(std::memory_order_acquire);
+				intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+				if (dif == 0) {
+					if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (dif < 0) {
+					return false;
+				}
+				else {
+					pos = enqueuePos.load(std::memory_order_relaxed);
+				}
+			}
+
+			cell->data = value;
+			cell->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer thread only. Returns false when the ring is empty.
+		bool TryPop(T& value) {
+			Cell* cell = &cells[dequeuePos & (Capacity - 1)];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+
+			if ((intptr_t)seq - (intptr_t)(dequeuePos + 1) < 0)
+				return false;
+
+			value = cell->data;
+			cell->sequence.store(dequeuePos + Capacity, std::memory_order_release);
+			dequeuePos++;
+			return true;
+		}
+
+	private:
+		Cell cells[Capacity];
+		alignas(64) std::atomic<size_t> enqueuePos;
+		alignas(64) size_t dequeuePos;
+	};
+
+}
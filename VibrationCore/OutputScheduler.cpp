@@ -0,0 +1,228 @@
+#include "OutputScheduler.h"
+#include "VibrationPort.h"
+
+namespace vibration {
+
+	OutputScheduler::OutputScheduler(IClock& clock)
+		: clock(clock), readyHead(NULL), registryDirty(false), portCount(0),
+		quit(false), wakeups(0), staleWakeups(0)
+	{
+	}
+
+	OutputScheduler::~OutputScheduler()
+	{
+		if (thrScheduler.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(mtxWake);
+				quit = true;
+			}
+			cvWake.notify_one();
+			thrScheduler.join();
+		}
+	}
+
+	void OutputScheduler::AddPort(VibrationPort& port)
+	{
+		std::lock_guard<std::mutex> registryLock(mtxRegistry);
+
+		if (!thrScheduler.joinable()) {
+			quit = false;
+			slots.clear();
+			timers = decltype(timers)();
+			thrScheduler = std::thread(&OutputScheduler::ThreadEntryPoint, this);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mtxPorts);
+			port.scheduler = this;
+			port.wakePending = false;
+			pendingAdds.push_back(&port);
+			portCount++;
+		}
+
+		Wake();
+	}
+
+	void OutputScheduler::RemovePort(VibrationPort& port)
+	{
+		std::lock_guard<std::mutex> registryLock(mtxRegistry);
+
+		{
+			std::unique_lock<std::mutex> lock(mtxPorts);
+			if (port.scheduler != this)
+				return;
+
+			pendingRemovals.push_back(&port);
+			Wake();
+
+			cvRemoved.wait(lock, [&] { return port.scheduler == NULL; });
+			portCount--;
+			if (portCount > 0)
+				return;
+		}
+
+		// Last port gone, nothing left to service
+		{
+			std::lock_guard<std::mutex> lock(mtxWake);
+			quit = true;
+		}
+		cvWake.notify_one();
+		thrScheduler.join();
+	}
+
+	void OutputScheduler::PushReady(VibrationPort& port)
+	{
+		VibrationPort* head = readyHead.load();
+		do {
+			port.nextReady = head;
+		} while (!readyHead.compare_exchange_weak(head, &port));
+
+		// The scheduler only sleeps with an empty list
+		if (head == NULL) {
+			std::lock_guard<std::mutex> lock(mtxWake);
+			cvWake.notify_one();
+		}
+	}
+
+	void OutputScheduler::Wake()
+	{
+		registryDirty = true;
+
+		std::lock_guard<std::mutex> lock(mtxWake);
+		cvWake.notify_one();
+	}
+
+	bool OutputScheduler::IsPending()
+	{
+		return readyHead.load() != NULL || registryDirty.load();
+	}
+
+	void OutputScheduler::Service(uint32_t slot)
+	{
+		Slot& s = slots[slot];
+
+		uint64_t nextTime;
+		if (s.port->Service(nextTime)) {
+			if (!s.hasTimer || s.timerTime != nextTime) {
+				s.gen++;
+				s.hasTimer = true;
+				s.timerTime = nextTime;
+				timers.push({ nextTime, slot, s.gen });
+			}
+		}
+		else if (s.hasTimer) {
+			s.gen++;
+			s.hasTimer = false;
+		}
+	}
+
+	bool OutputScheduler::IsStale(const Timer& t) const
+	{
+		const Slot& s = slots[t.slot];
+		return s.port == NULL || s.gen != t.gen || s.port->removing;
+	}
+
+	void OutputScheduler::ThreadEntryPoint()
+	{
+		std::vector<VibrationPort*> adds;
+		std::vector<VibrationPort*> removals;
+		bool timedOut = false;
+
+		while (true) {
+			wakeups++;
+
+			if (registryDirty.exchange(false)) {
+				std::lock_guard<std::mutex> lock(mtxPorts);
+				adds.swap(pendingAdds);
+				removals.swap(pendingRemovals);
+			}
+
+			// Taken after the registry so posts made before a removal request
+			// are seen while the port is still valid
+			VibrationPort* ready = readyHead.exchange(NULL);
+
+			for (VibrationPort* port : adds) {
+				uint32_t slot = 0;
+				while (slot < slots.size() && slots[slot].port != NULL)
+					slot++;
+				if (slot == slots.size())
+					slots.push_back(Slot());
+
+				slots[slot].port = port;
+				slots[slot].hasTimer = false;
+				port->slot = slot;
+				port->removing = false;
+
+				Service(slot);
+			}
+			adds.clear();
+
+			for (VibrationPort* port : removals)
+				port->removing = true;
+
+			while (ready != NULL) {
+				VibrationPort* port = ready;
+				ready = port->nextReady;
+
+				port->wakePending = false;
+				if (!port->removing)
+					Service(port->slot);
+			}
+
+			uint64_t now = clock.Now();
+			bool due = false;
+			while (!timers.empty()) {
+				Timer t = timers.top();
+				if (!TimeReached(now, t.time))
+					break;
+
+				timers.pop();
+				if (IsStale(t))
+					continue;
+
+				slots[t.slot].hasTimer = false;
+				Service(t.slot);
+				due = true;
+			}
+			if (timedOut && !due)
+				staleWakeups++;
+
+			if (!removals.empty()) {
+				for (VibrationPort* port : removals) {
+					Slot& s = slots[port->slot];
+					s.port = NULL;
+					s.gen++;
+					s.hasTimer = false;
+
+					port->Shutdown();
+				}
+
+				std::lock_guard<std::mutex> lock(mtxPorts);
+				for (VibrationPort* port : removals)
+					port->scheduler = NULL;
+				removals.clear();
+				cvRemoved.notify_all();
+			}
+
+			// Sleep until the earliest current deadline, not an old one
+			while (!timers.empty() && IsStale(timers.top()))
+				timers.pop();
+
+			std::unique_lock<std::mutex> lock(mtxWake);
+			if (quit)
+				break;
+
+			auto woken = [this] { return quit || IsPending(); };
+			timedOut = false;
+			if (!timers.empty()) {
+				int64_t dt = TimeDiff(timers.top().time, clock.Now());
+				if (dt > 0)
+					timedOut = !cvWake.wait_for(lock, std::chrono::microseconds(dt), woken);
+			}
+			else {
+				cvWake.wait(lock, woken);
+			}
+		}
+	}
+
+}
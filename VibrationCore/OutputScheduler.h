@@ -0,0 +1,103 @@
+#pragma once
+#include "Clock.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace vibration {
+
+	class VibrationPort;
+
+	// Services every registered port from a single thread. Ports are kept in
+	// a timer queue ordered by their next effect start/stop time and are
+	// also serviced as soon as a command is posted to them. The thread count
+	// does not depend on the number of ports.
+	//
+	// The thread runs while at least one port is registered.
+	class OutputScheduler
+	{
+	public:
+		OutputScheduler(IClock& clock);
+		~OutputScheduler();
+
+		void AddPort(VibrationPort& port);
+
+		// Sends the final stop report of the port and returns once the
+		// scheduler no longer references it. No command may be posted to
+		// the port while it is being removed.
+		void RemovePort(VibrationPort& port);
+
+		// Number of times the scheduler thread woke up
+		uint64_t GetWakeupCount() const { return wakeups; }
+
+		// Wakeups on a timer that had nothing due, e.g. the old deadline of
+		// a port whose deadline moved
+		uint64_t GetStaleWakeupCount() const { return staleWakeups; }
+
+	private:
+		friend class VibrationPort;
+
+		struct Slot {
+			VibrationPort* port;
+			uint32_t gen;
+			bool hasTimer;
+			uint64_t timerTime;
+		};
+
+		struct Timer {
+			uint64_t time;
+			uint32_t slot;
+			uint32_t gen;
+		};
+
+		struct TimerLater {
+			bool operator()(const Timer& a, const Timer& b) const {
+				return TimeDiff(a.time, b.time) > 0;
+			}
+		};
+
+		// Called by a port when its first command after a service is posted
+		void PushReady(VibrationPort& port);
+
+		void Wake();
+		void ThreadEntryPoint();
+		void Service(uint32_t slot);
+		bool IsStale(const Timer& t) const;
+		bool IsPending();
+
+		IClock& clock;
+
+		// Lock-free list of ports with pending commands. The scheduler takes
+		// the whole list at once, so there is no ABA on the head.
+		std::atomic<VibrationPort*> readyHead;
+
+		// Serializes AddPort/RemovePort and the thread start/stop
+		std::mutex mtxRegistry;
+
+		// Registration changes, applied by the scheduler thread
+		std::atomic<bool> registryDirty;
+		std::mutex mtxPorts;
+		std::condition_variable cvRemoved;
+		std::vector<VibrationPort*> pendingAdds;
+		std::vector<VibrationPort*> pendingRemovals;
+		size_t portCount;
+
+		// Scheduler thread only. A port has at most one current timer; the
+		// entries of its older deadlines stay queued until they reach the
+		// top and are dropped there.
+		std::vector<Slot> slots;
+		std::priority_queue<Timer, std::vector<Timer>, TimerLater> timers;
+
+		std::mutex mtxWake;
+		std::condition_variable cvWake;
+		bool quit;
+
+		std::atomic<uint64_t> wakeups;
+		std::atomic<uint64_t> staleWakeups;
+		std::thread thrScheduler;
+	};
+
+}
@@ -0,0 +1,83 @@
+#include "PortSnapshot.h"
+#include <thread>
+
+namespace vibration {
+
+	PortSnapshot::PortSnapshot()
+		: seq(0), dwState(STATE_EMPTY | STATE_STOPPED), dwLoad(0), forceX(0), forceY(0)
+	{
+		for (uint32_t k = 0; k < EFFECT_POOL_SIZE; k++)
+			effects[k].store(0, std::memory_order_relaxed);
+	}
+
+	void PortSnapshot::BeginUpdate()
+	{
+		seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	void PortSnapshot::SetEffect(uint32_t slot, uint32_t dwHandle, bool playing)
+	{
+		effects[slot].store(dwHandle | ((uint64_t)playing << 32), std::memory_order_relaxed);
+	}
+
+	void PortSnapshot::SetState(const PortState& state)
+	{
+		dwState.store(state.dwState, std::memory_order_relaxed);
+		dwLoad.store(state.dwLoad, std::memory_order_relaxed);
+		forceX.store(state.forceX, std::memory_order_relaxed);
+		forceY.store(state.forceY, std::memory_order_relaxed);
+	}
+
+	void PortSnapshot::EndUpdate()
+	{
+		seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	template <typename Read>
+	void PortSnapshot::ReadConsistent(Read read) const
+	{
+		for (;;) {
+			uint32_t before = seq.load(std::memory_order_acquire);
+			if ((before & 1) == 0) {
+				read();
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (seq.load(std::memory_order_relaxed) == before)
+					return;
+			}
+
+			// Updates are a handful of stores
+			std::this_thread::yield();
+		}
+	}
+
+	bool PortSnapshot::GetEffectStatus(uint32_t dwHandle, bool& playing) const
+	{
+		uint32_t slot = EffectHandleSlot(dwHandle);
+		if (slot >= EFFECT_POOL_SIZE)
+			return false;
+
+		uint64_t entry;
+		ReadConsistent([&] { entry = effects[slot].load(std::memory_order_relaxed); });
+
+		if ((uint32_t)entry != dwHandle)
+			return false;
+
+		playing = (entry >> 32) != 0;
+		return true;
+	}
+
+	PortState PortSnapshot::GetState() const
+	{
+		PortState state;
+		ReadConsistent([&] {
+			state.dwState = dwState.load(std::memory_order_relaxed);
+			state.dwLoad = dwLoad.load(std::memory_order_relaxed);
+			state.forceX = forceX.load(std::memory_order_relaxed);
+			state.forceY = forceY.load(std::memory_order_relaxed);
+		});
+		return state;
+	}
+
+}
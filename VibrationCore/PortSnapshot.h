@@ -0,0 +1,65 @@
+#pragma once
+#include "EffectPool.h"
+#include <atomic>
+#include <cstdint>
+
+namespace vibration {
+
+	// Same values as the DIGFFS_* flags
+	const uint32_t STATE_EMPTY = 0x00000001;
+	const uint32_t STATE_STOPPED = 0x00000002;
+	const uint32_t STATE_PAUSED = 0x00000004;
+	const uint32_t STATE_ACTUATORS_ON = 0x00000010;
+	const uint32_t STATE_ACTUATORS_OFF = 0x00000020;
+	const uint32_t STATE_POWER_ON = 0x00000040;
+	const uint32_t STATE_SAFETY_SWITCH_ON = 0x00000100;
+	const uint32_t STATE_USER_FF_SWITCH_ON = 0x00000400;
+
+	struct PortState {
+		// STATE_* flags
+		uint32_t dwState;
+
+		// Percentage of the effect pool in use
+		uint32_t dwLoad;
+
+		// Forces last sent to the device
+		uint8_t forceX;
+		uint8_t forceY;
+	};
+
+	// State of a port published by the output thread after each mixing
+	// pass, for the status queries of the DirectInput callers. Guarded by a
+	// sequence counter: readers retry while an update is in progress and
+	// never wait on the port lock.
+	class PortSnapshot
+	{
+	public:
+		PortSnapshot();
+
+		// Output thread only
+		void BeginUpdate();
+		void SetEffect(uint32_t slot, uint32_t dwHandle, bool playing);
+		void SetState(const PortState& state);
+		void EndUpdate();
+
+		// Any thread. Returns false for a handle the output thread has not
+		// seen yet.
+		bool GetEffectStatus(uint32_t dwHandle, bool& playing) const;
+		PortState GetState() const;
+
+	private:
+		template <typename Read>
+		void ReadConsistent(Read read) const;
+
+		std::atomic<uint32_t> seq;
+
+		// Handle of the slot, playing flag in bit 32
+		std::atomic<uint64_t> effects[EFFECT_POOL_SIZE];
+
+		std::atomic<uint32_t> dwState;
+		std::atomic<uint32_t> dwLoad;
+		std::atomic<uint8_t> forceX;
+		std::atomic<uint8_t> forceY;
+	};
+
+}
@@ -0,0 +1,75 @@
+#include "RateLimiter.h"
+#include "Clock.h"
+
+namespace vibration {
+
+	static const uint64_t TOKEN = 1000000;
+
+	RateLimiter::RateLimiter()
+		: rate(0), burst(1), tokens(0), lastTime(0), primed(false)
+	{
+	}
+
+	void RateLimiter::Configure(uint32_t reportsPerSecond, uint32_t burst)
+	{
+		rate = reportsPerSecond;
+		this->burst = burst > 0 ? burst : 1;
+		primed = false;
+	}
+
+	void RateLimiter::Refill(uint64_t now)
+	{
+		// Starts full
+		if (!primed) {
+			tokens = burst * TOKEN;
+			lastTime = now;
+			primed = true;
+			return;
+		}
+
+		int64_t dt = TimeDiff(now, lastTime);
+		if (dt <= 0)
+			return;
+
+		// A full bucket takes at most burst seconds to refill
+		if ((uint64_t)dt >= burst * TOKEN)
+			tokens = burst * TOKEN;
+		else
+			tokens += (uint64_t)dt * rate;
+		if (tokens > burst * TOKEN)
+			tokens = burst * TOKEN;
+		lastTime = now;
+	}
+
+	bool RateLimiter::TryAcquire(uint64_t now)
+	{
+		if (!IsEnabled())
+			return true;
+
+		Refill(now);
+		if (tokens < TOKEN)
+			return false;
+
+		tokens -= TOKEN;
+		return true;
+	}
+
+	void RateLimiter::Acquire(uint64_t now)
+	{
+		if (!TryAcquire(now))
+			tokens = 0;
+	}
+
+	uint64_t RateLimiter::NextTime(uint64_t now)
+	{
+		if (!IsEnabled())
+			return now;
+
+		Refill(now);
+		if (tokens >= TOKEN)
+			return now;
+
+		return now + (TOKEN - tokens + rate - 1) / rate;
+	}
+
+}
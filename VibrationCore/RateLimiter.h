@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+namespace vibration {
+
+	// Token bucket over the microsecond clock. Tokens are kept in millionths
+	// so any rate is exact. A rate of 0 disables the limiter.
+	class RateLimiter
+	{
+	public:
+		RateLimiter();
+
+		void Configure(uint32_t reportsPerSecond, uint32_t burst);
+		bool IsEnabled() const { return rate != 0; }
+
+		// Takes a token if one is available
+		bool TryAcquire(uint64_t now);
+
+		// Takes a token if one is available, never refuses
+		void Acquire(uint64_t now);
+
+		// First time at which TryAcquire will succeed
+		uint64_t NextTime(uint64_t now);
+
+	private:
+		void Refill(uint64_t now);
+
+		uint32_t rate;
+		uint32_t burst;
+		uint64_t tokens;
+		uint64_t lastTime;
+		bool primed;
+	};
+
+}
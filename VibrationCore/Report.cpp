@@ -0,0 +1,21 @@
+#include "Report.h"
+
+namespace vibration {
+
+	void SendVibrationForce(IReportSink& sink, uint8_t forceSmallMotor, uint8_t forceBigMotor, uint32_t dwID) {
+		uint8_t buffer1[REPORT_SIZE] = {
+			0x00, 0x01, 0x00, forceBigMotor, forceSmallMotor
+		};
+		buffer1[0] = (uint8_t) dwID + 1;
+		sink.SendReport(buffer1, REPORT_SIZE);
+	}
+
+	void SendVibrationStop(IReportSink& sink, uint32_t dwID) {
+		uint8_t GP_STOP_COMMAND[REPORT_SIZE] = {
+			0x00, 0x01, 0x00, 0x00, 0x00
+		};
+		GP_STOP_COMMAND[0] = (uint8_t) dwID + 1;
+		sink.SendReport(GP_STOP_COMMAND, REPORT_SIZE);
+	}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "ReportSink.h"
+
+namespace vibration {
+
+	// Output report of the VID_0810&PID_0001 adapter:
+	// { port + 1, 0x01, 0x00, big motor, small motor }
+	const size_t REPORT_SIZE = 5;
+
+	void SendVibrationForce(IReportSink& sink, uint8_t forceSmallMotor, uint8_t forceBigMotor, uint32_t dwID);
+	void SendVibrationStop(IReportSink& sink, uint32_t dwID);
+
+}
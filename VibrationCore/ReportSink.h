@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace vibration {
+
+	// Destination of the adapter output reports (HID device, fake device...)
+	class IReportSink
+	{
+	public:
+		virtual ~IReportSink() {}
+		virtual void SendReport(const uint8_t* buff, size_t buffsz) = 0;
+	};
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace vibration {
+
+	class IWriteCompletion
+	{
+	public:
+		virtual ~IWriteCompletion() {}
+		virtual void OnWriteComplete(bool success) = 0;
+	};
+
+	// Asynchronous report writer (overlapped HID write, fake endpoint...).
+	// Only one write is started at a time per transport.
+	class IReportTransport
+	{
+	public:
+		virtual ~IReportTransport() {}
+
+		// Starts writing the report. The buffer stays valid until completion
+		// is signaled, possibly from another thread or before returning.
+		// Returns false, without signaling, if the write could not start.
+		virtual bool BeginWrite(const uint8_t* buff, size_t buffsz, IWriteCompletion& completion) = 0;
+	};
+
+}
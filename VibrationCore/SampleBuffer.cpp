@@ -0,0 +1,137 @@
+#include "SampleBuffer.h"
+#include <cstring>
+
+namespace vibration {
+
+	SampleBuffer::SampleBuffer(SampleBufferPool& pool, size_t capacity)
+		: pool(pool), refs(0), data(capacity), count(0), channels(1), frames(0)
+	{
+	}
+
+	void SampleBuffer::AddRef()
+	{
+		refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void SampleBuffer::Release()
+	{
+		if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			pool.Recycle(this);
+	}
+
+	SampleBufferPool::SampleBufferPool()
+		: allocatedBytes(0)
+	{
+		for (uint32_t k = 0; k < EFFECT_POOL_SIZE; k++) {
+			current[k] = NULL;
+			currentHandles[k] = 0;
+		}
+	}
+
+	SampleBufferPool::~SampleBufferPool()
+	{
+	}
+
+	SampleBuffer* SampleBufferPool::Acquire(uint32_t dwHandle, const int32_t* samples, uint32_t count, uint32_t channels)
+	{
+		uint32_t slot = EffectHandleSlot(dwHandle);
+		if (channels == 0)
+			channels = 1;
+		if (count > MAX_SAMPLES)
+			count = MAX_SAMPLES;
+		count -= count % channels;
+
+		std::lock_guard<std::mutex> lock(mtxSync);
+
+		SampleBuffer* cur = current[slot];
+		if (cur != NULL && cur->count == count && cur->channels == channels
+			&& memcmp(cur->data.data(), samples, count * sizeof(int32_t)) == 0) {
+			cur->AddRef();
+			currentHandles[slot] = dwHandle;
+			return cur;
+		}
+
+		// Smallest free buffer that fits
+		size_t best = freeBuffers.size();
+		for (size_t k = 0; k < freeBuffers.size(); k++) {
+			size_t capacity = freeBuffers[k]->data.size();
+			if (capacity >= count && (best == freeBuffers.size() || capacity < freeBuffers[best]->data.size()))
+				best = k;
+		}
+
+		SampleBuffer* buffer;
+		if (best < freeBuffers.size()) {
+			buffer = freeBuffers[best];
+			freeBuffers[best] = freeBuffers.back();
+			freeBuffers.pop_back();
+		}
+		else {
+			size_t capacity = 64;
+			while (capacity < count)
+				capacity *= 2;
+
+			buffers.emplace_back(new SampleBuffer(*this, capacity));
+			buffer = buffers.back().get();
+			allocatedBytes += capacity * sizeof(int32_t);
+		}
+
+		memcpy(buffer->data.data(), samples, count * sizeof(int32_t));
+		buffer->count = count;
+		buffer->channels = channels;
+		buffer->frames = count / channels;
+
+		// Caller and slot references
+		buffer->refs.store(2, std::memory_order_relaxed);
+
+		current[slot] = buffer;
+		currentHandles[slot] = dwHandle;
+		if (cur != NULL)
+			ReleaseLocked(cur);
+
+		return buffer;
+	}
+
+	void SampleBufferPool::Forget(uint32_t dwHandle)
+	{
+		uint32_t slot = EffectHandleSlot(dwHandle);
+
+		std::lock_guard<std::mutex> lock(mtxSync);
+
+		if (current[slot] != NULL && currentHandles[slot] == dwHandle) {
+			ReleaseLocked(current[slot]);
+			current[slot] = NULL;
+		}
+	}
+
+	void SampleBufferPool::ForgetAll()
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+
+		for (uint32_t k = 0; k < EFFECT_POOL_SIZE; k++) {
+			if (current[k] != NULL) {
+				ReleaseLocked(current[k]);
+				current[k] = NULL;
+			}
+		}
+	}
+
+	size_t SampleBufferPool::GetAllocatedBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		return allocatedBytes;
+	}
+
+	void SampleBufferPool::Recycle(SampleBuffer* buffer)
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		freeBuffers.push_back(buffer);
+	}
+
+	// mtxSync must be held by the caller
+	void SampleBufferPool::ReleaseLocked(SampleBuffer* buffer)
+	{
+		if (buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			freeBuffers.push_back(buffer);
+	}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "EffectPool.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vibration {
+
+	class SampleBufferPool;
+
+	// Immutable copy of the samples of a custom force. One reference is held
+	// by each of the download command, the effect slot and the pool, so
+	// restarting or re-downloading an effect never copies them again.
+	class SampleBuffer
+	{
+	public:
+		const int32_t* GetSamples() const { return data.data(); }
+		uint32_t GetChannels() const { return channels; }
+
+		// Samples per channel
+		uint32_t GetFrames() const { return frames; }
+
+		void AddRef();
+		void Release();
+
+	private:
+		friend class SampleBufferPool;
+
+		SampleBuffer(SampleBufferPool& pool, size_t capacity);
+
+		SampleBufferPool& pool;
+		std::atomic<uint32_t> refs;
+		std::vector<int32_t> data;
+		uint32_t count;
+		uint32_t channels;
+		uint32_t frames;
+	};
+
+	// Sample buffers of the custom forces of one port. Released buffers are
+	// kept for reuse, so memory stays at the high-water mark of the effects
+	// downloaded at the same time.
+	class SampleBufferPool
+	{
+	public:
+		// Samples kept per effect, all channels included
+		static const uint32_t MAX_SAMPLES = 65536;
+
+		SampleBufferPool();
+		~SampleBufferPool();
+
+		// Buffer with a copy of the samples, holding one reference for the
+		// caller. The current buffer of the effect slot is shared instead
+		// when the samples did not change.
+		SampleBuffer* Acquire(uint32_t dwHandle, const int32_t* samples, uint32_t count, uint32_t channels);
+
+		// Drops the current buffer of a destroyed effect, unless the slot
+		// was reused by another handle since
+		void Forget(uint32_t dwHandle);
+		void ForgetAll();
+
+		size_t GetAllocatedBytes() const;
+
+	private:
+		friend class SampleBuffer;
+
+		void Recycle(SampleBuffer* buffer);
+		void ReleaseLocked(SampleBuffer* buffer);
+
+		mutable std::mutex mtxSync;
+		std::vector<std::unique_ptr<SampleBuffer>> buffers;
+		std::vector<SampleBuffer*> freeBuffers;
+		SampleBuffer* current[EFFECT_POOL_SIZE];
+		uint32_t currentHandles[EFFECT_POOL_SIZE];
+		size_t allocatedBytes;
+	};
+
+}
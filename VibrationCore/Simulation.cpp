@@ -0,0 +1,114 @@
+#include "Simulation.h"
+#include <cstring>
+
+namespace vibration {
+
+	void RecordingSink::SendReport(const uint8_t* buff, size_t buffsz)
+	{
+		SimReport report;
+		report.time = clock.Now();
+		memset(report.data, 0, sizeof(report.data));
+		memcpy(report.data, buff, buffsz < REPORT_SIZE ? buffsz : REPORT_SIZE);
+		reports.push_back(report);
+	}
+
+	Simulation::Simulation(uint64_t startTime)
+		: clock(startTime), passes(0)
+	{
+	}
+
+	VibrationPort& Simulation::AddPort(uint32_t dwPort)
+	{
+		std::unique_ptr<SimPort> sp(new SimPort());
+		sp->sink.reset(new RecordingSink(clock));
+		sp->port.reset(new VibrationPort(dwPort, clock, *sp->sink));
+		sp->hasDeadline = false;
+		sp->nextTime = 0;
+
+		ports.push_back(std::move(sp));
+		return *ports.back()->port;
+	}
+
+	VibrationPort& Simulation::AddPort(uint32_t dwPort, IReportSink& sink)
+	{
+		std::unique_ptr<SimPort> sp(new SimPort());
+		sp->port.reset(new VibrationPort(dwPort, clock, sink));
+		sp->hasDeadline = false;
+		sp->nextTime = 0;
+
+		ports.push_back(std::move(sp));
+		return *ports.back()->port;
+	}
+
+	void Simulation::RemovePort(VibrationPort& port)
+	{
+		for (auto it = ports.begin(); it != ports.end(); ++it) {
+			if ((*it)->port.get() == &port) {
+				port.Shutdown();
+				ports.erase(it);
+				return;
+			}
+		}
+	}
+
+	void Simulation::ClearReports()
+	{
+		for (auto& sp : ports) {
+			if (sp->sink != NULL)
+				sp->sink->Clear();
+		}
+	}
+
+	void Simulation::Sync()
+	{
+		for (auto& sp : ports)
+			Service(*sp);
+	}
+
+	void Simulation::Sync(VibrationPort& port)
+	{
+		SimPort* sp = Find(port);
+		if (sp != NULL)
+			Service(*sp);
+	}
+
+	void Simulation::AdvanceTo(uint64_t time)
+	{
+		while (true) {
+			SimPort* next = NULL;
+			for (auto& sp : ports) {
+				if (sp->hasDeadline && TimeReached(time, sp->nextTime)
+					&& (next == NULL || TimeDiff(sp->nextTime, next->nextTime) < 0))
+					next = sp.get();
+			}
+			if (next == NULL)
+				break;
+
+			// A deadline already passed is serviced late, as on a busy
+			// output thread
+			if (TimeDiff(next->nextTime, clock.Now()) > 0)
+				clock.Set(next->nextTime);
+			Service(*next);
+		}
+
+		if (TimeDiff(time, clock.Now()) > 0)
+			clock.Set(time);
+	}
+
+	Simulation::SimPort* Simulation::Find(VibrationPort& port)
+	{
+		for (auto& sp : ports) {
+			if (sp->port.get() == &port)
+				return sp.get();
+		}
+
+		return NULL;
+	}
+
+	void Simulation::Service(SimPort& sp)
+	{
+		sp.hasDeadline = sp.port->Service(sp.nextTime);
+		passes++;
+	}
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "Clock.h"
+#include "Report.h"
+#include "VibrationPort.h"
+#include <memory>
+#include <vector>
+
+namespace vibration {
+
+	// Clock set by the code driving it
+	class VirtualClock : public IClock
+	{
+	public:
+		VirtualClock(uint64_t time = 0) : time(time) {}
+		uint64_t Now() override { return time; }
+		void Set(uint64_t time) { this->time = time; }
+		void Advance(uint64_t micros) { time += micros; }
+
+	private:
+		uint64_t time;
+	};
+
+	// Report received by a RecordingSink and the clock time it was sent at
+	struct SimReport {
+		uint64_t time;
+		uint8_t data[REPORT_SIZE];
+
+		uint8_t GetForceX() const { return data[4]; }
+		uint8_t GetForceY() const { return data[3]; }
+	};
+
+	// Fake HID device keeping every report
+	class RecordingSink : public IReportSink
+	{
+	public:
+		RecordingSink(IClock& clock) : clock(clock) {}
+
+		void SendReport(const uint8_t* buff, size_t buffsz) override;
+
+		const std::vector<SimReport>& GetReports() const { return reports; }
+		void Clear() { reports.clear(); }
+
+	private:
+		IClock& clock;
+		std::vector<SimReport> reports;
+	};
+
+	// Runs ports on a virtual clock from a single thread, serviced the way
+	// the OutputScheduler does: once after the calls made to them (Sync)
+	// and at each start/stop time a mixing pass asks for. The same calls at
+	// the same times give the same reports on every run, and hours of
+	// effects play in milliseconds.
+	class Simulation
+	{
+	public:
+		Simulation(uint64_t startTime = 0);
+
+		// Port with index dwPort on the adapter, recording to its own sink
+		VibrationPort& AddPort(uint32_t dwPort);
+
+		// Port sending to the given sink, which must outlive it. It has no
+		// reports here.
+		VibrationPort& AddPort(uint32_t dwPort, IReportSink& sink);
+
+		// Shuts the port down, its stop report going out at the current time
+		void RemovePort(VibrationPort& port);
+
+		size_t GetPortCount() const { return ports.size(); }
+		VibrationPort& GetPort(size_t index) { return *ports[index]->port; }
+		const std::vector<SimReport>& GetReports(size_t index) const { return ports[index]->sink->GetReports(); }
+		void ClearReports();
+
+		// Mixing pass of every port at the current time, applying the calls
+		// posted since the last one
+		void Sync();
+		void Sync(VibrationPort& port);
+
+		// Services the ports at their start/stop times up to time, in time
+		// order, then leaves the clock at time
+		void AdvanceTo(uint64_t time);
+		void Advance(uint64_t micros) { AdvanceTo(clock.Now() + micros); }
+
+		uint64_t Now() { return clock.Now(); }
+		IClock& GetClock() { return clock; }
+
+		// Mixing passes run so far
+		uint64_t GetPassCount() const { return passes; }
+
+	private:
+		// The port is released before its sink, if it has one
+		struct SimPort {
+			std::unique_ptr<RecordingSink> sink;
+			std::unique_ptr<VibrationPort> port;
+			bool hasDeadline;
+			uint64_t nextTime;
+		};
+
+		SimPort* Find(VibrationPort& port);
+		void Service(SimPort& sp);
+
+		VirtualClock clock;
+		std::vector<std::unique_ptr<SimPort>> ports;
+		uint64_t passes;
+	};
+
+}
@@ -0,0 +1,72 @@
+#include "Telemetry.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace vibration {
+
+	static uint32_t HighBit(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanReverse(&idx, value);
+		return idx;
+#else
+		return 31 - __builtin_clz(value);
+#endif
+	}
+
+	LatencyHistogram::LatencyHistogram()
+	{
+		for (uint32_t k = 0; k < HISTOGRAM_BUCKETS; k++)
+			counts[k].store(0, std::memory_order_relaxed);
+	}
+
+	uint32_t LatencyHistogram::BucketOf(uint64_t micros)
+	{
+		uint32_t value = micros > UINT32_MAX ? UINT32_MAX : (uint32_t)micros;
+		if (value < HISTOGRAM_SUB_BUCKETS)
+			return value;
+
+		// Top bits below the leading one select the sub-bucket
+		uint32_t exponent = HighBit(value) - HISTOGRAM_SUB_BITS;
+		uint32_t sub = (value >> exponent) & (HISTOGRAM_SUB_BUCKETS - 1);
+		return HISTOGRAM_SUB_BUCKETS + exponent * HISTOGRAM_SUB_BUCKETS + sub;
+	}
+
+	uint64_t LatencyHistogram::BucketLow(uint32_t bucket)
+	{
+		if (bucket < HISTOGRAM_SUB_BUCKETS)
+			return bucket;
+
+		uint32_t exponent = (bucket - HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_SUB_BUCKETS;
+		uint32_t sub = (bucket - HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_SUB_BUCKETS;
+		return (uint64_t)(HISTOGRAM_SUB_BUCKETS + sub) << exponent;
+	}
+
+	void LatencyHistogram::CopyTo(uint64_t* out) const
+	{
+		for (uint32_t k = 0; k < HISTOGRAM_BUCKETS; k++)
+			out[k] = counts[k].load(std::memory_order_relaxed);
+	}
+
+	uint64_t LatencyHistogram::Percentile(const uint64_t* counts, double fraction)
+	{
+		uint64_t total = 0;
+		for (uint32_t k = 0; k < HISTOGRAM_BUCKETS; k++)
+			total += counts[k];
+		if (total == 0)
+			return 0;
+
+		uint64_t rank = (uint64_t)(fraction * total);
+		uint64_t seen = 0;
+		for (uint32_t k = 0; k < HISTOGRAM_BUCKETS; k++) {
+			seen += counts[k];
+			if (seen > rank)
+				return k + 1 < HISTOGRAM_BUCKETS ? BucketLow(k + 1) - 1 : BucketLow(k);
+		}
+
+		return BucketLow(HISTOGRAM_BUCKETS - 1);
+	}
+
+}
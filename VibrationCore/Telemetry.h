@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace vibration {
+
+	// Latency histogram buckets: one per microsecond below 16 us, then 16
+	// per power of two up to 2^32 us, so each bucket is within 6.25% of the
+	// values it holds.
+	const uint32_t HISTOGRAM_SUB_BITS = 4;
+	const uint32_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+	const uint32_t HISTOGRAM_BUCKETS = HISTOGRAM_SUB_BUCKETS + (32 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_BUCKETS;
+
+	// Adds to a counter that only one thread writes at a time. Plain
+	// relaxed load and store, no locked instruction on the hot path.
+	inline void CounterAdd(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+		counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	// Log-linear histogram of durations in microseconds. Recorded by one
+	// thread at a time, read from any thread.
+	class LatencyHistogram
+	{
+	public:
+		LatencyHistogram();
+
+		void Record(uint64_t micros) {
+			CounterAdd(counts[BucketOf(micros)]);
+		}
+
+		void CopyTo(uint64_t* out) const;
+
+		static uint32_t BucketOf(uint64_t micros);
+
+		// Smallest value counted in the bucket
+		static uint64_t BucketLow(uint32_t bucket);
+
+		// Value below which the given fraction of the counts fall, as the
+		// upper bound of its bucket
+		static uint64_t Percentile(const uint64_t* counts, double fraction);
+
+	private:
+		std::atomic<uint64_t> counts[HISTOGRAM_BUCKETS];
+	};
+
+	// Escape command of the driver returning the PortTelemetry of the port
+	// (IDirectInputEffectDriver::Escape, DIEFFESCAPE::dwCommand). The output
+	// buffer must hold sizeof(PortTelemetry) bytes; cbOutBuffer receives the
+	// size written. Counters and histograms accumulate from the attach of
+	// the device.
+	const uint32_t ESCAPE_GET_TELEMETRY = 0x56425401;
+
+	const uint32_t TELEMETRY_VERSION = 1;
+
+	struct PortTelemetry {
+		// sizeof(PortTelemetry) and TELEMETRY_VERSION
+		uint32_t dwSize;
+		uint32_t dwVersion;
+
+		// Mixing passes and their outcome: report sent, same forces as the
+		// device already has, or held back by the report rate limit. Sent
+		// includes the stop report of the device detach.
+		uint64_t mixPasses;
+		uint64_t reportsSent;
+		uint64_t reportsDeduplicated;
+		uint64_t reportsDeferred;
+
+		// Force changes merged by the report rate limit
+		uint64_t reportsMerged;
+
+		// Effect commands applied, effects replaced because the pool was full
+		uint64_t commandsApplied;
+		uint64_t effectsEvicted;
+
+		// Output stage
+		uint64_t writesStarted;
+		uint64_t writesFailed;
+		uint64_t reportsCoalesced;
+
+		// Latency histograms, microseconds (see LatencyHistogram::BucketLow):
+		// effect call to the mixing pass that applies it, mixing pass to the
+		// start of the write of its report, and write start to completion
+		uint64_t callToMix[HISTOGRAM_BUCKETS];
+		uint64_t mixToWrite[HISTOGRAM_BUCKETS];
+		uint64_t writeDuration[HISTOGRAM_BUCKETS];
+	};
+
+}
@@ -0,0 +1,610 @@
+#include "VibrationPort.h"
+#include "Report.h"
+#include "OutputScheduler.h"
+
+namespace vibration {
+
+	VibrationPort::VibrationPort(uint32_t dwID, IClock& clock, IReportSink& sink)
+		: dwID(dwID), clock(clock), sink(sink),
+		publishedState(0), publishedForceX(0), publishedForceY(0),
+		lastForceX(0), lastForceY(0), actuatorsOn(true),
+		hasDeferred(false), deferredForceX(0), deferredForceY(0),
+		deviceGain(10000), tableGain(10000), mixMode(MIX_MAX),
+		maxReportRate(0), reportBurst(1), limiterRate(0), limiterBurst(1),
+		reportsSent(0), reportsDeduplicated(0), reportsDeferred(0), reportsMerged(0),
+		commandsApplied(0), effectsEvicted(0),
+		scheduler(NULL), wakePending(false), nextReady(NULL),
+		slot(0), removing(false)
+	{
+		BuildGainTable(tableGain);
+		PublishSnapshot();
+	}
+
+	VibrationPort::~VibrationPort()
+	{
+	}
+
+	void VibrationPort::BuildGainTable(uint32_t dwGain)
+	{
+		uint32_t gainQ16 = GainToQ16(dwGain);
+		for (uint32_t k = 0; k < 256; k++)
+			gainTable[k] = ScaleForce((uint8_t)k, gainQ16);
+
+		tableGain = dwGain;
+	}
+
+	bool VibrationPort::PostCommand(const EffectCommand& cmd)
+	{
+		if (!commands.TryPush(cmd))
+			return false;
+
+		Wake();
+		return true;
+	}
+
+	void VibrationPort::Wake()
+	{
+		// Queued once until the scheduler services the port
+		if (scheduler != NULL && !wakePending.exchange(true))
+			scheduler->PushReady(*this);
+	}
+
+	void VibrationPort::Tick()
+	{
+		uint64_t nextTime;
+		Service(nextTime);
+	}
+
+	bool VibrationPort::Service(uint64_t& nextTime)
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+		return MixAndSend(nextTime);
+	}
+
+	void VibrationPort::Shutdown()
+	{
+		std::lock_guard<std::mutex> lock(mtxSync);
+
+		EffectCommand cmd;
+		while (commands.TryPop(cmd))
+			DiscardCommand(cmd);
+
+		effects.Clear();
+		hasDeferred = false;
+		Send(0, 0);
+		PublishSnapshot();
+	}
+
+	void VibrationPort::SetMaxReportRate(uint32_t reportsPerSecond, uint32_t burst)
+	{
+		reportBurst = burst;
+		maxReportRate = reportsPerSecond;
+
+		// Applied by the next mixing pass
+		Wake();
+	}
+
+	void VibrationPort::SetGain(uint32_t dwGain)
+	{
+		deviceGain = dwGain > 10000 ? 10000 : dwGain;
+
+		// Applied by the next mixing pass
+		Wake();
+	}
+
+	void VibrationPort::SetMixMode(uint8_t mode)
+	{
+		mixMode = mode < MIX_MODE_COUNT ? mode : (uint8_t)MIX_MAX;
+
+		// Applied by the next mixing pass
+		Wake();
+	}
+
+	bool VibrationPort::GetEffectStatus(uint32_t dwHandle, bool& playing) const
+	{
+		return snapshot.GetEffectStatus(dwHandle, playing);
+	}
+
+	PortState VibrationPort::GetState() const
+	{
+		return snapshot.GetState();
+	}
+
+	// mtxSync must be held by the caller
+	void VibrationPort::PublishSnapshot()
+	{
+		uint32_t downloaded = effects.GetDownloadedCount();
+
+		uint32_t state = STATE_POWER_ON | STATE_SAFETY_SWITCH_ON | STATE_USER_FF_SWITCH_ON;
+		state |= actuatorsOn ? STATE_ACTUATORS_ON : STATE_ACTUATORS_OFF;
+		if (downloaded == 0)
+			state |= STATE_EMPTY;
+		if (effects.IsPaused())
+			state |= STATE_PAUSED;
+		else if (effects.GetActiveCount() == 0)
+			state |= STATE_STOPPED;
+
+		if (effects.GetDirtyCount() == 0 && state == publishedState
+			&& lastForceX == publishedForceX && lastForceY == publishedForceY)
+			return;
+
+		snapshot.BeginUpdate();
+
+		for (uint32_t i = 0; i < effects.GetDirtyCount(); i++) {
+			uint32_t slot = effects.GetDirtySlot(i);
+			const VibrationEff& eff = effects.GetSlot(slot);
+			snapshot.SetEffect(slot, eff.dwHandle, eff.isActive);
+		}
+
+		PortState portState;
+		portState.dwState = state;
+		portState.dwLoad = (downloaded * 100 + EFFECT_POOL_SIZE - 1) / EFFECT_POOL_SIZE;
+		portState.forceX = lastForceX;
+		portState.forceY = lastForceY;
+		snapshot.SetState(portState);
+
+		snapshot.EndUpdate();
+
+		effects.ClearDirty();
+		publishedState = state;
+		publishedForceX = lastForceX;
+		publishedForceY = lastForceY;
+	}
+
+	PortStats VibrationPort::GetStats() const
+	{
+		PortStats stats;
+		stats.reportsSent = reportsSent;
+		stats.reportsMerged = reportsMerged;
+		stats.effectsEvicted = effectsEvicted;
+		stats.sampleBytes = samples.GetAllocatedBytes();
+		return stats;
+	}
+
+	void VibrationPort::GetTelemetry(PortTelemetry& telemetry) const
+	{
+		// Every pass ends in exactly one of the three outcomes, so the pass
+		// count needs no counter of its own
+		telemetry.reportsSent = reportsSent;
+		telemetry.reportsDeduplicated = reportsDeduplicated;
+		telemetry.reportsDeferred = reportsDeferred;
+		telemetry.mixPasses = telemetry.reportsSent + telemetry.reportsDeduplicated + telemetry.reportsDeferred;
+		telemetry.reportsMerged = reportsMerged;
+		telemetry.commandsApplied = commandsApplied;
+		telemetry.effectsEvicted = effectsEvicted;
+		callToMix.CopyTo(telemetry.callToMix);
+	}
+
+	// mtxSync must be held by the caller
+	void VibrationPort::ApplyCommands()
+	{
+		EffectCommand cmd;
+		uint64_t applyTime = 0;
+		uint64_t applied = 0;
+
+		while (commands.TryPop(cmd)) {
+			// The clock is only read on passes that have commands
+			if (applied++ == 0)
+				applyTime = clock.Now();
+			int64_t latency = TimeDiff(applyTime, cmd.time);
+			callToMix.Record(latency > 0 ? (uint64_t)latency : 0);
+
+			switch (cmd.type) {
+			case CMD_DOWNLOAD_EFFECT: {
+				// Evicted again before the output thread saw it
+				if (!handles.IsCurrent(cmd.dwHandle)) {
+					DiscardCommand(cmd);
+					break;
+				}
+
+				// A restart keeps the plays left, DOWNLOAD_START plays once
+				VibrationEff& eff = effects.Download(cmd.dwHandle, cmd.params);
+				if (cmd.dwFlags & DOWNLOAD_START)
+					effects.Start(cmd.dwHandle, cmd.time);
+				else if (eff.isActive && !(cmd.dwFlags & DOWNLOAD_NORESTART))
+					effects.Start(cmd.dwHandle, cmd.time, eff.iterations);
+				break;
+			}
+
+			case CMD_START_EFFECT:
+				if (effects.Lookup(cmd.dwHandle) == NULL)
+					break;
+
+				if (cmd.dwFlags & START_SOLO)
+					effects.StopAll();
+				effects.Start(cmd.dwHandle, cmd.time, cmd.dwIterations);
+				break;
+
+			case CMD_STOP_EFFECT:
+				effects.Stop(cmd.dwHandle);
+				break;
+
+			case CMD_DESTROY_EFFECT:
+				if (effects.Destroy(cmd.dwHandle))
+					samples.Forget(cmd.dwHandle);
+				handles.Release(cmd.dwHandle);
+				break;
+
+			case CMD_STOP_ALL:
+				effects.StopAll();
+				break;
+
+			case CMD_RESET:
+				// The handles were released by Reset
+				effects.Clear();
+				samples.ForgetAll();
+				actuatorsOn = true;
+				break;
+
+			case CMD_PAUSE:
+				effects.Pause(cmd.time);
+				break;
+
+			case CMD_CONTINUE:
+				effects.Resume(cmd.time);
+				break;
+
+			case CMD_SET_ACTUATORS:
+				actuatorsOn = cmd.dwFlags != 0;
+				break;
+			}
+		}
+
+		if (applied != 0)
+			CounterAdd(commandsApplied, applied);
+	}
+
+	void VibrationPort::DiscardCommand(EffectCommand& cmd)
+	{
+		if (cmd.type == CMD_DOWNLOAD_EFFECT && cmd.params.samples != NULL) {
+			cmd.params.samples->Release();
+			cmd.params.samples = NULL;
+		}
+	}
+
+	// mtxSync must be held by the caller
+	bool VibrationPort::MixAndSend(uint64_t& nextTime)
+	{
+		ApplyCommands();
+
+		if (maxReportRate != limiterRate || reportBurst != limiterBurst) {
+			limiterRate = maxReportRate;
+			limiterBurst = reportBurst;
+			limiter.Configure(limiterRate, limiterBurst);
+		}
+
+		if (deviceGain != tableGain)
+			BuildGainTable(deviceGain);
+
+		if (mixMode != effects.GetMixMode())
+			effects.SetMixMode(mixMode);
+
+		uint64_t now = clock.Now();
+		uint8_t forceX;
+		uint8_t forceY;
+		bool hasDeadline = effects.Mix(now, forceX, forceY, nextTime);
+
+		forceX = gainTable[forceX];
+		forceY = gainTable[forceY];
+
+		// Effects still advance, nothing reaches the motors
+		if (!actuatorsOn) {
+			forceX = 0;
+			forceY = 0;
+		}
+
+		if (forceX == lastForceX && forceY == lastForceY) {
+			// Back to what the device already has
+			if (hasDeferred)
+				CounterAdd(reportsMerged);
+			hasDeferred = false;
+			CounterAdd(reportsDeduplicated);
+		}
+		else if (forceX == 0 && forceY == 0) {
+			// Stop edges always go out
+			limiter.Acquire(now);
+			hasDeferred = false;
+			Send(0, 0);
+		}
+		else if (limiter.TryAcquire(now)) {
+			hasDeferred = false;
+			Send(forceX, forceY);
+		}
+		else {
+			if (hasDeferred && (forceX != deferredForceX || forceY != deferredForceY))
+				CounterAdd(reportsMerged);
+
+			hasDeferred = true;
+			CounterAdd(reportsDeferred);
+			deferredForceX = forceX;
+			deferredForceY = forceY;
+
+			uint64_t tokenTime = limiter.NextTime(now);
+			if (!hasDeadline || TimeDiff(tokenTime, nextTime) < 0)
+				nextTime = tokenTime;
+			hasDeadline = true;
+		}
+
+		PublishSnapshot();
+		return hasDeadline;
+	}
+
+	// mtxSync must be held by the caller
+	void VibrationPort::Send(uint8_t forceX, uint8_t forceY)
+	{
+		// Send the command
+		if (forceX == 0 && forceY == 0)
+			SendVibrationStop(sink, dwID);
+		else
+			SendVibrationForce(sink, forceX, forceY, dwID);
+
+		lastForceX = forceX;
+		lastForceY = forceY;
+		CounterAdd(reportsSent);
+	}
+
+	bool VibrationPort::DecodeEffect(uint32_t dwEffectType, const EffectDesc& eff, EffectParams& params)
+	{
+		if ((eff.cbTypeSpecificParams != 0 && eff.lpvTypeSpecificParams == NULL)
+			|| (eff.cAxes != 0 && eff.rglDirection == NULL))
+			return false;
+
+		// Unknown parameters play at full strength
+		params.kind = KIND_CONSTANT;
+		params.waveform = WAVE_SINE;
+		params.lMagnitude = 10000;
+		params.lOffset = 0;
+		params.lRampStart = 0;
+		params.lRampEnd = 0;
+		params.dwPhase = 0;
+		params.dwPeriod = 0;
+		params.samples = NULL;
+		params.dwSamplePeriod = 0;
+
+		if (dwEffectType == EFFECT_CONSTANT && eff.cbTypeSpecificParams == sizeof(ConstantForce)) {
+			const ConstantForce* effParams = (const ConstantForce*)eff.lpvTypeSpecificParams;
+			params.lMagnitude = effParams->lMagnitude;
+		}
+		else if (dwEffectType == EFFECT_RAMP && eff.cbTypeSpecificParams == sizeof(RampForce)) {
+			const RampForce* effParams = (const RampForce*)eff.lpvTypeSpecificParams;
+
+			params.kind = KIND_RAMP;
+			params.lRampStart = ClampLevel(effParams->lStart);
+			params.lRampEnd = ClampLevel(effParams->lEnd);
+
+			int32_t absStart = params.lRampStart < 0 ? -params.lRampStart : params.lRampStart;
+			int32_t absEnd = params.lRampEnd < 0 ? -params.lRampEnd : params.lRampEnd;
+			params.lMagnitude = absStart > absEnd ? absStart : absEnd;
+		}
+		else if (dwEffectType == EFFECT_CUSTOM && eff.cbTypeSpecificParams == sizeof(CustomForce)) {
+			const CustomForce* effParams = (const CustomForce*)eff.lpvTypeSpecificParams;
+
+			// The samples are copied by DownloadEffect once it has a handle
+			uint32_t channels = effParams->cChannels > 0 ? effParams->cChannels : 1;
+			if (effParams->rglForceData != NULL && effParams->cSamples >= channels) {
+				params.kind = KIND_CUSTOM;
+				params.dwSamplePeriod = effParams->dwSamplePeriod != 0 ? effParams->dwSamplePeriod : eff.dwSamplePeriod;
+				if (params.dwSamplePeriod == 0)
+					params.dwSamplePeriod = EFFECT_TICK_US;
+			}
+		}
+		else if (dwEffectType >= EFFECT_SQUARE && dwEffectType <= EFFECT_SAWTOOTH_DOWN
+			&& eff.cbTypeSpecificParams == sizeof(PeriodicForce)) {
+			const PeriodicForce* effParams = (const PeriodicForce*)eff.lpvTypeSpecificParams;
+
+			params.kind = KIND_PERIODIC;
+			params.waveform = (uint8_t)(WAVE_SQUARE + (dwEffectType - EFFECT_SQUARE));
+			params.lMagnitude = effParams->dwMagnitude > 10000 ? 10000 : (int32_t)effParams->dwMagnitude;
+			params.lOffset = effParams->lOffset;
+			params.dwPhase = effParams->dwPhase;
+			params.dwPeriod = effParams->dwPeriod;
+		}
+
+		// Motors driven by the effect
+		params.motors = MOTOR_X | MOTOR_Y;
+
+		if (eff.cAxes == 1) {
+			// If direction is negative, then it is a forceX
+			// Otherwise it is a forceY
+			int32_t direction = eff.rglDirection[0];
+
+			params.motors = 0;
+			if (direction == -1)
+				params.motors = MOTOR_X;
+			else if (direction == 1)
+				params.motors = MOTOR_Y;
+		}
+		else {
+			if (eff.cAxes >= 1) {
+				int32_t fx = eff.rglDirection[0];
+
+				if (fx <= 0)
+					params.motors = 0;
+			}
+
+			if (eff.cAxes >= 2) {
+				int32_t fy = eff.rglDirection[1];
+
+				if (fy > 0)
+					params.motors |= MOTOR_Y;
+				else
+					params.motors &= ~MOTOR_Y;
+			}
+		}
+
+		params.dwGain = eff.dwGain > 10000 ? 10000 : eff.dwGain;
+		if (eff.dwPriority != 0)
+			params.priority = (uint8_t)(eff.dwPriority > 255 ? 255 : eff.dwPriority);
+		else
+			params.priority = eff.dwDuration != EFFECT_INFINITE ? 1 : 0;
+		params.dwStartDelay = eff.dwStartDelay;
+		params.dwDuration = eff.dwDuration;
+
+		params.hasEnvelope = false;
+		params.dwAttackLevel = 0;
+		params.dwAttackTime = 0;
+		params.dwFadeLevel = 0;
+		params.dwFadeTime = 0;
+
+		if (eff.lpEnvelope != NULL) {
+			const Envelope* env = eff.lpEnvelope;
+
+			params.dwAttackLevel = env->dwAttackLevel > 10000 ? 10000 : env->dwAttackLevel;
+			params.dwAttackTime = env->dwAttackTime;
+			params.dwFadeLevel = env->dwFadeLevel > 10000 ? 10000 : env->dwFadeLevel;
+			params.dwFadeTime = env->dwFadeTime;
+			params.hasEnvelope = params.dwAttackTime != 0 || params.dwFadeTime != 0;
+		}
+
+		return true;
+	}
+
+	bool VibrationPort::DownloadEffect(uint32_t dwEffectType, const EffectDesc& eff, uint32_t& dwHandle, uint32_t dwFlags)
+	{
+		EffectCommand cmd;
+		cmd.type = CMD_DOWNLOAD_EFFECT;
+		cmd.dwFlags = dwFlags;
+		cmd.time = clock.Now();
+		if (!DecodeEffect(dwEffectType, eff, cmd.params))
+			return false;
+
+		bool isNew = dwHandle == 0;
+		if (!isNew && !handles.IsCurrent(dwHandle))
+			return false;
+
+		uint8_t magnitude = EffectPool::PeakForce(cmd.params);
+		if (isNew) {
+			uint32_t dwEvicted;
+			dwHandle = handles.Allocate(magnitude, dwEvicted);
+			if (dwEvicted != 0)
+				effectsEvicted++;
+		}
+		else {
+			handles.Touch(dwHandle, magnitude);
+		}
+
+		if (cmd.params.kind == KIND_CUSTOM) {
+			const CustomForce* custom = (const CustomForce*)eff.lpvTypeSpecificParams;
+			cmd.params.samples = samples.Acquire(dwHandle, custom->rglForceData, custom->cSamples, custom->cChannels);
+		}
+
+		cmd.dwHandle = dwHandle;
+		if (!PostCommand(cmd)) {
+			DiscardCommand(cmd);
+			if (isNew) {
+				handles.Release(dwHandle);
+				dwHandle = 0;
+			}
+			return false;
+		}
+
+		return true;
+	}
+
+	bool VibrationPort::PostHandleCommand(uint8_t type, uint32_t dwHandle, uint32_t dwFlags)
+	{
+		EffectCommand cmd = {};
+		cmd.type = type;
+		cmd.dwFlags = dwFlags;
+		cmd.dwHandle = dwHandle;
+		cmd.time = clock.Now();
+
+		return PostCommand(cmd);
+	}
+
+	bool VibrationPort::StartEffect(uint32_t dwHandle, uint32_t dwFlags, uint32_t dwIterations)
+	{
+		if (!handles.IsCurrent(dwHandle))
+			return false;
+
+		handles.Touch(dwHandle);
+
+		EffectCommand cmd = {};
+		cmd.type = CMD_START_EFFECT;
+		cmd.dwFlags = dwFlags;
+		cmd.dwHandle = dwHandle;
+		cmd.dwIterations = dwIterations;
+		cmd.time = clock.Now();
+
+		return PostCommand(cmd);
+	}
+
+	bool VibrationPort::StopEffect(uint32_t dwHandle)
+	{
+		if (!handles.IsCurrent(dwHandle))
+			return false;
+
+		return PostHandleCommand(CMD_STOP_EFFECT, dwHandle, 0);
+	}
+
+	bool VibrationPort::DestroyEffect(uint32_t dwHandle)
+	{
+		if (!handles.IsCurrent(dwHandle))
+			return false;
+
+		return PostHandleCommand(CMD_DESTROY_EFFECT, dwHandle, 0);
+	}
+
+	bool VibrationPort::StopAllEffects()
+	{
+		EffectCommand cmd = {};
+		cmd.type = CMD_STOP_ALL;
+		cmd.time = clock.Now();
+
+		return PostCommand(cmd);
+	}
+
+	bool VibrationPort::Reset()
+	{
+		EffectCommand cmd = {};
+		cmd.type = CMD_RESET;
+		cmd.time = clock.Now();
+
+		if (!PostCommand(cmd))
+			return false;
+
+		// Downloads posted from here on come after the reset, so their
+		// handles stay valid
+		handles.ReleaseAll();
+		return true;
+	}
+
+	bool VibrationPort::Pause()
+	{
+		EffectCommand cmd = {};
+		cmd.type = CMD_PAUSE;
+		cmd.time = clock.Now();
+
+		return PostCommand(cmd);
+	}
+
+	bool VibrationPort::Continue()
+	{
+		EffectCommand cmd = {};
+		cmd.type = CMD_CONTINUE;
+		cmd.time = clock.Now();
+
+		return PostCommand(cmd);
+	}
+
+	bool VibrationPort::SetActuators(bool on)
+	{
+		EffectCommand cmd = {};
+		cmd.type = CMD_SET_ACTUATORS;
+		cmd.dwFlags = on ? 1 : 0;
+		cmd.time = clock.Now();
+
+		return PostCommand(cmd);
+	}
+
+	bool VibrationPort::IsEffectHandle(uint32_t dwHandle) const
+	{
+		return handles.IsCurrent(dwHandle);
+	}
+
+	void VibrationPort::SetEvictionPolicy(EvictionPolicy policy)
+	{
+		handles.SetEvictionPolicy(policy);
+	}
+
+}
@@ -0,0 +1,194 @@
+#pragma once
+#include "Clock.h"
+#include "ReportSink.h"
+#include "EffectDesc.h"
+#include "EffectPool.h"
+#include "EffectHandles.h"
+#include "SampleBuffer.h"
+#include "PortSnapshot.h"
+#include "Telemetry.h"
+#include "EffectCommand.h"
+#include "MpscRing.h"
+#include "RateLimiter.h"
+#include <atomic>
+#include <mutex>
+
+namespace vibration {
+
+	class OutputScheduler;
+
+	struct PortStats {
+		uint64_t reportsSent;
+
+		// Force changes superseded by a newer value before they could be
+		// sent because of the report rate limit
+		uint64_t reportsMerged;
+
+		// Effects replaced because the pool was full
+		uint64_t effectsEvicted;
+
+		// Memory held for custom force samples
+		uint64_t sampleBytes;
+	};
+
+	// Effect engine of one adapter port. Time and output only go through
+	// the injected clock and sink, so it runs the same on any platform.
+	//
+	// Effects are downloaded into a pool of EFFECT_POOL_SIZE slots and
+	// addressed by the handle DownloadEffect returns. None of the effect
+	// calls wait for the output thread: they post a command into a lock-free
+	// ring that is drained before each mixing pass. They return false if the
+	// ring is full or the handle is not current.
+	//
+	// The port has no thread of its own. It is either registered with an
+	// OutputScheduler or driven by calling Tick.
+	class VibrationPort
+	{
+	public:
+		static const size_t COMMAND_QUEUE_SIZE = 256;
+
+		VibrationPort(uint32_t dwID, IClock& clock, IReportSink& sink);
+		~VibrationPort();
+
+		// dwHandle 0 downloads a new effect and receives its handle, which
+		// may evict another effect when the pool is full. Otherwise the
+		// parameters of that effect are updated; a playing effect restarts
+		// unless DOWNLOAD_NORESTART is set. DOWNLOAD_START starts it.
+		// Parameters or directions given by size or count with a NULL
+		// pointer are refused.
+		bool DownloadEffect(uint32_t dwEffectType, const EffectDesc& eff, uint32_t& dwHandle, uint32_t dwFlags);
+
+		// Plays the effect dwIterations times, EFFECT_INFINITE repeating it
+		// until stopped; each play waits for the start delay again
+		bool StartEffect(uint32_t dwHandle, uint32_t dwFlags = 0, uint32_t dwIterations = 1);
+		bool StopEffect(uint32_t dwHandle);
+		bool DestroyEffect(uint32_t dwHandle);
+		bool StopAllEffects();
+
+		// Stops and destroys every effect (DISFFC_RESET). The handles are
+		// invalid once it returns; effects downloaded afterwards are kept.
+		bool Reset();
+
+		// DISFFC_PAUSE / DISFFC_CONTINUE: the effects keep their remaining
+		// time while paused and carry on where they were
+		bool Pause();
+		bool Continue();
+
+		// DISFFC_SETACTUATORSON / OFF: the effects keep playing, only the
+		// output is muted
+		bool SetActuators(bool on);
+
+		// False for handles that were destroyed or evicted
+		bool IsEffectHandle(uint32_t dwHandle) const;
+
+		void SetEvictionPolicy(EvictionPolicy policy);
+
+		// One mixing pass; sends a report when the mixed forces changed
+		void Tick();
+
+		// Tick that also returns the next start/stop time, if any
+		bool Service(uint64_t& nextTime);
+
+		// Clears the effects and sends the stop report
+		void Shutdown();
+
+		// Caps the reports sent to the device. Force changes within the
+		// same window are merged into the latest value; stop reports are
+		// never held back. 0 disables the limit.
+		void SetMaxReportRate(uint32_t reportsPerSecond, uint32_t burst = 1);
+
+		// Device gain (0..10000) applied to the mixed forces from the next
+		// mixing pass
+		void SetGain(uint32_t dwGain);
+
+		// How overlapping effects combine (MixMode), from the next mixing
+		// pass
+		void SetMixMode(uint8_t mode);
+
+		PortStats GetStats() const;
+
+		// Fills the counters and the call to mix histogram of the port; the
+		// output stage fills the rest
+		void GetTelemetry(PortTelemetry& telemetry) const;
+
+		// Status as of the last mixing pass; never waits for the output
+		// thread. GetEffectStatus returns false for an unknown handle.
+		bool GetEffectStatus(uint32_t dwHandle, bool& playing) const;
+		PortState GetState() const;
+
+	private:
+		friend class OutputScheduler;
+
+		bool PostCommand(const EffectCommand& cmd);
+		void Wake();
+		void ApplyCommands();
+		bool MixAndSend(uint64_t& nextTime);
+		void Send(uint8_t forceX, uint8_t forceY);
+		void BuildGainTable(uint32_t dwGain);
+		void PublishSnapshot();
+		void DiscardCommand(EffectCommand& cmd);
+		bool PostHandleCommand(uint8_t type, uint32_t dwHandle, uint32_t dwFlags);
+		static bool DecodeEffect(uint32_t dwEffectType, const EffectDesc& eff, EffectParams& params);
+
+		uint32_t dwID;
+		IClock& clock;
+		IReportSink& sink;
+
+		MpscRing<EffectCommand, COMMAND_QUEUE_SIZE> commands;
+
+		// Outlives the effects holding its buffers
+		SampleBufferPool samples;
+
+		// Held while mixing; only taken by Tick and the output thread
+		std::mutex mtxSync;
+		EffectPool effects;
+
+		EffectHandles handles;
+
+		PortSnapshot snapshot;
+		uint32_t publishedState;
+		uint8_t publishedForceX;
+		uint8_t publishedForceY;
+
+		// Last forces sent to the device
+		uint8_t lastForceX;
+		uint8_t lastForceY;
+
+		bool actuatorsOn;
+
+		// Forces held back by the rate limiter
+		bool hasDeferred;
+		uint8_t deferredForceX;
+		uint8_t deferredForceY;
+
+		// Mixed force to device force, rebuilt when the gain changes
+		uint8_t gainTable[256];
+		std::atomic<uint32_t> deviceGain;
+		uint32_t tableGain;
+
+		std::atomic<uint8_t> mixMode;
+
+		RateLimiter limiter;
+		std::atomic<uint32_t> maxReportRate;
+		std::atomic<uint32_t> reportBurst;
+		uint32_t limiterRate;
+		uint32_t limiterBurst;
+
+		// Written under mtxSync, except effectsEvicted
+		std::atomic<uint64_t> reportsSent;
+		std::atomic<uint64_t> reportsDeduplicated;
+		std::atomic<uint64_t> reportsDeferred;
+		std::atomic<uint64_t> reportsMerged;
+		std::atomic<uint64_t> commandsApplied;
+		std::atomic<uint64_t> effectsEvicted;
+		LatencyHistogram callToMix;
+
+		// Owned by the OutputScheduler the port is registered with
+		OutputScheduler* scheduler;
+		std::atomic<bool> wakePending;
+		VibrationPort* nextReady;
+		uint32_t slot;
+		bool removing;
+	};
+
+}
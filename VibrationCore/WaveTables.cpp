@@ -0,0 +1,42 @@
+#include "WaveTables.h"
+#include "EffectParams.h"
+#include <cmath>
+
+namespace vibration {
+
+	namespace {
+
+		const double PI = 3.14159265358979323846;
+
+		struct WaveTables {
+			int16_t samples[WAVE_COUNT][WAVE_TABLE_SIZE];
+
+			WaveTables() {
+				for (uint32_t k = 0; k < WAVE_TABLE_SIZE; k++) {
+					double t = (double)k / WAVE_TABLE_SIZE;
+
+					double triangle = t < 0.25 ? 4.0 * t : t < 0.75 ? 2.0 - 4.0 * t : 4.0 * t - 4.0;
+					double sawUp = 2.0 * t - 1.0;
+
+					samples[WAVE_SQUARE][k] = t < 0.5 ? 32767 : -32767;
+					samples[WAVE_SINE][k] = Q15(sin(2.0 * PI * t));
+					samples[WAVE_TRIANGLE][k] = Q15(triangle);
+					samples[WAVE_SAWTOOTH_UP][k] = Q15(sawUp);
+					samples[WAVE_SAWTOOTH_DOWN][k] = Q15(-sawUp);
+				}
+			}
+
+			static int16_t Q15(double v) {
+				return (int16_t)lround(v * 32767.0);
+			}
+		};
+
+	}
+
+	const int16_t* GetWaveTable(uint8_t waveform)
+	{
+		static const WaveTables tables;
+		return tables.samples[waveform < WAVE_COUNT ? waveform : (uint8_t)WAVE_SINE];
+	}
+
+}
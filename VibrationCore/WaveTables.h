@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+
+namespace vibration {
+
+	// One period of each waveform in Q15, indexed by the top bits of a
+	// 64-bit phase (a full period is 2^64)
+	const uint32_t WAVE_TABLE_BITS = 8;
+	const uint32_t WAVE_TABLE_SIZE = 1 << WAVE_TABLE_BITS;
+
+	const int16_t* GetWaveTable(uint8_t waveform);
+
+	inline int32_t WaveSample(const int16_t* table, uint64_t phase) {
+		return table[phase >> (64 - WAVE_TABLE_BITS)];
+	}
+
+}
@@ -0,0 +1,203 @@
+// Port 0 sits behind a stalled endpoint (50 ms per write) and gets a new
+// magnitude every 2 ms, port 1 is healthy and plays 20 ms effects. Both are
+// serviced by the same OutputScheduler. With the blocking sink every write
+// of port 0 holds up the scheduler; with AsyncReportSink it only coalesces.
+
+#include "VibrationPort.h"
+#include "OutputScheduler.h"
+#include "AsyncReportSink.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <thread>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	const auto STALL_TIME = std::chrono::milliseconds(50);
+	const uint32_t EFFECT_MS = 20;
+
+	class BlockingSink : public IReportSink
+	{
+	public:
+		BlockingSink(BenchClock::duration writeTime) : writeTime(writeTime), writes(0) {}
+
+		void SendReport(const uint8_t* /* buff */, size_t /* buffsz */) override {
+			std::this_thread::sleep_for(writeTime);
+			writes++;
+		}
+
+		BenchClock::duration writeTime;
+		std::atomic<uint64_t> writes;
+	};
+
+	// Fake endpoint completing each write from its own thread
+	class SlowTransport : public IReportTransport
+	{
+	public:
+		SlowTransport(BenchClock::duration writeTime) : writeTime(writeTime), quit(false), completion(NULL), writes(0) {
+			worker = std::thread([this] {
+				std::unique_lock<std::mutex> lock(mtx);
+				while (true) {
+					cv.wait(lock, [this] { return quit || completion != NULL; });
+					if (completion == NULL)
+						break;
+
+					IWriteCompletion* done = completion;
+					completion = NULL;
+					lock.unlock();
+
+					std::this_thread::sleep_for(this->writeTime);
+					writes++;
+					done->OnWriteComplete(true);
+
+					lock.lock();
+				}
+			});
+		}
+		~SlowTransport() {
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				quit = true;
+			}
+			cv.notify_one();
+			worker.join();
+		}
+
+		bool BeginWrite(const uint8_t* /* buff */, size_t /* buffsz */, IWriteCompletion& done) override {
+			std::lock_guard<std::mutex> lock(mtx);
+			completion = &done;
+			cv.notify_one();
+			return true;
+		}
+
+		BenchClock::duration writeTime;
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool quit;
+		IWriteCompletion* completion;
+		std::atomic<uint64_t> writes;
+		std::thread worker;
+	};
+
+	// Healthy port: measures how late the stop report of each effect is
+	class LatencySink : public IReportSink
+	{
+	public:
+		LatencySink() : expectedStop(0) {}
+
+		void SendReport(const uint8_t* buff, size_t /* buffsz */) override {
+			if (buff[3] != 0 || buff[4] != 0)
+				return;
+
+			int64_t expected = expectedStop.exchange(0);
+			if (expected != 0) {
+				int64_t now = BenchClock::now().time_since_epoch().count();
+				lateness.push_back(std::chrono::duration<double, std::micro>(BenchClock::duration(now - expected)).count());
+			}
+		}
+
+		std::atomic<int64_t> expectedStop;
+		std::vector<double> lateness;
+	};
+
+	double Percentile(std::vector<double>& v, double p) {
+		if (v.empty())
+			return 0.0;
+		std::sort(v.begin(), v.end());
+		return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+	}
+
+	void Run(const char* name, IReportSink& stalledSink, int runMs) {
+		SteadyClock clock;
+		LatencySink healthySink;
+		VibrationPort stalled(0, clock, stalledSink);
+		VibrationPort healthy(1, clock, healthySink);
+		OutputScheduler scheduler(clock);
+
+		scheduler.AddPort(stalled);
+		scheduler.AddPort(healthy);
+
+		int32_t dir[2] = { 1, 1 };
+		std::vector<double> callerLatency;
+
+		auto t0 = BenchClock::now();
+		auto end = t0 + std::chrono::milliseconds(runMs);
+		auto nextHealthy = t0;
+
+		uint32_t stalledHandle = 0;
+		uint32_t healthyHandle = 0;
+		for (int i = 0; BenchClock::now() < end; i++) {
+			ConstantForce cf = { (i % 100) * 100 };
+			EffectDesc eff = {};
+			eff.dwDuration = EFFECT_INFINITE;
+			eff.dwGain = 10000;
+			eff.cAxes = 2;
+			eff.rglDirection = dir;
+			eff.cbTypeSpecificParams = sizeof(cf);
+			eff.lpvTypeSpecificParams = &cf;
+
+			auto begin = BenchClock::now();
+			stalled.DownloadEffect(0, eff, stalledHandle, DOWNLOAD_START);
+			callerLatency.push_back(std::chrono::duration<double, std::micro>(BenchClock::now() - begin).count());
+
+			if (begin >= nextHealthy) {
+				ConstantForce full = { 10000 };
+				EffectDesc shortEff = {};
+				shortEff.dwDuration = EFFECT_MS * 1000;
+				shortEff.dwGain = 10000;
+				shortEff.cAxes = 2;
+				shortEff.rglDirection = dir;
+				shortEff.cbTypeSpecificParams = sizeof(full);
+				shortEff.lpvTypeSpecificParams = &full;
+				healthySink.expectedStop = (BenchClock::now() + std::chrono::milliseconds(EFFECT_MS)).time_since_epoch().count();
+				healthy.DownloadEffect(0, shortEff, healthyHandle, DOWNLOAD_START);
+				nextHealthy = begin + std::chrono::milliseconds(2 * EFFECT_MS);
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+
+		scheduler.RemovePort(healthy);
+		scheduler.RemovePort(stalled);
+
+		printf("%-8s caller us p99 %7.2f  healthy port stop edges %3zu late us p50 %9.1f p99 %9.1f max %9.1f\n",
+			name, Percentile(callerLatency, 0.99), healthySink.lateness.size(),
+			Percentile(healthySink.lateness, 0.5), Percentile(healthySink.lateness, 0.99),
+			Percentile(healthySink.lateness, 1.0));
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int runMs = argc > 1 ? atoi(argv[1]) : 1000;
+
+	{
+		BlockingSink sink(STALL_TIME);
+		Run("blocking", sink, runMs);
+		printf("         stalled port writes %llu\n", (unsigned long long)sink.writes);
+	}
+
+	{
+		SlowTransport transport(STALL_TIME);
+		OutputStats stats;
+		{
+			AsyncReportSink sink(transport);
+			Run("async", sink, runMs);
+			sink.Drain(std::chrono::seconds(1));
+			stats = sink.GetStats();
+		}
+		printf("         stalled port writes %llu  coalesced %llu  write us avg %.0f max %llu\n",
+			(unsigned long long)stats.writesStarted, (unsigned long long)stats.reportsCoalesced,
+			stats.writesStarted ? (double)stats.totalWriteMicros / stats.writesStarted : 0.0,
+			(unsigned long long)stats.maxWriteMicros);
+	}
+
+	return 0;
+}
@@ -0,0 +1,162 @@
+// Caller-side latency of StartEffect with many DirectInput caller threads
+// while the output thread is stuck in slow report writes. The "locked" case
+// replicates the previous design where callers and the output thread shared
+// one mutex held across the write.
+
+#include "VibrationPort.h"
+#include "OutputScheduler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	const auto WRITE_TIME = std::chrono::microseconds(1000);
+
+	// A USB interrupt transfer takes about a frame
+	class SlowSink : public IReportSink
+	{
+	public:
+		void SendReport(const uint8_t* /* buff */, size_t /* buffsz */) override {
+			std::this_thread::sleep_for(WRITE_TIME);
+		}
+	};
+
+	class LockedEngine
+	{
+	public:
+		LockedEngine(IClock& clock, IReportSink& sink) : clock(clock), sink(sink), quit(false) {
+			thr = std::thread([this] {
+				uint8_t lastX = 0, lastY = 0;
+				while (!quit) {
+					{
+						std::lock_guard<std::mutex> lock(mtxSync);
+						uint8_t x, y;
+						uint64_t next;
+						pool.Mix(this->clock.Now(), x, y, next);
+						if (x != lastX || y != lastY) {
+							uint8_t report[5] = { 1, 1, 0, y, x };
+							this->sink.SendReport(report, sizeof(report));
+							lastX = x;
+							lastY = y;
+						}
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+			});
+		}
+		~LockedEngine() {
+			quit = true;
+			thr.join();
+		}
+
+		void StartEffect(uint32_t dwEffectID, int32_t lMagnitude) {
+			EffectParams params = {};
+			params.dwGain = 10000;
+			params.kind = KIND_CONSTANT;
+			params.motors = MOTOR_X | MOTOR_Y;
+			params.lMagnitude = lMagnitude;
+			params.dwDuration = 50;
+
+			std::lock_guard<std::mutex> lock(mtxSync);
+			uint32_t dwHandle = MakeEffectHandle(dwEffectID, 1);
+			pool.Download(dwHandle, params);
+			pool.Start(dwHandle, clock.Now());
+		}
+
+		IClock& clock;
+		IReportSink& sink;
+		std::mutex mtxSync;
+		EffectPool pool;
+		std::atomic<bool> quit;
+		std::thread thr;
+	};
+
+	double Percentile(std::vector<double>& v, double p) {
+		if (v.empty())
+			return 0.0;
+		std::sort(v.begin(), v.end());
+		return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+	}
+
+	template <typename Call>
+	void RunCallers(const char* name, int threads, int callsPerThread, Call call) {
+		std::vector<std::vector<double>> latencies(threads);
+		std::vector<std::thread> callers;
+		std::atomic<uint64_t> rejected(0);
+
+		auto t0 = BenchClock::now();
+		for (int t = 0; t < threads; t++) {
+			callers.emplace_back([&, t] {
+				latencies[t].reserve(callsPerThread);
+				for (int i = 0; i < callsPerThread; i++) {
+					auto begin = BenchClock::now();
+					if (!call(t, i))
+						rejected++;
+					latencies[t].push_back(std::chrono::duration<double, std::micro>(BenchClock::now() - begin).count());
+					std::this_thread::sleep_for(std::chrono::microseconds(500));
+				}
+			});
+		}
+		for (auto& c : callers)
+			c.join();
+		double elapsed = std::chrono::duration<double>(BenchClock::now() - t0).count();
+
+		std::vector<double> all;
+		for (auto& l : latencies)
+			all.insert(all.end(), l.begin(), l.end());
+
+		printf("%-7s threads %3d  calls/s %9.0f  rejected %6llu  latency us p50 %8.2f p99 %8.2f p999 %8.2f max %8.2f\n",
+			name, threads, all.size() / elapsed, (unsigned long long)rejected,
+			Percentile(all, 0.5), Percentile(all, 0.99), Percentile(all, 0.999), Percentile(all, 1.0));
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int callsPerThread = argc > 1 ? atoi(argv[1]) : 500;
+	const int threadCounts[] = { 1, 4, 16, 64 };
+
+	SteadyClock clock;
+	SlowSink sink;
+
+	for (int threads : threadCounts) {
+		{
+			LockedEngine engine(clock, sink);
+			RunCallers("locked", threads, callsPerThread, [&](int t, int i) {
+				engine.StartEffect(t, (int32_t)(i & 0x7f) * 78);
+				return true;
+			});
+		}
+
+		{
+			VibrationPort port(0, clock, sink);
+			OutputScheduler scheduler(clock);
+			scheduler.AddPort(port);
+
+			int32_t dir[2] = { 1, 1 };
+			std::vector<uint32_t> handles(threads, 0);
+			RunCallers("queue", threads, callsPerThread, [&](int t, int i) {
+				ConstantForce cf = { (int32_t)(i & 0x7f) * 78 };
+				EffectDesc eff = {};
+				eff.dwDuration = 50000;
+				eff.dwGain = 10000;
+				eff.cAxes = 2;
+				eff.rglDirection = dir;
+				eff.cbTypeSpecificParams = sizeof(cf);
+				eff.lpvTypeSpecificParams = &cf;
+				return port.DownloadEffect(0, eff, handles[t], DOWNLOAD_START);
+			});
+
+			scheduler.RemovePort(port);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,363 @@
+// Reproduces games calling DownloadEffect hundreds of times a second from
+// several threads. Caller threads per port post randomized constant,
+// periodic and stop calls at a target rate through a mutex shared by all
+// ports, as VibrationController::mtxSync is, while the OutputScheduler and
+// the AsyncReportSink of each port write to a fake HID endpoint. Reports
+// the caller side latency, the time spent waiting for and holding the
+// lock, and the achieved call rate. Percentiles are the upper bounds of
+// LatencyHistogram buckets, within 6.25%.
+//
+//   ContentionStress [--ports n] [--threads n] [--rate calls/s] [--seconds s]
+//                    [--write-us us] [--lock global|port] [--seed n]
+//
+// --threads and --rate are per port and per thread; --write-us is the time
+// the endpoint takes per report (1000, a full speed interrupt endpoint, by
+// default). --lock port gives each port its own mutex, to compare a finer
+// grained controller lock against the current one.
+
+#include "DeviceRegistry.h"
+#include "Telemetry.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	// Effects each caller thread keeps downloaded on its port
+	const int EFFECTS_PER_THREAD = 8;
+
+	// A caller this far behind its schedule skips the missed calls
+	const auto MAX_BACKLOG = std::chrono::milliseconds(100);
+
+	// Fake endpoint completing each write from its own thread after
+	// writeTime
+	class FakeHidTransport : public IReportTransport
+	{
+	public:
+		FakeHidTransport(BenchClock::duration writeTime)
+			: writeTime(writeTime), quit(false), completion(NULL), writes(0), nonZero(0)
+		{
+			worker = std::thread([this] {
+				std::unique_lock<std::mutex> lock(mtx);
+				while (true) {
+					cv.wait(lock, [this] { return quit || completion != NULL; });
+					if (completion == NULL)
+						break;
+
+					IWriteCompletion* done = completion;
+					completion = NULL;
+					lock.unlock();
+
+					std::this_thread::sleep_for(this->writeTime);
+					writes++;
+					done->OnWriteComplete(true);
+
+					lock.lock();
+				}
+			});
+		}
+
+		~FakeHidTransport()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				quit = true;
+			}
+			cv.notify_one();
+			worker.join();
+		}
+
+		bool BeginWrite(const uint8_t* buff, size_t buffsz, IWriteCompletion& done) override
+		{
+			if (buffsz == REPORT_SIZE && (buff[3] != 0 || buff[4] != 0))
+				nonZero++;
+
+			std::lock_guard<std::mutex> lock(mtx);
+			completion = &done;
+			cv.notify_one();
+			return true;
+		}
+
+		BenchClock::duration writeTime;
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool quit;
+		IWriteCompletion* completion;
+		std::atomic<uint64_t> writes;
+		std::atomic<uint64_t> nonZero;
+		std::thread worker;
+	};
+
+	struct Options {
+		int ports;
+		int threads;
+		int rate;
+		int seconds;
+		int writeMicros;
+		bool portLock;
+		uint32_t seed;
+	};
+
+	// Recorded by one caller thread, in nanoseconds
+	struct CallerStats {
+		CallerStats() : calls(0), failed(0), skipped(0), maxCall(0), maxHold(0) {}
+
+		LatencyHistogram call;
+		LatencyHistogram wait;
+		LatencyHistogram hold;
+		uint64_t calls;
+		uint64_t failed;
+		uint64_t skipped;
+		uint64_t maxCall;
+		uint64_t maxHold;
+	};
+
+	struct Histogram {
+		Histogram() : counts() {}
+
+		void Add(const LatencyHistogram& histogram) {
+			uint64_t copy[HISTOGRAM_BUCKETS];
+			histogram.CopyTo(copy);
+			for (uint32_t k = 0; k < HISTOGRAM_BUCKETS; k++)
+				counts[k] += copy[k];
+		}
+
+		double Micros(double fraction) const {
+			return LatencyHistogram::Percentile(counts, fraction) / 1000.0;
+		}
+
+		uint64_t counts[HISTOGRAM_BUCKETS];
+	};
+
+	uint64_t Nanos(BenchClock::duration d) {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+	}
+
+	// Same sequence as VibrationController::DownloadEffect/StopEffect: find
+	// the port and post the call with the lock held
+	void CallerThread(DeviceRegistry& registry, std::mutex& mtxSync, uint32_t dwID, const Options& options,
+		uint32_t seed, BenchClock::time_point start, BenchClock::time_point end, CallerStats& stats)
+	{
+		std::mt19937 rng(seed);
+		uint32_t handles[EFFECTS_PER_THREAD] = {};
+		int32_t dir[2] = { 1, 1 };
+
+		const auto interval = std::chrono::nanoseconds(1000000000 / options.rate);
+		auto next = start + std::chrono::nanoseconds(rng() % (uint32_t)interval.count());
+
+		while (true) {
+			std::this_thread::sleep_until(next);
+			auto now = BenchClock::now();
+			if (now >= end)
+				break;
+
+			next += interval;
+			if (now - next > MAX_BACKLOG) {
+				auto missed = (now - next) / interval;
+				stats.skipped += missed;
+				next += missed * interval;
+			}
+
+			int slot = rng() % EFFECTS_PER_THREAD;
+			uint32_t choice = rng() % 100;
+
+			ConstantForce constant = { (int32_t)(rng() % 20001) - 10000 };
+			PeriodicForce periodic = { (uint32_t)(rng() % 10001), 0, 0, (uint32_t)(20 + rng() % 200) * 1000 };
+			EffectDesc eff = {};
+			eff.dwDuration = (uint32_t)(50 + rng() % 500) * 1000;
+			eff.dwGain = 10000;
+			eff.cAxes = 2;
+			eff.rglDirection = dir;
+
+			uint32_t dwEffectType;
+			if (choice < 45) {
+				dwEffectType = EFFECT_CONSTANT;
+				eff.cbTypeSpecificParams = sizeof(constant);
+				eff.lpvTypeSpecificParams = &constant;
+			}
+			else {
+				dwEffectType = EFFECT_SQUARE + (uint32_t)(rng() % 5);
+				eff.cbTypeSpecificParams = sizeof(periodic);
+				eff.lpvTypeSpecificParams = &periodic;
+			}
+
+			auto t0 = BenchClock::now();
+			BenchClock::time_point t1, t2;
+			bool ok = true;
+			{
+				std::lock_guard<std::mutex> lock(mtxSync);
+				t1 = BenchClock::now();
+
+				VibrationPort* port = registry.Find(dwID);
+				if (choice >= 80) {
+					if (handles[slot] != 0 && port->IsEffectHandle(handles[slot]))
+						port->StopEffect(handles[slot]);
+				}
+				else {
+					uint32_t dwHandle = handles[slot];
+					if (dwHandle != 0 && !port->IsEffectHandle(dwHandle))
+						dwHandle = 0;
+					ok = port->DownloadEffect(dwEffectType, eff, dwHandle, DOWNLOAD_START);
+					if (ok)
+						handles[slot] = dwHandle;
+				}
+
+				t2 = BenchClock::now();
+			}
+			auto t3 = BenchClock::now();
+
+			uint64_t callNs = Nanos(t3 - t0);
+			uint64_t holdNs = Nanos(t2 - t1);
+			stats.call.Record(callNs);
+			stats.wait.Record(Nanos(t1 - t0));
+			stats.hold.Record(holdNs);
+			stats.maxCall = std::max(stats.maxCall, callNs);
+			stats.maxHold = std::max(stats.maxHold, holdNs);
+			stats.calls++;
+			if (!ok)
+				stats.failed++;
+		}
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options) {
+		options.ports = 2;
+		options.threads = 4;
+		options.rate = 500;
+		options.seconds = 5;
+		options.writeMicros = 1000;
+		options.portLock = false;
+		options.seed = 1;
+
+		for (int i = 1; i < argc; i++) {
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+			if (value == NULL)
+				return false;
+
+			if (strcmp(arg, "--ports") == 0)
+				options.ports = atoi(value);
+			else if (strcmp(arg, "--threads") == 0)
+				options.threads = atoi(value);
+			else if (strcmp(arg, "--rate") == 0)
+				options.rate = atoi(value);
+			else if (strcmp(arg, "--seconds") == 0)
+				options.seconds = atoi(value);
+			else if (strcmp(arg, "--write-us") == 0)
+				options.writeMicros = atoi(value);
+			else if (strcmp(arg, "--seed") == 0)
+				options.seed = (uint32_t)strtoul(value, NULL, 10);
+			else if (strcmp(arg, "--lock") == 0 && (strcmp(value, "global") == 0 || strcmp(value, "port") == 0))
+				options.portLock = strcmp(value, "port") == 0;
+			else
+				return false;
+			i++;
+		}
+
+		// Calls are spaced by a whole number of nanoseconds
+		return options.ports > 0 && options.threads > 0 && options.rate > 0 && options.rate <= 1000000000
+			&& options.seconds > 0 && options.writeMicros >= 0;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: %s [--ports n] [--threads n] [--rate calls/s] [--seconds s] [--write-us us]"
+			" [--lock global|port] [--seed n]\n", argv[0]);
+		return 2;
+	}
+
+	SteadyClock clock;
+	OutputScheduler scheduler(clock);
+	DeviceRegistry registry(clock, scheduler);
+
+	std::vector<FakeHidTransport*> transports;
+	for (int p = 0; p < options.ports; p++) {
+		std::unique_ptr<IReportTransport> transport(new FakeHidTransport(std::chrono::microseconds(options.writeMicros)));
+		transports.push_back((FakeHidTransport*)transport.get());
+		registry.Register(p + 1, p, std::move(transport));
+	}
+
+	std::mutex mtxGlobal;
+	std::vector<std::unique_ptr<std::mutex>> portMutexes;
+	for (int p = 0; p < options.ports; p++)
+		portMutexes.emplace_back(new std::mutex());
+
+	std::vector<std::unique_ptr<CallerStats>> stats;
+	std::vector<std::thread> callers;
+	auto start = BenchClock::now() + std::chrono::milliseconds(20);
+	auto end = start + std::chrono::seconds(options.seconds);
+
+	for (int p = 0; p < options.ports; p++) {
+		std::mutex& mtxSync = options.portLock ? *portMutexes[p] : mtxGlobal;
+		for (int t = 0; t < options.threads; t++) {
+			stats.emplace_back(new CallerStats());
+			CallerStats& threadStats = *stats.back();
+			uint32_t seed = options.seed * 1000003u + p * 1009u + t;
+			callers.emplace_back(CallerThread, std::ref(registry), std::ref(mtxSync), (uint32_t)(p + 1),
+				std::cref(options), seed, start, end, std::ref(threadStats));
+		}
+	}
+
+	for (auto& caller : callers)
+		caller.join();
+	double elapsed = std::chrono::duration<double>(BenchClock::now() - start).count();
+
+	printf("%d ports x %d threads at %d calls/s, %s lock, %d us per write, %.2f s\n", options.ports, options.threads,
+		options.rate, options.portLock ? "port" : "global", options.writeMicros, elapsed);
+	printf("caller us (p50 / p99 / p999 / max)   lock wait us (p99 / p999)   lock hold us (p50 / p99 / max)\n");
+
+	Histogram allCalls;
+	uint64_t allCount = 0;
+	for (int p = 0; p < options.ports; p++) {
+		Histogram call, wait, hold;
+		uint64_t calls = 0, failed = 0, skipped = 0, maxCall = 0, maxHold = 0;
+		for (int t = 0; t < options.threads; t++) {
+			CallerStats& s = *stats[p * options.threads + t];
+			call.Add(s.call);
+			allCalls.Add(s.call);
+			wait.Add(s.wait);
+			hold.Add(s.hold);
+			calls += s.calls;
+			failed += s.failed;
+			skipped += s.skipped;
+			maxCall = std::max(maxCall, s.maxCall);
+			maxHold = std::max(maxHold, s.maxHold);
+		}
+		allCount += calls;
+
+		PortTelemetry telemetry;
+		registry.GetTelemetry(p + 1, telemetry);
+
+		printf("port %d  %8.2f %8.2f %8.2f %9.2f   %8.2f %8.2f   %8.2f %8.2f %9.2f\n", p,
+			call.Micros(0.5), call.Micros(0.99), call.Micros(0.999), maxCall / 1000.0,
+			wait.Micros(0.99), wait.Micros(0.999),
+			hold.Micros(0.5), hold.Micros(0.99), maxHold / 1000.0);
+		printf("        %llu calls (%.0f/s of %d), %llu failed, %llu skipped behind schedule\n",
+			(unsigned long long)calls, calls / elapsed, options.threads * options.rate,
+			(unsigned long long)failed, (unsigned long long)skipped);
+		printf("        %llu mixing passes, %llu writes (%llu with force), %llu coalesced, call to mix us p99 %llu\n",
+			(unsigned long long)telemetry.mixPasses, (unsigned long long)transports[p]->writes.load(),
+			(unsigned long long)transports[p]->nonZero.load(), (unsigned long long)telemetry.reportsCoalesced,
+			(unsigned long long)LatencyHistogram::Percentile(telemetry.callToMix, 0.99));
+	}
+
+	printf("all     %8.2f %8.2f %8.2f             %llu calls, %.0f calls/s\n",
+		allCalls.Micros(0.5), allCalls.Micros(0.99), allCalls.Micros(0.999),
+		(unsigned long long)allCount, allCount / elapsed);
+
+	registry.UnregisterAll();
+	return 0;
+}
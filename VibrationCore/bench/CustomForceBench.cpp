@@ -0,0 +1,157 @@
+// Custom force playback on a virtual clock: checks the reported forces
+// against the downloaded samples, then restarts and re-downloads the same
+// track many times and reports the sample memory of the port and the heap
+// allocations made meanwhile (global operator new is counted).
+
+#include "Simulation.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations++;
+	if (void* p = malloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+namespace {
+
+	class StateSink : public IReportSink
+	{
+	public:
+		StateSink() : forceX(0), forceY(0) {}
+		void SendReport(const uint8_t* buff, size_t /* buffsz */) override {
+			forceY = buff[3];
+			forceX = buff[4];
+		}
+		uint8_t forceX;
+		uint8_t forceY;
+	};
+
+	const uint32_t SAMPLE_PERIOD_MS = 5;
+
+	// Two channel track, X then Y for each sample
+	std::vector<int32_t> MakeTrack(uint32_t frames, int seed) {
+		std::vector<int32_t> track;
+		for (uint32_t k = 0; k < frames; k++) {
+			track.push_back((int32_t)((k * 37 + seed * 101) % 20001) - 10000);
+			track.push_back((int32_t)((k * 53 + seed * 17) % 20001) - 10000);
+		}
+		return track;
+	}
+
+	void Report(const char* phase, uint64_t count, VibrationPort& port, uint64_t allocs, double seconds) {
+		printf("%-22s %7llu  sample bytes %7llu  allocs %6llu  us/op %6.2f\n",
+			phase, (unsigned long long)count, (unsigned long long)port.GetStats().sampleBytes,
+			(unsigned long long)allocs, seconds * 1e6 / count);
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const uint32_t iterations = argc > 1 ? atoi(argv[1]) : 10000;
+	const uint32_t trackFrames = 4000;
+
+	VirtualClock clock;
+	StateSink sink;
+	VibrationPort port(0, clock, sink);
+
+	std::vector<int32_t> track = MakeTrack(trackFrames, 1);
+	std::vector<int32_t> other = MakeTrack(trackFrames, 2);
+
+	int32_t dir[2] = { 1, 1 };
+	CustomForce custom = { 2, SAMPLE_PERIOD_MS * 1000, (uint32_t)track.size(), track.data() };
+	EffectDesc eff = {};
+	eff.dwDuration = trackFrames * SAMPLE_PERIOD_MS * 2000;
+	eff.dwGain = 10000;
+	eff.cAxes = 2;
+	eff.rglDirection = dir;
+	eff.cbTypeSpecificParams = sizeof(custom);
+	eff.lpvTypeSpecificParams = &custom;
+
+	// Plays the track twice through, checking every millisecond
+	uint32_t dwHandle = 0;
+	port.DownloadEffect(EFFECT_CUSTOM, eff, dwHandle, DOWNLOAD_START);
+
+	int maxError = 0;
+	uint32_t reportsBefore = (uint32_t)port.GetStats().reportsSent;
+	for (uint32_t ms = 0; ms < 2 * trackFrames * SAMPLE_PERIOD_MS; ms++) {
+		clock.Set((uint64_t)ms * 1000);
+		port.Tick();
+
+		uint32_t k = (ms / SAMPLE_PERIOD_MS) % trackFrames;
+		int errorX = abs((int)sink.forceX - ForceFromLevel(track[2 * k]));
+		int errorY = abs((int)sink.forceY - ForceFromLevel(track[2 * k + 1]));
+		maxError = errorX > maxError ? errorX : maxError;
+		maxError = errorY > maxError ? errorY : maxError;
+	}
+	printf("playback %u samples x2  reports %llu  max error %d  %s\n", trackFrames,
+		(unsigned long long)(port.GetStats().reportsSent - reportsBefore), maxError, maxError == 0 ? "ok" : "FAILED");
+
+	// Restarts share the downloaded samples
+	uint64_t allocs0 = allocations;
+	auto t0 = BenchClock::now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		port.StartEffect(dwHandle);
+		clock.Advance(1000);
+		port.Tick();
+	}
+	Report("restart", iterations, port, allocations - allocs0, std::chrono::duration<double>(BenchClock::now() - t0).count());
+
+	// Identical samples are compared, not copied
+	allocs0 = allocations;
+	t0 = BenchClock::now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		port.DownloadEffect(EFFECT_CUSTOM, eff, dwHandle, DOWNLOAD_START);
+		clock.Advance(1000);
+		port.Tick();
+	}
+	Report("download same", iterations, port, allocations - allocs0, std::chrono::duration<double>(BenchClock::now() - t0).count());
+
+	// Changing samples recycle the released buffers
+	allocs0 = allocations;
+	t0 = BenchClock::now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		custom.rglForceData = (i & 1) ? track.data() : other.data();
+		port.DownloadEffect(EFFECT_CUSTOM, eff, dwHandle, DOWNLOAD_START);
+		clock.Advance(1000);
+		port.Tick();
+	}
+	Report("download alternating", iterations, port, allocations - allocs0, std::chrono::duration<double>(BenchClock::now() - t0).count());
+
+	// New effects each time, destroyed right after
+	allocs0 = allocations;
+	t0 = BenchClock::now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		uint32_t dwTemp = 0;
+		port.DownloadEffect(EFFECT_CUSTOM, eff, dwTemp, DOWNLOAD_START);
+		clock.Advance(1000);
+		port.Tick();
+		port.DestroyEffect(dwTemp);
+	}
+	port.Tick();
+	Report("download+destroy", iterations, port, allocations - allocs0, std::chrono::duration<double>(BenchClock::now() - t0).count());
+
+	return maxError == 0 ? 0 : 1;
+}
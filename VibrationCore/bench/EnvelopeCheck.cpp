@@ -0,0 +1,136 @@
+// Plays enveloped effects through a VibrationPort on a virtual clock and
+// compares the reported forces with a closed-form reference of the
+// DIENVELOPE attack and fade, which start and end at the motors off for a
+// level of 0. The port is ticked either every millisecond
+// or only at the times it asks for. Exits with 1 on a mismatch.
+
+#include "Simulation.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace vibration;
+
+namespace {
+
+	// Keeps the forces the device would be playing
+	class StateSink : public IReportSink
+	{
+	public:
+		StateSink() : forceX(0), forceY(0) {}
+		void SendReport(const uint8_t* buff, size_t /* buffsz */) override {
+			forceY = buff[3];
+			forceX = buff[4];
+		}
+		uint8_t forceX;
+		uint8_t forceY;
+	};
+
+	struct Case {
+		const char* name;
+		uint32_t dwEffectType;
+		int32_t lMagnitude;
+		uint32_t dwDurationMs;
+		Envelope env;
+	};
+
+	const uint32_t PERIOD_MS = 200;
+
+	// Force the effect should play ms after its start. The envelope scales
+	// the force of the effect without one relative to the sustain, so its
+	// 0 level is off.
+	double ReferenceForce(const Case& c, uint32_t ms) {
+		double sustain = fabs((double)c.lMagnitude);
+		double attackTime = c.env.dwAttackTime / 1000.0;
+		double fadeTime = c.env.dwFadeTime / 1000.0;
+		double fadeStart = c.dwDurationMs - fadeTime;
+
+		auto attack = [&](double t) {
+			return t < attackTime ? c.env.dwAttackLevel + (sustain - c.env.dwAttackLevel) * t / attackTime : sustain;
+		};
+
+		// An early fade starts from the level the attack got to
+		double magnitude = attack(ms);
+		if (fadeTime > 0 && ms >= fadeStart) {
+			double from = attack(fadeStart);
+			magnitude = from + (c.env.dwFadeLevel - from) * (ms - fadeStart) / fadeTime;
+		}
+
+		int32_t level = c.lMagnitude;
+		if (c.dwEffectType == EFFECT_SQUARE)
+			level = (ms % PERIOD_MS) < PERIOD_MS / 2 ? c.lMagnitude : -c.lMagnitude;
+
+		double force = ForceFromLevel(level) * magnitude / (sustain != 0 ? sustain : 10000);
+		return force < FORCE_MAX ? force : FORCE_MAX;
+	}
+
+	int Run(const Case& c, bool everyMs) {
+		VirtualClock clock(1000000);
+		StateSink sink;
+		VibrationPort port(0, clock, sink);
+
+		int32_t dir[2] = { 1, 1 };
+		ConstantForce cf = { c.lMagnitude };
+		PeriodicForce pf = { (uint32_t)c.lMagnitude, 0, 0, PERIOD_MS * 1000 };
+
+		EffectDesc eff = {};
+		eff.dwDuration = c.dwDurationMs * 1000;
+		eff.dwGain = 10000;
+		eff.cAxes = 2;
+		eff.rglDirection = dir;
+		eff.cbTypeSpecificParams = sizeof(cf);
+		eff.lpvTypeSpecificParams = &cf;
+		eff.lpEnvelope = &c.env;
+		if (c.dwEffectType == EFFECT_SQUARE) {
+			eff.cbTypeSpecificParams = sizeof(pf);
+			eff.lpvTypeSpecificParams = &pf;
+		}
+
+		uint64_t startTime = clock.Now();
+		uint32_t dwHandle = 0;
+		port.DownloadEffect(c.dwEffectType, eff, dwHandle, DOWNLOAD_START);
+
+		int maxError = 0;
+		int checks = 0;
+		uint64_t nextTime = startTime;
+		for (uint32_t ms = 0; ms <= c.dwDurationMs + 10; ms++) {
+			clock.Set(startTime + ms * 1000);
+			if (!everyMs && ms > 0 && !TimeReached(clock.Now(), nextTime))
+				continue;
+
+			if (!port.Service(nextTime))
+				nextTime = clock.Now() + 1000000000;
+
+			int expected = ms < c.dwDurationMs ? (int)lround(ReferenceForce(c, ms)) : 0;
+			int error = abs((int)sink.forceX - expected);
+			if (error > maxError)
+				maxError = error;
+			checks++;
+		}
+
+		bool ok = maxError <= 1;
+		printf("%-26s %-12s checks %5d  max error %3d  %s\n",
+			c.name, everyMs ? "every ms" : "deadlines", checks, maxError, ok ? "ok" : "FAILED");
+		return ok ? 0 : 1;
+	}
+
+}
+
+int main()
+{
+	const Case cases[] = {
+		{ "constant attack+fade", EFFECT_CONSTANT, 10000, 1000, { sizeof(Envelope), 0, 300000, 0, 400000 } },
+		{ "constant attack only", EFFECT_CONSTANT, 6000, 800, { sizeof(Envelope), 2000, 500000, 0, 0 } },
+		{ "negative fade up", EFFECT_CONSTANT, -8000, 600, { sizeof(Envelope), 0, 0, 10000, 250000 } },
+		{ "overlapping attack/fade", EFFECT_CONSTANT, 10000, 500, { sizeof(Envelope), 0, 400000, 0, 300000 } },
+		{ "square attack+fade", EFFECT_SQUARE, 9000, 1200, { sizeof(Envelope), 1000, 350000, 500, 450000 } },
+	};
+
+	int failures = 0;
+	for (const Case& c : cases) {
+		failures += Run(c, true);
+		failures += Run(c, false);
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+// Cost of a BinaryLog record on the calling thread, filtered out by the
+// level and written, from 1 to 8 threads. Each thread writes bursts of 32
+// records 1 ms apart, well above the rate of DirectInput calls, then the
+// file is read back to check that every record written or counted as
+// dropped is accounted for.
+//
+//   LogBench [file] [bursts]
+
+#include "BinaryLog.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	const int BURST = 32;
+
+	double RunThreads(int threads, int bursts, uint8_t level) {
+		std::vector<std::thread> workers;
+		std::vector<double> ns(threads);
+
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([t, bursts, level, &ns] {
+				BenchClock::duration busy(0);
+				for (int b = 0; b < bursts; b++) {
+					auto t0 = BenchClock::now();
+					for (int i = 0; i < BURST; i++)
+						BinaryLog::Write(level, LOG_DOWNLOAD_EFFECT, t, b, i, 0x8000);
+					busy += BenchClock::now() - t0;
+
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				ns[t] = std::chrono::duration<double, std::nano>(busy).count() / ((double)bursts * BURST);
+			});
+		}
+
+		double total = 0;
+		for (int t = 0; t < threads; t++) {
+			workers[t].join();
+			total += ns[t];
+		}
+		return total / threads;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "LogBench.vblog";
+	const int bursts = argc > 2 ? atoi(argv[2]) : 200;
+
+	remove(path);
+
+	SteadyClock clock;
+	if (!BinaryLog::Open(path, LOG_INFO, clock)) {
+		fprintf(stderr, "cannot open %s\n", path);
+		return 1;
+	}
+
+	uint64_t written = 0;
+	for (int threads = 1; threads <= 8; threads *= 2) {
+		double filteredNs = RunThreads(threads, bursts, LOG_TRACE);
+		double writeNs = RunThreads(threads, bursts, LOG_INFO);
+		written += (uint64_t)threads * bursts * BURST;
+
+		printf("threads %d  filtered %5.2f ns  written %6.2f ns  dropped %llu\n",
+			threads, filteredNs, writeNs, (unsigned long long)BinaryLog::GetDroppedCount());
+	}
+
+	BinaryLog::Close();
+
+	// Every record is in the file, or counted by a Dropped record
+	std::ifstream file(path, std::ios_base::binary);
+	uint64_t records = 0, sessions = 0, dropped = 0;
+	LogRecord record;
+	while (file.read((char*)&record, sizeof(record))) {
+		if (record.event == LOG_SESSION)
+			sessions++;
+		else if (record.event == LOG_DROPPED)
+			dropped += record.args[1];
+		else
+			records++;
+	}
+
+	bool ok = sessions == 1 && records + dropped == written && dropped == BinaryLog::GetDroppedCount();
+	printf("file records %llu + dropped %llu of %llu %s\n", (unsigned long long)records,
+		(unsigned long long)dropped, (unsigned long long)written, ok ? "ok" : "MISMATCH");
+
+	remove(path);
+	return ok ? 0 : 1;
+}
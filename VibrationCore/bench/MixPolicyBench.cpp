@@ -0,0 +1,92 @@
+// Cost per mixing tick of each MixMode with 1 to 256 playing effects,
+// constant and periodic, of mixed priorities. Also prints what each policy
+// makes of an ambient rumble overlapped by an impact.
+
+#include "EffectPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	const char* MODE_NAMES[MIX_MODE_COUNT] = { "max", "saturating sum", "weighted sum", "priority" };
+
+	EffectParams MakeEffect(int k) {
+		EffectParams params = {};
+		params.dwGain = 10000;
+		params.kind = (k & 1) ? KIND_PERIODIC : KIND_CONSTANT;
+		params.waveform = (uint8_t)(k % WAVE_COUNT);
+		params.motors = (k & 2) ? MOTOR_X : MOTOR_X | MOTOR_Y;
+		params.priority = (uint8_t)(k % 3);
+		params.lMagnitude = -9000 + (k * 37) % 10000;
+		params.dwPeriod = (20 + (k * 13) % 480) * 1000;
+		params.dwDuration = 0x40000000;
+		return params;
+	}
+
+	EffectParams MakeConstant(int32_t lMagnitude, uint8_t priority) {
+		EffectParams params = {};
+		params.dwGain = 10000;
+		params.kind = KIND_CONSTANT;
+		params.motors = MOTOR_X | MOTOR_Y;
+		params.priority = priority;
+		params.lMagnitude = lMagnitude;
+		params.dwDuration = 0x40000000;
+		return params;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int ticks = argc > 1 ? atoi(argv[1]) : 20000;
+	const int effectCounts[] = { 1, 8, 64, 256 };
+
+	for (int count : effectCounts) {
+		printf("effects %4d ", count);
+
+		for (uint8_t mode = 0; mode < MIX_MODE_COUNT; mode++) {
+			EffectPool pool;
+			pool.SetMixMode(mode);
+			for (int k = 0; k < count; k++) {
+				uint32_t dwHandle = MakeEffectHandle(k, 1);
+				pool.Download(dwHandle, MakeEffect(k));
+				pool.Start(dwHandle, 0);
+			}
+
+			unsigned checksum = 0;
+			uint64_t nextTime;
+			auto t0 = BenchClock::now();
+			for (int i = 0; i < ticks; i++) {
+				uint8_t forceX, forceY;
+				pool.Mix((uint64_t)i * EFFECT_TICK_US, forceX, forceY, nextTime);
+				checksum += forceX + forceY;
+			}
+			double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - t0).count() / ticks;
+
+			printf(" %s %8.1f ns [%02x]", MODE_NAMES[mode], ns, checksum & 0xff);
+		}
+		printf("\n");
+	}
+
+	// Ambient rumble at half strength, impact on top of it
+	for (uint8_t mode = 0; mode < MIX_MODE_COUNT; mode++) {
+		EffectPool pool;
+		pool.SetMixMode(mode);
+		pool.Download(MakeEffectHandle(0, 1), MakeConstant(0, 0));
+		pool.Download(MakeEffectHandle(1, 1), MakeConstant(-4000, 1));
+		pool.Start(MakeEffectHandle(0, 1), 0);
+		pool.Start(MakeEffectHandle(1, 1), 0);
+
+		uint8_t forceX, forceY;
+		uint64_t nextTime;
+		pool.Mix(0, forceX, forceY, nextTime);
+		printf("ambient 0x%02x + impact 0x%02x  %-14s -> 0x%02x\n",
+			ForceFromLevel(0), ForceFromLevel(-4000), MODE_NAMES[mode], forceX);
+	}
+
+	return 0;
+}
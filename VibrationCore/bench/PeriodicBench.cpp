@@ -0,0 +1,107 @@
+// Mixing throughput of many concurrent periodic effects on one port: the
+// fixed-point phase accumulators and wave tables of EffectPool against a
+// reference evaluating the waveform with sin() on every tick.
+
+#include "EffectPool.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	EffectParams MakePeriodic(int k) {
+		EffectParams params = {};
+		params.dwGain = 10000;
+		params.kind = KIND_PERIODIC;
+		params.waveform = (uint8_t)(k % WAVE_COUNT);
+		params.motors = (k & 1) ? MOTOR_X : MOTOR_Y;
+		params.lMagnitude = 2000 + (k * 37) % 8000;
+		params.lOffset = (k * 53) % 2000 - 1000;
+		params.dwPhase = (k * 4500) % 36000;
+		params.dwPeriod = (20 + (k * 13) % 480) * 1000;
+		// Infinite effects are cut after a second
+		params.dwDuration = 0x40000000;
+		return params;
+	}
+
+	// Same waveforms in double precision, recomputed from the elapsed time
+	struct FloatEffect {
+		EffectParams params;
+
+		double Level(uint64_t time) const {
+			const double PI = 3.14159265358979323846;
+			double t = fmod((double)time / params.dwPeriod + params.dwPhase / 36000.0, 1.0);
+
+			double wave;
+			switch (params.waveform) {
+			case WAVE_SQUARE: wave = t < 0.5 ? 1.0 : -1.0; break;
+			case WAVE_SINE: wave = sin(2.0 * PI * t); break;
+			case WAVE_TRIANGLE: wave = t < 0.25 ? 4.0 * t : t < 0.75 ? 2.0 - 4.0 * t : 4.0 * t - 4.0; break;
+			case WAVE_SAWTOOTH_UP: wave = 2.0 * t - 1.0; break;
+			default: wave = 1.0 - 2.0 * t; break;
+			}
+
+			return params.lOffset + params.lMagnitude * wave;
+		}
+	};
+
+	double NsPerTick(BenchClock::time_point t0, int ticks) {
+		return std::chrono::duration<double, std::nano>(BenchClock::now() - t0).count() / ticks;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int ticks = argc > 1 ? atoi(argv[1]) : 20000;
+	const int effectCounts[] = { 1, 8, 64, 256 };
+
+	for (int count : effectCounts) {
+		// Fixed point
+		EffectPool pool;
+		for (int k = 0; k < count; k++) {
+			uint32_t dwHandle = MakeEffectHandle(k, 1);
+			pool.Download(dwHandle, MakePeriodic(k));
+			pool.Start(dwHandle, 0);
+		}
+
+		unsigned checksum = 0;
+		uint64_t nextTime;
+		auto t0 = BenchClock::now();
+		for (int i = 0; i < ticks; i++) {
+			uint8_t forceX, forceY;
+			pool.Mix((uint64_t)i * EFFECT_TICK_US, forceX, forceY, nextTime);
+			checksum += forceX + forceY;
+		}
+		double fixedNs = NsPerTick(t0, ticks);
+
+		// Floating point reference
+		std::vector<FloatEffect> reference(count);
+		for (int k = 0; k < count; k++)
+			reference[k].params = MakePeriodic(k);
+
+		t0 = BenchClock::now();
+		for (int i = 0; i < ticks; i++) {
+			uint8_t forceX = 0, forceY = 0;
+			for (const FloatEffect& eff : reference) {
+				uint8_t force = ForceFromLevel((int32_t)lround(eff.Level((uint64_t)i * EFFECT_TICK_US)));
+				if (eff.params.motors & MOTOR_X)
+					forceX = force > forceX ? force : forceX;
+				else
+					forceY = force > forceY ? force : forceY;
+			}
+			checksum += forceX + forceY;
+		}
+		double floatNs = NsPerTick(t0, ticks);
+
+		printf("effects %4d  fixed ns/tick %9.1f (%6.2f/effect)  float ns/tick %9.1f (%6.2f/effect)  [%u]\n",
+			count, fixedNs, fixedNs / count, floatNs, floatNs / count, checksum & 0xff);
+	}
+
+	return 0;
+}
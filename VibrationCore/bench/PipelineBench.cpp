@@ -0,0 +1,311 @@
+// Cost of each stage of the effect pipeline, printed as JSON so that runs
+// of two releases can be diffed:
+//
+//   download  caller side of DownloadEffect for each effect type: decoding
+//             the DIEFFECT parameters and posting the command
+//   start     caller side of StartEffect
+//   mix       one mixing pass over 1 to 256 playing effects on 1 to 8
+//             ports, on a virtual clock
+//   report    building a report in SendVibrationForce / SendVibrationStop
+//             into a sink that discards it
+//
+// Each figure is the best of several runs.
+//
+//   PipelineBench [iterations]
+
+#include "Simulation.h"
+#include "Report.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	const int RUNS = 5;
+
+	// Commands posted between two untimed mixing passes, below
+	// COMMAND_QUEUE_SIZE
+	const int BATCH = 128;
+
+	class NullSink : public IReportSink
+	{
+	public:
+		NullSink() : checksum(0) {}
+		void SendReport(const uint8_t* buff, size_t /* buffsz */) override {
+			checksum += buff[0] + buff[3] + buff[4];
+		}
+		uint32_t checksum;
+	};
+
+	struct EffectCase {
+		const char* name;
+		uint32_t dwEffectType;
+		bool envelope;
+	};
+
+	const EffectCase EFFECT_CASES[] = {
+		{ "constant", EFFECT_CONSTANT, false },
+		{ "constant_envelope", EFFECT_CONSTANT, true },
+		{ "ramp", EFFECT_RAMP, false },
+		{ "square", EFFECT_SQUARE, false },
+		{ "sine", EFFECT_SINE, false },
+		{ "triangle", EFFECT_TRIANGLE, false },
+		{ "sawtooth_up", EFFECT_SAWTOOTH_UP, false },
+		{ "sawtooth_down", EFFECT_SAWTOOTH_DOWN, false },
+		{ "custom_64", EFFECT_CUSTOM, false },
+	};
+
+	// Parameters for any effect type, pointed to by desc
+	struct EffectData {
+		int32_t dir[2];
+		Envelope env;
+		ConstantForce constant;
+		RampForce ramp;
+		PeriodicForce periodic;
+		int32_t samples[64];
+		CustomForce custom;
+		EffectDesc desc;
+	};
+
+	void MakeEffect(EffectData& data, uint32_t dwEffectType, bool envelope, int k) {
+		data.dir[0] = 1;
+		data.dir[1] = (k & 1) ? -1 : 1;
+		data.env = { sizeof(Envelope), 2000, 50000, 0, 100000 };
+		data.constant.lMagnitude = -9000 + (k * 37) % 18000;
+		data.ramp = { -8000, 8000 };
+		data.periodic = { 6000u + k % 4000, 0, 0, (uint32_t)(20 + k % 480) * 1000 };
+		for (int i = 0; i < 64; i++)
+			data.samples[i] = (i * 997) % 20001 - 10000;
+		data.custom = { 1, 10000, 64, data.samples };
+
+		EffectDesc& desc = data.desc;
+		desc = {};
+		desc.dwDuration = EFFECT_INFINITE;
+		desc.dwGain = 10000;
+		desc.cAxes = 2;
+		desc.rglDirection = data.dir;
+		desc.lpEnvelope = envelope ? &data.env : NULL;
+
+		if (dwEffectType == EFFECT_CONSTANT) {
+			desc.cbTypeSpecificParams = sizeof(data.constant);
+			desc.lpvTypeSpecificParams = &data.constant;
+		}
+		else if (dwEffectType == EFFECT_RAMP) {
+			desc.dwDuration = 1000000;
+			desc.cbTypeSpecificParams = sizeof(data.ramp);
+			desc.lpvTypeSpecificParams = &data.ramp;
+		}
+		else if (dwEffectType == EFFECT_CUSTOM) {
+			desc.cbTypeSpecificParams = sizeof(data.custom);
+			desc.lpvTypeSpecificParams = &data.custom;
+		}
+		else {
+			desc.cbTypeSpecificParams = sizeof(data.periodic);
+			desc.lpvTypeSpecificParams = &data.periodic;
+		}
+	}
+
+	double NsSince(BenchClock::time_point t0) {
+		return std::chrono::duration<double, std::nano>(BenchClock::now() - t0).count();
+	}
+
+	// Update of a downloaded effect; the port applies the batch untimed
+	double DownloadNs(const EffectCase& effect, int iterations) {
+		VirtualClock clock;
+		NullSink sink;
+		VibrationPort port(0, clock, sink);
+
+		EffectData data;
+		MakeEffect(data, effect.dwEffectType, effect.envelope, 0);
+		uint32_t dwHandle = 0;
+		port.DownloadEffect(effect.dwEffectType, data.desc, dwHandle, 0);
+		port.Tick();
+
+		double best = 1e300;
+		for (int run = 0; run < RUNS; run++) {
+			double ns = 0;
+			int calls = 0;
+			for (int done = 0; done < iterations; done += BATCH) {
+				auto t0 = BenchClock::now();
+				for (int i = 0; i < BATCH; i++)
+					port.DownloadEffect(effect.dwEffectType, data.desc, dwHandle, DOWNLOAD_NORESTART);
+				ns += NsSince(t0);
+				calls += BATCH;
+				port.Tick();
+			}
+			if (ns / calls < best)
+				best = ns / calls;
+		}
+		return best;
+	}
+
+	double StartNs(int iterations) {
+		VirtualClock clock;
+		NullSink sink;
+		VibrationPort port(0, clock, sink);
+
+		EffectData data;
+		MakeEffect(data, EFFECT_CONSTANT, false, 0);
+		uint32_t dwHandle = 0;
+		port.DownloadEffect(EFFECT_CONSTANT, data.desc, dwHandle, 0);
+		port.Tick();
+
+		double best = 1e300;
+		for (int run = 0; run < RUNS; run++) {
+			double ns = 0;
+			int calls = 0;
+			for (int done = 0; done < iterations; done += BATCH) {
+				auto t0 = BenchClock::now();
+				for (int i = 0; i < BATCH; i++)
+					port.StartEffect(dwHandle);
+				ns += NsSince(t0);
+				calls += BATCH;
+				port.Tick();
+			}
+			if (ns / calls < best)
+				best = ns / calls;
+		}
+		return best;
+	}
+
+	// All ports mixed once per EFFECT_TICK_US; constant and periodic
+	// effects alternate, so the forces change and reports go out. Effects
+	// play for MIX_DURATION_US (INFINITE is cut to a second under
+	// DISABLE_INFINITE_VIBRATION) and are restarted untimed before that.
+	const uint32_t MIX_DURATION_US = 10000000;
+	const int RESTART_TICKS = 1000;
+
+	double MixNs(int portCount, int effectCount, int ticks, uint32_t& checksum) {
+		VirtualClock clock;
+		NullSink sink;
+		std::vector<std::unique_ptr<VibrationPort>> ports;
+		std::vector<std::vector<uint32_t>> handles(portCount);
+
+		for (int p = 0; p < portCount; p++) {
+			ports.emplace_back(new VibrationPort(p, clock, sink));
+			for (int k = 0; k < effectCount; k++) {
+				uint32_t dwEffectType = (k & 1) ? EFFECT_SQUARE + k % 5 : EFFECT_CONSTANT;
+				EffectData data;
+				MakeEffect(data, dwEffectType, false, k);
+				data.desc.dwDuration = MIX_DURATION_US;
+				uint32_t dwHandle = 0;
+				ports.back()->DownloadEffect(dwEffectType, data.desc, dwHandle, 0);
+				handles[p].push_back(dwHandle);
+
+				if (k % BATCH == BATCH - 1)
+					ports.back()->Tick();
+			}
+		}
+
+		auto restart = [&]() {
+			for (int p = 0; p < portCount; p++) {
+				for (size_t k = 0; k < handles[p].size(); k++) {
+					ports[p]->StartEffect(handles[p][k]);
+					if (k % BATCH == BATCH - 1)
+						ports[p]->Tick();
+				}
+				ports[p]->Tick();
+			}
+		};
+
+		double best = 1e300;
+		for (int run = 0; run < RUNS; run++) {
+			double ns = 0;
+			for (int done = 0; done < ticks; done += RESTART_TICKS) {
+				int count = ticks - done < RESTART_TICKS ? ticks - done : RESTART_TICKS;
+				restart();
+
+				auto t0 = BenchClock::now();
+				for (int i = 0; i < count; i++) {
+					clock.Advance(EFFECT_TICK_US);
+					for (auto& port : ports)
+						port->Tick();
+				}
+				ns += NsSince(t0);
+			}
+			if (ns < best)
+				best = ns;
+		}
+
+		checksum += sink.checksum;
+		return best / ticks;
+	}
+
+	double ReportNs(bool stop, int iterations, uint32_t& checksum) {
+		NullSink sink;
+
+		double best = 1e300;
+		for (int run = 0; run < RUNS; run++) {
+			auto t0 = BenchClock::now();
+			for (int i = 0; i < iterations; i++) {
+				if (stop)
+					SendVibrationStop(sink, i & 1);
+				else
+					SendVibrationForce(sink, (uint8_t)i, (uint8_t)(i >> 8), i & 1);
+			}
+			double ns = NsSince(t0);
+			if (ns < best)
+				best = ns;
+		}
+
+		checksum += sink.checksum;
+		return best / iterations;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	if (iterations < 1) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 2;
+	}
+
+	const int portCounts[] = { 1, 2, 4, 8 };
+	const int effectCounts[] = { 1, 4, 16, 64, 256 };
+	uint32_t checksum = 0;
+
+	printf("{\n");
+	printf("  \"benchmark\": \"PipelineBench\",\n");
+	printf("  \"version\": 1,\n");
+	printf("  \"iterations\": %d,\n", iterations);
+	printf("  \"unit\": \"ns\",\n");
+
+	printf("  \"download\": {\n");
+	size_t caseCount = sizeof(EFFECT_CASES) / sizeof(EFFECT_CASES[0]);
+	for (size_t c = 0; c < caseCount; c++) {
+		printf("    \"%s\": %.1f%s\n", EFFECT_CASES[c].name, DownloadNs(EFFECT_CASES[c], iterations),
+			c + 1 < caseCount ? "," : "");
+	}
+	printf("  },\n");
+
+	printf("  \"start\": %.1f,\n", StartNs(iterations));
+
+	printf("  \"mix\": [\n");
+	for (size_t p = 0; p < sizeof(portCounts) / sizeof(portCounts[0]); p++) {
+		for (size_t e = 0; e < sizeof(effectCounts) / sizeof(effectCounts[0]); e++) {
+			int ticks = iterations / (portCounts[p] * effectCounts[e]) + 100;
+			double ns = MixNs(portCounts[p], effectCounts[e], ticks, checksum);
+			bool last = p + 1 == sizeof(portCounts) / sizeof(portCounts[0]) && e + 1 == sizeof(effectCounts) / sizeof(effectCounts[0]);
+			printf("    { \"ports\": %d, \"effects\": %d, \"tick\": %.1f, \"per_port\": %.1f }%s\n",
+				portCounts[p], effectCounts[e], ns, ns / portCounts[p], last ? "" : ",");
+		}
+	}
+	printf("  ],\n");
+
+	printf("  \"report\": {\n");
+	printf("    \"SendVibrationForce\": %.2f,\n", ReportNs(false, iterations * 10, checksum));
+	printf("    \"SendVibrationStop\": %.2f\n", ReportNs(true, iterations * 10, checksum));
+	printf("  },\n");
+
+	// Keeps the work observable
+	printf("  \"checksum\": %u\n", checksum);
+	printf("}\n");
+	return 0;
+}
@@ -0,0 +1,127 @@
+// Services 2 to 64 simulated ports with a 20 ms effect every 40 ms each,
+// once with a thread per port (one OutputScheduler per port, the previous
+// model) and once with a single shared OutputScheduler.
+
+#include "VibrationPort.h"
+#include "OutputScheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	const uint32_t EFFECT_MS = 20;
+	const uint32_t PERIOD_MS = 40;
+
+	// Measures how late the stop report of each effect is
+	class LatencySink : public IReportSink
+	{
+	public:
+		LatencySink() : expectedStop(0) {}
+
+		void SendReport(const uint8_t* buff, size_t /* buffsz */) override {
+			if (buff[3] != 0 || buff[4] != 0)
+				return;
+
+			int64_t expected = expectedStop.exchange(0);
+			if (expected != 0) {
+				int64_t now = BenchClock::now().time_since_epoch().count();
+				lateness.push_back(std::chrono::duration<double, std::micro>(BenchClock::duration(now - expected)).count());
+			}
+		}
+
+		std::atomic<int64_t> expectedStop;
+		std::vector<double> lateness;
+	};
+
+	double Percentile(std::vector<double>& v, double p) {
+		if (v.empty())
+			return 0.0;
+		std::sort(v.begin(), v.end());
+		return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+	}
+
+	void Run(const char* name, int portCount, bool shared, int runMs) {
+		SteadyClock clock;
+		std::vector<std::unique_ptr<LatencySink>> sinks;
+		std::vector<std::unique_ptr<VibrationPort>> ports;
+		std::vector<std::unique_ptr<OutputScheduler>> schedulers;
+
+		for (int p = 0; p < portCount; p++) {
+			sinks.emplace_back(new LatencySink());
+			ports.emplace_back(new VibrationPort(p, clock, *sinks.back()));
+
+			if (p == 0 || !shared)
+				schedulers.emplace_back(new OutputScheduler(clock));
+			schedulers.back()->AddPort(*ports.back());
+		}
+
+		int32_t dir[2] = { 1, 1 };
+		ConstantForce cf = { 10000 };
+		EffectDesc eff = {};
+		eff.dwDuration = EFFECT_MS * 1000;
+		eff.dwGain = 10000;
+		eff.cAxes = 2;
+		eff.rglDirection = dir;
+		eff.cbTypeSpecificParams = sizeof(cf);
+		eff.lpvTypeSpecificParams = &cf;
+
+		std::clock_t cpu0 = std::clock();
+		auto t0 = BenchClock::now();
+		auto end = t0 + std::chrono::milliseconds(runMs);
+
+		std::vector<uint32_t> handles(portCount, 0);
+
+		// Ports are staggered over the period
+		for (uint64_t tick = 0; BenchClock::now() < end; tick++) {
+			auto slotTime = t0 + std::chrono::microseconds(tick * PERIOD_MS * 1000 / portCount);
+			std::this_thread::sleep_until(slotTime);
+
+			int p = (int)(tick % portCount);
+			auto now = BenchClock::now();
+			sinks[p]->expectedStop = (now + std::chrono::milliseconds(EFFECT_MS)).time_since_epoch().count();
+			ports[p]->DownloadEffect(0, eff, handles[p], DOWNLOAD_START);
+		}
+
+		double elapsed = std::chrono::duration<double>(BenchClock::now() - t0).count();
+		double cpuMs = (std::clock() - cpu0) * 1000.0 / CLOCKS_PER_SEC;
+
+		uint64_t wakeups = 0;
+		for (auto& s : schedulers)
+			wakeups += s->GetWakeupCount();
+
+		for (int p = 0; p < portCount; p++) {
+			OutputScheduler& scheduler = *schedulers[shared ? 0 : p];
+			scheduler.RemovePort(*ports[p]);
+		}
+
+		std::vector<double> lateness;
+		for (auto& s : sinks)
+			lateness.insert(lateness.end(), s->lateness.begin(), s->lateness.end());
+
+		printf("%-8s ports %3d  threads %3d  wakeups/s %8.0f  cpu ms/s %7.2f  stop late us p50 %8.1f p99 %8.1f\n",
+			name, portCount, (int)schedulers.size(), wakeups / elapsed, cpuMs / elapsed,
+			Percentile(lateness, 0.5), Percentile(lateness, 0.99));
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int runMs = argc > 1 ? atoi(argv[1]) : 1000;
+	const int portCounts[] = { 2, 4, 8, 16, 32, 64 };
+
+	for (int portCount : portCounts) {
+		Run("per-port", portCount, false, runMs);
+		Run("shared", portCount, true, runMs);
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+// Ramp force mixing: cost per tick of the incremental Q32 steppers of
+// EffectPool against a reference interpolating in double precision, the
+// heap allocations made while ticking (global operator new is counted),
+// and the largest deviation of the stepped ramp from the exact line.
+
+#include "Simulation.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations++;
+	if (void* p = malloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+namespace {
+
+	class NullSink : public IReportSink
+	{
+	public:
+		void SendReport(const uint8_t* /* buff */, size_t /* buffsz */) override {}
+	};
+
+	EffectParams MakeRamp(int k, uint32_t duration) {
+		EffectParams params = {};
+		params.dwGain = 10000;
+		params.kind = KIND_RAMP;
+		params.motors = (k & 1) ? MOTOR_X : MOTOR_Y;
+		params.lRampStart = -10000 + (k * 71) % 20000;
+		params.lRampEnd = 10000 - (k * 113) % 20000;
+		params.lMagnitude = 10000;
+		params.dwDuration = duration;
+		return params;
+	}
+
+	double Exact(const EffectParams& params, uint64_t elapsed) {
+		return params.lRampStart + (double)(params.lRampEnd - params.lRampStart) * elapsed / params.dwDuration;
+	}
+
+	double NsPerTick(BenchClock::time_point t0, int ticks) {
+		return std::chrono::duration<double, std::nano>(BenchClock::now() - t0).count() / ticks;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int ticks = argc > 1 ? atoi(argv[1]) : 20000;
+	const uint32_t duration = ticks * EFFECT_TICK_US + 1000000;
+	const int effectCounts[] = { 1, 16, 64, 256 };
+
+	for (int count : effectCounts) {
+		EffectPool pool;
+		for (int k = 0; k < count; k++) {
+			uint32_t dwHandle = MakeEffectHandle(k, 1);
+			pool.Download(dwHandle, MakeRamp(k, duration));
+			pool.Start(dwHandle, 0);
+		}
+
+		// Effect 0 alone drives the Y motor for odd counts, so the mixed
+		// force of a single ramp is checked against the exact line
+		int maxError = 0;
+		unsigned checksum = 0;
+		uint64_t nextTime;
+		uint64_t allocs0 = allocations;
+		auto t0 = BenchClock::now();
+		for (int i = 0; i < ticks; i++) {
+			uint8_t forceX, forceY;
+			uint64_t time = (uint64_t)i * EFFECT_TICK_US;
+			pool.Mix(time, forceX, forceY, nextTime);
+			checksum += forceX + forceY;
+
+			if (count == 1) {
+				int error = abs((int)forceY - ForceFromLevel((int32_t)lround(Exact(MakeRamp(0, duration), time))));
+				maxError = error > maxError ? error : maxError;
+			}
+		}
+		double fixedNs = NsPerTick(t0, ticks);
+		uint64_t fixedAllocs = allocations - allocs0;
+
+		std::vector<EffectParams> reference;
+		for (int k = 0; k < count; k++)
+			reference.push_back(MakeRamp(k, duration));
+
+		t0 = BenchClock::now();
+		for (int i = 0; i < ticks; i++) {
+			uint8_t forceX = 0, forceY = 0;
+			for (const EffectParams& params : reference) {
+				uint8_t force = ForceFromLevel((int32_t)lround(Exact(params, (uint64_t)i * EFFECT_TICK_US)));
+				if (params.motors & MOTOR_X)
+					forceX = force > forceX ? force : forceX;
+				else
+					forceY = force > forceY ? force : forceY;
+			}
+			checksum += forceX + forceY;
+		}
+		double floatNs = NsPerTick(t0, ticks);
+
+		printf("ramps %4d  fixed ns/tick %8.1f (%5.2f/effect) allocs %llu  float ns/tick %8.1f (%5.2f/effect)",
+			count, fixedNs, fixedNs / count, (unsigned long long)fixedAllocs, floatNs, floatNs / count);
+		if (count == 1)
+			printf("  max error %d", maxError);
+		printf("  [%u]\n", checksum & 0xff);
+	}
+
+	// Whole port pass: command ring, pool, dedup and report
+	VirtualClock clock;
+	NullSink sink;
+	VibrationPort port(0, clock, sink);
+
+	int32_t dir[2] = { 1, 1 };
+	std::vector<uint32_t> handles(64, 0);
+	for (size_t k = 0; k < handles.size(); k++) {
+		RampForce rf = { -10000 + (int32_t)k * 100, 10000 - (int32_t)k * 100 };
+		EffectDesc eff = {};
+		eff.dwDuration = duration;
+		eff.dwGain = 10000;
+		eff.cAxes = 2;
+		eff.rglDirection = dir;
+		eff.cbTypeSpecificParams = sizeof(rf);
+		eff.lpvTypeSpecificParams = &rf;
+		port.DownloadEffect(EFFECT_RAMP, eff, handles[k], DOWNLOAD_START);
+	}
+	port.Tick();
+
+	uint64_t allocs0 = allocations;
+	auto t0 = BenchClock::now();
+	for (int i = 1; i < ticks; i++) {
+		clock.Set((uint64_t)i * EFFECT_TICK_US);
+		port.Tick();
+	}
+	printf("port  64 ramps  ns/tick %8.1f  allocs %llu  reports %llu\n",
+		NsPerTick(t0, ticks - 1), (unsigned long long)(allocations - allocs0),
+		(unsigned long long)port.GetStats().reportsSent);
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+// Compares the deadline-driven output thread of VibrationPort with the old
+// fixed 10 ms polling loop: wakeups of an idle port and start/stop edge
+// latency of short effects. Then stops effects before their end, which
+// moves the deadline of the port, and counts the wakeups on the old
+// deadlines.
+
+#include "VibrationPort.h"
+#include "OutputScheduler.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	// Records when each report reaches the "device"
+	class TimestampSink : public IReportSink
+	{
+	public:
+		void SendReport(const uint8_t* buff, size_t /* buffsz */) override {
+			std::lock_guard<std::mutex> lock(mtx);
+			bool on = buff[3] != 0 || buff[4] != 0;
+			(on ? startTimes : stopTimes).push_back(BenchClock::now());
+			cv.notify_all();
+		}
+
+		bool WaitFor(std::vector<BenchClock::time_point>& v, size_t n) {
+			std::unique_lock<std::mutex> lock(mtx);
+			return cv.wait_for(lock, std::chrono::seconds(2), [&] { return v.size() >= n; });
+		}
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::vector<BenchClock::time_point> startTimes;
+		std::vector<BenchClock::time_point> stopTimes;
+	};
+
+	// Reproduces the previous VibrationThreadEntryPoint loop
+	class PollingRunner
+	{
+	public:
+		PollingRunner(VibrationPort& port) : port(port), quit(false), wakeups(0) {
+			thr = std::thread([this] {
+				while (!quit) {
+					wakeups++;
+					this->port.Tick();
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+			});
+		}
+		~PollingRunner() {
+			quit = true;
+			thr.join();
+		}
+
+		VibrationPort& port;
+		std::atomic<bool> quit;
+		std::atomic<uint64_t> wakeups;
+		std::thread thr;
+	};
+
+	double Micros(BenchClock::duration d) {
+		return std::chrono::duration<double, std::micro>(d).count();
+	}
+
+	struct Result {
+		uint64_t idleWakeups;
+		std::vector<double> startLatency;
+		std::vector<double> stopLatency;
+	};
+
+	void RunEdges(VibrationPort& port, TimestampSink& sink, int iterations, uint32_t durationMs, Result& res) {
+		int32_t dir[2] = { 1, 1 };
+		ConstantForce cf = { 10000 };
+		EffectDesc eff = {};
+		eff.dwDuration = durationMs * 1000;
+		eff.dwGain = 10000;
+		eff.cAxes = 2;
+		eff.rglDirection = dir;
+		eff.cbTypeSpecificParams = sizeof(cf);
+		eff.lpvTypeSpecificParams = &cf;
+
+		uint32_t dwHandle = 0;
+		for (int i = 0; i < iterations; i++) {
+			auto t0 = BenchClock::now();
+			port.DownloadEffect(0, eff, dwHandle, DOWNLOAD_START);
+
+			if (!sink.WaitFor(sink.startTimes, i + 1) || !sink.WaitFor(sink.stopTimes, i + 1))
+				break;
+
+			std::lock_guard<std::mutex> lock(sink.mtx);
+			res.startLatency.push_back(Micros(sink.startTimes[i] - t0));
+			res.stopLatency.push_back(Micros(sink.stopTimes[i] - (t0 + std::chrono::milliseconds(durationMs))));
+		}
+	}
+
+	double Percentile(std::vector<double> v, double p) {
+		if (v.empty())
+			return 0.0;
+		std::sort(v.begin(), v.end());
+		return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+	}
+
+	void Print(const char* name, const Result& res, int idleMs) {
+		printf("%-9s idle wakeups/s: %6.1f  start edge us p50 %8.1f max %8.1f  stop edge us p50 %8.1f max %8.1f\n",
+			name, res.idleWakeups * 1000.0 / idleMs,
+			Percentile(res.startLatency, 0.5), Percentile(res.startLatency, 1.0),
+			Percentile(res.stopLatency, 0.5), Percentile(res.stopLatency, 1.0));
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int idleMs = 1000;
+	const int iterations = argc > 1 ? atoi(argv[1]) : 50;
+	const uint32_t durationMs = 20;
+
+	SteadyClock clock;
+
+	{
+		TimestampSink sink;
+		VibrationPort port(0, clock, sink);
+		Result res;
+
+		PollingRunner runner(port);
+		std::this_thread::sleep_for(std::chrono::milliseconds(idleMs));
+		res.idleWakeups = runner.wakeups;
+
+		RunEdges(port, sink, iterations, durationMs, res);
+		Print("polling", res, idleMs);
+	}
+
+	{
+		TimestampSink sink;
+		VibrationPort port(0, clock, sink);
+		OutputScheduler scheduler(clock);
+		Result res;
+
+		scheduler.AddPort(port);
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		uint64_t before = scheduler.GetWakeupCount();
+		std::this_thread::sleep_for(std::chrono::milliseconds(idleMs));
+		res.idleWakeups = scheduler.GetWakeupCount() - before;
+
+		RunEdges(port, sink, iterations, durationMs, res);
+		Print("deadline", res, idleMs);
+
+		// Each stop leaves the timer of the effect end queued
+		int32_t dir[2] = { 1, 1 };
+		ConstantForce cf = { 10000 };
+		EffectDesc eff = {};
+		eff.dwDuration = 50000;
+		eff.dwGain = 10000;
+		eff.cAxes = 2;
+		eff.rglDirection = dir;
+		eff.cbTypeSpecificParams = sizeof(cf);
+		eff.lpvTypeSpecificParams = &cf;
+
+		uint64_t stale = scheduler.GetStaleWakeupCount();
+		before = scheduler.GetWakeupCount();
+		uint32_t dwHandle = 0;
+		for (int i = 0; i < iterations; i++) {
+			port.DownloadEffect(0, eff, dwHandle, DOWNLOAD_START);
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			port.StopAllEffects();
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		printf("%-9s %d early stops: %llu wakeups, %llu on old deadlines\n", "deadline", iterations,
+			(unsigned long long)(scheduler.GetWakeupCount() - before),
+			(unsigned long long)(scheduler.GetStaleWakeupCount() - stale));
+
+		scheduler.RemovePort(port);
+	}
+
+	return 0;
+}
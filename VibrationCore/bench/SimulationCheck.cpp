@@ -0,0 +1,497 @@
+// Plays scripted effect traffic through Simulation, on a virtual clock,
+// and checks every report the fake device receives, byte for byte and to
+// the microsecond: start delays and durations, INFINITE effects with or
+// without DISABLE_INFINITE_VIBRATION, repeated plays, stop-all, reset and
+// invalid handles, call-to-mix telemetry, and hours of random constant
+// effects on two ports against a model of the mixer. Exits with 1 on a
+// mismatch.
+//
+//   SimulationCheck [hours] [seed]
+
+#include "Simulation.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace vibration;
+
+namespace {
+
+	const uint64_t ORIGIN = 5000000000ull;
+
+	// Effects the soak keeps downloaded on each port
+	const int SLOTS = 8;
+
+	struct Expected {
+		uint64_t time;
+		uint8_t forceX;
+		uint8_t forceY;
+	};
+
+	int failures = 0;
+
+	bool Check(bool ok, const char* what) {
+		if (!ok) {
+			printf("FAIL %s\n", what);
+			failures++;
+		}
+		return ok;
+	}
+
+	// Same reports, each {port + 1, 0x01, 0x00, big motor, small motor}
+	bool CheckReports(const char* what, const std::vector<SimReport>& reports, uint32_t dwPort,
+		const std::vector<Expected>& expected)
+	{
+		for (size_t k = 0; k < reports.size() || k < expected.size(); k++) {
+			if (k >= reports.size() || k >= expected.size()) {
+				printf("FAIL %s: %zu reports, expected %zu\n", what, reports.size(), expected.size());
+				failures++;
+				return false;
+			}
+
+			const SimReport& r = reports[k];
+			const Expected& e = expected[k];
+			if (r.time != e.time || r.data[0] != dwPort + 1 || r.data[1] != 0x01 || r.data[2] != 0x00
+				|| r.GetForceX() != e.forceX || r.GetForceY() != e.forceY) {
+				printf("FAIL %s: report %zu is %02x %02x %02x %02x %02x at %llu us, expected %02x %02x at %llu us\n",
+					what, k, r.data[0], r.data[1], r.data[2], r.data[3], r.data[4],
+					(unsigned long long)(r.time - ORIGIN), e.forceY, e.forceX, (unsigned long long)(e.time - ORIGIN));
+				failures++;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Constant(VibrationPort& port, int32_t lMagnitude, uint32_t dwStartDelay, uint32_t dwDuration, uint32_t& dwHandle,
+		const int32_t* dir = NULL)
+	{
+		static const int32_t both[2] = { 1, 1 };
+		ConstantForce cf = { lMagnitude };
+		EffectDesc eff = {};
+		eff.dwDuration = dwDuration;
+		eff.dwGain = 10000;
+		eff.dwStartDelay = dwStartDelay;
+		eff.cAxes = 2;
+		eff.rglDirection = dir != NULL ? dir : both;
+		eff.cbTypeSpecificParams = sizeof(cf);
+		eff.lpvTypeSpecificParams = &cf;
+		return port.DownloadEffect(EFFECT_CONSTANT, eff, dwHandle, DOWNLOAD_START);
+	}
+
+	void StartDelayAndDuration() {
+		Simulation sim(ORIGIN);
+		VibrationPort& port = sim.AddPort(1);
+
+		uint32_t strong = 0, weak = 0;
+		Constant(port, 10000, 250000, 1500000, strong);
+		Constant(port, 0, 0, 1000000, weak);
+		sim.Sync();
+		sim.Advance(10000000);
+
+		uint8_t half = ForceFromLevel(0);
+		CheckReports("start delay and duration", sim.GetReports(0), 1, {
+			{ ORIGIN, half, half },
+			{ ORIGIN + 250000, FORCE_MAX, FORCE_MAX },
+			{ ORIGIN + 1750000, 0, 0 },
+		});
+	}
+
+	void Infinite() {
+		Simulation sim(ORIGIN);
+		VibrationPort& port = sim.AddPort(0);
+
+		// Started after its delay, the limit counts from there
+		uint32_t dwHandle = 0;
+		Constant(port, 10000, 300000, EFFECT_INFINITE, dwHandle);
+		sim.Sync();
+		sim.Advance(3600ull * 1000000);
+
+		if (EffectPool::IsInfiniteLimited()) {
+			CheckReports("infinite", sim.GetReports(0), 0, {
+				{ ORIGIN + 300000, FORCE_MAX, FORCE_MAX },
+				{ ORIGIN + 300000 + INFINITE_VIBRATION_US, 0, 0 },
+			});
+		}
+		else {
+			CheckReports("infinite", sim.GetReports(0), 0, {
+				{ ORIGIN + 300000, FORCE_MAX, FORCE_MAX },
+			});
+		}
+
+		// Downloading it again restarts the limit
+		sim.ClearReports();
+		uint64_t restart = sim.Now();
+		Constant(port, -5000, 0, EFFECT_INFINITE, dwHandle);
+		sim.Sync();
+		sim.Advance(INFINITE_VIBRATION_US / 2);
+		Constant(port, 5000, 0, EFFECT_INFINITE, dwHandle);
+		sim.Sync();
+		sim.Advance(3600ull * 1000000);
+
+		uint8_t low = ForceFromLevel(-5000), high = ForceFromLevel(5000);
+		if (EffectPool::IsInfiniteLimited()) {
+			CheckReports("infinite restarted", sim.GetReports(0), 0, {
+				{ restart, low, low },
+				{ restart + INFINITE_VIBRATION_US / 2, high, high },
+				{ restart + INFINITE_VIBRATION_US / 2 + INFINITE_VIBRATION_US, 0, 0 },
+			});
+		}
+		else {
+			CheckReports("infinite restarted", sim.GetReports(0), 0, {
+				{ restart, low, low },
+				{ restart + INFINITE_VIBRATION_US / 2, high, high },
+			});
+		}
+	}
+
+	// Each play waits for the start delay again, as with ff-memless
+	void Iterations() {
+		Simulation sim(ORIGIN);
+		VibrationPort& port = sim.AddPort(0);
+
+		static const int32_t both[2] = { 1, 1 };
+		ConstantForce cf = { 10000 };
+		EffectDesc delayed = {};
+		delayed.dwDuration = 100000;
+		delayed.dwGain = 10000;
+		delayed.dwStartDelay = 50000;
+		delayed.cAxes = 2;
+		delayed.rglDirection = both;
+		delayed.cbTypeSpecificParams = sizeof(cf);
+		delayed.lpvTypeSpecificParams = &cf;
+		uint32_t dwHandle = 0;
+		port.DownloadEffect(EFFECT_CONSTANT, delayed, dwHandle, 0);
+		port.StartEffect(dwHandle, 0, 3);
+		sim.Sync();
+		sim.Advance(2000000);
+
+		CheckReports("iterations", sim.GetReports(0), 0, {
+			{ ORIGIN + 50000, FORCE_MAX, FORCE_MAX },
+			{ ORIGIN + 150000, 0, 0 },
+			{ ORIGIN + 200000, FORCE_MAX, FORCE_MAX },
+			{ ORIGIN + 300000, 0, 0 },
+			{ ORIGIN + 350000, FORCE_MAX, FORCE_MAX },
+			{ ORIGIN + 450000, 0, 0 },
+		});
+
+		// Without a delay the plays follow each other, until stopped
+		sim.ClearReports();
+		uint64_t start = sim.Now();
+		EffectDesc immediate = {};
+		immediate.dwDuration = 100000;
+		immediate.dwGain = 10000;
+		immediate.cAxes = 2;
+		immediate.rglDirection = both;
+		immediate.cbTypeSpecificParams = sizeof(cf);
+		immediate.lpvTypeSpecificParams = &cf;
+		port.DownloadEffect(EFFECT_CONSTANT, immediate, dwHandle, 0);
+		port.StartEffect(dwHandle, 0, EFFECT_INFINITE);
+		sim.Sync();
+		sim.Advance(1050000);
+		port.StopEffect(dwHandle);
+		sim.Sync();
+		sim.Advance(1000000);
+
+		CheckReports("infinite iterations", sim.GetReports(0), 0, {
+			{ start, FORCE_MAX, FORCE_MAX },
+			{ start + 1050000, 0, 0 },
+		});
+	}
+
+	void StopAll() {
+		Simulation sim(ORIGIN);
+		VibrationPort& port = sim.AddPort(0);
+		VibrationPort& other = sim.AddPort(1);
+
+		int32_t dir[2] = { 1, -1 };
+		uint32_t handles[4] = {};
+		Constant(port, 8000, 0, 10000000, handles[0], dir);
+		Constant(port, 2000, 100000, 10000000, handles[1]);
+		PeriodicForce pf = { 10000, 0, 0, 50000 };
+		int32_t both[2] = { 1, 1 };
+		EffectDesc sine = {};
+		sine.dwDuration = 10000000;
+		sine.dwGain = 10000;
+		sine.dwStartDelay = 200000;
+		sine.cAxes = 2;
+		sine.rglDirection = both;
+		sine.cbTypeSpecificParams = sizeof(pf);
+		sine.lpvTypeSpecificParams = &pf;
+		port.DownloadEffect(EFFECT_SINE, sine, handles[2], DOWNLOAD_START);
+		Constant(other, 10000, 0, 600000, handles[3]);
+		sim.Sync();
+
+		sim.Advance(400000);
+		size_t before = sim.GetReports(0).size();
+		port.StopAllEffects();
+		sim.Sync();
+		sim.Advance(20000000);
+
+		const std::vector<SimReport>& reports = sim.GetReports(0);
+		uint8_t strong = ForceFromLevel(8000), weak = ForceFromLevel(2000);
+		Check(reports.size() > 3 && reports[0].time == ORIGIN && reports[0].GetForceX() == strong
+			&& reports[0].GetForceY() == 0, "stop all: first effect");
+		Check(reports.size() > 3 && reports[1].time == ORIGIN + 100000 && reports[1].GetForceX() == strong
+			&& reports[1].GetForceY() == weak, "stop all: second effect");
+		// The sine starts at its zero level, below the second effect, and
+		// shows from the next mixing tick
+		Check(reports.size() > 3 && reports[2].time == ORIGIN + 200000 + EFFECT_TICK_US
+			&& reports[2].GetForceY() > weak, "stop all: periodic effect");
+		Check(reports.size() == before + 1 && reports.back().time == ORIGIN + 400000
+			&& reports.back().GetForceX() == 0 && reports.back().GetForceY() == 0, "stop all: stop report");
+
+		// The other port is not affected
+		CheckReports("stop all: other port", sim.GetReports(1), 1, {
+			{ ORIGIN, FORCE_MAX, FORCE_MAX },
+			{ ORIGIN + 600000, 0, 0 },
+		});
+
+		// Every command is stamped with its call time, so the calls applied
+		// by the next pass add no call-to-mix latency
+		port.SetActuators(true);
+		port.Reset();
+		sim.Sync();
+		std::unique_ptr<PortTelemetry> telemetry(new PortTelemetry());
+		port.GetTelemetry(*telemetry);
+		Check(LatencyHistogram::Percentile(telemetry->callToMix, 0.99) < 1000, "stop all: call to mix latency");
+	}
+
+	void ResetAndHandles() {
+		Simulation sim(ORIGIN);
+		VibrationPort& port = sim.AddPort(0);
+
+		uint32_t before = 0;
+		Constant(port, 10000, 0, 10000000, before);
+		sim.Sync();
+
+		// DISFFC_RESET then downloads, before the output thread ran
+		port.Reset();
+		Check(!port.IsEffectHandle(before), "reset: old handle released");
+		uint32_t after = 0;
+		Check(Constant(port, 0, 0, 1000000, after) && port.IsEffectHandle(after), "reset: download after reset");
+		sim.Sync();
+		Check(port.IsEffectHandle(after), "reset: new handle kept");
+		sim.Advance(2000000);
+
+		uint8_t half = ForceFromLevel(0);
+		CheckReports("reset", sim.GetReports(0), 0, {
+			{ ORIGIN, FORCE_MAX, FORCE_MAX },
+			{ ORIGIN, half, half },
+			{ ORIGIN + 1000000, 0, 0 },
+		});
+
+		// Handles that were never allocated are refused, not indexed
+		uint32_t malformed = 0xFFFF0000;
+		Check(!port.StartEffect(0) && !port.StopEffect(0) && !port.DestroyEffect(0)
+			&& !port.StartEffect(malformed) && !port.DestroyEffect(MakeEffectHandle(EFFECT_POOL_SIZE, 1))
+			&& !Constant(port, 10000, 0, 1000, malformed), "handles: invalid handles refused");
+		Check(!port.StopEffect(before) && !port.DestroyEffect(before), "handles: stale handle refused");
+
+		// Sizes and counts given with a NULL pointer
+		static const int32_t both[2] = { 1, 1 };
+		EffectDesc eff = {};
+		eff.dwDuration = 1000;
+		eff.dwGain = 10000;
+		eff.cAxes = 2;
+		eff.rglDirection = both;
+		eff.cbTypeSpecificParams = sizeof(ConstantForce);
+		uint32_t dwHandle = 0;
+		Check(!port.DownloadEffect(EFFECT_CONSTANT, eff, dwHandle, DOWNLOAD_START) && dwHandle == 0,
+			"handles: NULL parameters refused");
+		ConstantForce cf = { 10000 };
+		eff.lpvTypeSpecificParams = &cf;
+		eff.rglDirection = NULL;
+		Check(!port.DownloadEffect(EFFECT_CONSTANT, eff, dwHandle, DOWNLOAD_START) && dwHandle == 0,
+			"handles: NULL directions refused");
+	}
+
+	// Constant effects as the mixer should play them, in MIX_MAX
+	struct ModelEffect {
+		uint32_t dwHandle;
+		int32_t lMagnitude;
+		int dir;
+		uint32_t dwStartDelay;
+		uint32_t dwDuration;
+
+		bool playing;
+		uint64_t start;
+		uint64_t stop;
+		bool hasStop;
+	};
+
+	const int32_t DIRECTIONS[3][2] = { { 1, 1 }, { 1, -1 }, { -1, 1 } };
+
+	class ModelPort
+	{
+	public:
+		ModelPort() : effects(), lastTime(0), forceX(0), forceY(0) {}
+
+		// Edges of the effects up to time, then the call made at time
+		void Call(uint64_t time) {
+			Settle(time);
+			lastTime = time;
+		}
+
+		void Start(ModelEffect& eff, uint64_t time) {
+			eff.playing = true;
+			eff.start = time + eff.dwStartDelay;
+			eff.hasStop = eff.dwDuration != EFFECT_INFINITE || EffectPool::IsInfiniteLimited();
+			eff.stop = eff.start + (eff.dwDuration != EFFECT_INFINITE ? eff.dwDuration : INFINITE_VIBRATION_US);
+		}
+
+		void StopAll() {
+			for (ModelEffect& eff : effects)
+				eff.playing = false;
+		}
+
+		// Report of the mixing pass run after the call
+		void Mix() {
+			Emit(lastTime);
+		}
+
+		void Settle(uint64_t time) {
+			while (true) {
+				bool found = false;
+				uint64_t next = 0;
+				for (ModelEffect& eff : effects) {
+					if (!eff.playing)
+						continue;
+					if (eff.start > lastTime && eff.start <= time && (!found || eff.start < next)) {
+						next = eff.start;
+						found = true;
+					}
+					if (eff.hasStop && eff.stop > lastTime && eff.stop <= time && (!found || eff.stop < next)) {
+						next = eff.stop;
+						found = true;
+					}
+				}
+				if (!found)
+					break;
+
+				lastTime = next;
+				Emit(next);
+			}
+		}
+
+		ModelEffect effects[SLOTS];
+		std::vector<Expected> expected;
+
+	private:
+		void Emit(uint64_t time) {
+			uint8_t x = 0, y = 0;
+			for (ModelEffect& eff : effects) {
+				if (!eff.playing || time < eff.start || (eff.hasStop && time >= eff.stop))
+					continue;
+
+				uint8_t force = ForceFromLevel(eff.lMagnitude);
+				if (DIRECTIONS[eff.dir][0] > 0 && force > x)
+					x = force;
+				if (DIRECTIONS[eff.dir][1] > 0 && force > y)
+					y = force;
+			}
+
+			if (x != forceX || y != forceY)
+				expected.push_back({ time, x, y });
+			forceX = x;
+			forceY = y;
+		}
+
+		uint64_t lastTime;
+		uint8_t forceX;
+		uint8_t forceY;
+	};
+
+	void Soak(uint32_t hours, uint32_t seed) {
+		const uint32_t PORTS = 2;
+
+		Simulation sim(ORIGIN);
+		ModelPort models[PORTS];
+		for (uint32_t p = 0; p < PORTS; p++)
+			sim.AddPort(p);
+
+		std::mt19937 rng(seed);
+		uint64_t end = ORIGIN + hours * 3600ull * 1000000;
+		uint64_t calls = 0;
+
+		auto t0 = std::chrono::steady_clock::now();
+		while (sim.Now() < end) {
+			sim.Advance(1 + rng() % 400000);
+
+			uint32_t p = rng() % PORTS;
+			VibrationPort& port = sim.GetPort(p);
+			ModelPort& model = models[p];
+			model.Call(sim.Now());
+
+			ModelEffect& eff = model.effects[rng() % SLOTS];
+			uint32_t op = rng() % 100;
+
+			if (op < 70) {
+				// Download, or update and restart
+				eff.lMagnitude = (int32_t)(rng() % 41) * 500 - 10000;
+				eff.dir = rng() % 3;
+				eff.dwStartDelay = rng() % 4 == 0 ? (uint32_t)(rng() % 200000) : 0;
+				eff.dwDuration = rng() % 10 == 0 ? EFFECT_INFINITE : 10000 + (uint32_t)(rng() % 2000000);
+				Check(Constant(port, eff.lMagnitude, eff.dwStartDelay, eff.dwDuration, eff.dwHandle,
+					DIRECTIONS[eff.dir]), "soak download");
+				model.Start(eff, sim.Now());
+			}
+			else if (op < 85) {
+				if (eff.dwHandle != 0) {
+					port.StartEffect(eff.dwHandle);
+					model.Start(eff, sim.Now());
+				}
+			}
+			else if (op < 98) {
+				if (eff.dwHandle != 0) {
+					port.StopEffect(eff.dwHandle);
+					eff.playing = false;
+				}
+			}
+			else {
+				port.StopAllEffects();
+				model.StopAll();
+			}
+
+			sim.Sync();
+			model.Mix();
+			calls++;
+		}
+
+		// Lets the last effects play out
+		sim.Advance(2 * INFINITE_VIBRATION_US + 2000000);
+		for (uint32_t p = 0; p < PORTS; p++)
+			models[p].Settle(sim.Now());
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+		size_t reports = 0;
+		for (uint32_t p = 0; p < PORTS; p++) {
+			CheckReports(p == 0 ? "soak port 0" : "soak port 1", sim.GetReports(p), p, models[p].expected);
+			reports += sim.GetReports(p).size();
+		}
+
+		printf("soak: %u h on %u ports, %llu calls, %zu reports, %llu mixing passes in %.0f ms\n", hours, PORTS,
+			(unsigned long long)calls, reports, (unsigned long long)sim.GetPassCount(), ms);
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t hours = argc > 1 ? (uint32_t)atoi(argv[1]) : 4;
+	uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 1;
+
+	StartDelayAndDuration();
+	Infinite();
+	Iterations();
+	StopAll();
+	ResetAndHandles();
+	Soak(hours, seed);
+
+	printf("%s\n", failures == 0 ? "ok" : "FAILED");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+// Cost of the port instrumentation against the mixing pass it is part of,
+// then the telemetry of a live port: a caller thread changes a constant
+// effect every 2 ms on a port behind a fake endpoint taking 1 ms per write,
+// serviced by the OutputScheduler. Prints what ESCAPE_GET_TELEMETRY returns.
+
+#include "VibrationPort.h"
+#include "DeviceRegistry.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+using namespace vibration;
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+	class NullSink : public IReportSink
+	{
+	public:
+		void SendReport(const uint8_t* /* buff */, size_t /* buffsz */) override {}
+	};
+
+	// Completes each write from its own thread after writeTime
+	class FakeTransport : public IReportTransport
+	{
+	public:
+		FakeTransport(BenchClock::duration writeTime) : writeTime(writeTime), quit(false), completion(NULL) {
+			worker = std::thread([this] {
+				std::unique_lock<std::mutex> lock(mtx);
+				while (true) {
+					cv.wait(lock, [this] { return quit || completion != NULL; });
+					if (completion == NULL)
+						break;
+
+					IWriteCompletion* done = completion;
+					completion = NULL;
+					lock.unlock();
+
+					std::this_thread::sleep_for(this->writeTime);
+					done->OnWriteComplete(true);
+
+					lock.lock();
+				}
+			});
+		}
+		~FakeTransport() {
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				quit = true;
+			}
+			cv.notify_one();
+			worker.join();
+		}
+
+		bool BeginWrite(const uint8_t* /* buff */, size_t /* buffsz */, IWriteCompletion& done) override {
+			std::lock_guard<std::mutex> lock(mtx);
+			completion = &done;
+			cv.notify_one();
+			return true;
+		}
+
+	private:
+		BenchClock::duration writeTime;
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool quit;
+		IWriteCompletion* completion;
+		std::thread worker;
+	};
+
+	double NsPer(BenchClock::time_point t0, int count) {
+		return std::chrono::duration<double, std::nano>(BenchClock::now() - t0).count() / count;
+	}
+
+	void PrintHistogram(const char* name, const uint64_t* counts) {
+		uint64_t total = 0;
+		for (uint32_t k = 0; k < HISTOGRAM_BUCKETS; k++)
+			total += counts[k];
+
+		printf("  %-15s n %7llu  p50 %7llu us  p99 %7llu us  p999 %7llu us\n", name, (unsigned long long)total,
+			(unsigned long long)LatencyHistogram::Percentile(counts, 0.5),
+			(unsigned long long)LatencyHistogram::Percentile(counts, 0.99),
+			(unsigned long long)LatencyHistogram::Percentile(counts, 0.999));
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int ticks = argc > 1 ? atoi(argv[1]) : 200000;
+
+	// Cheapest full pass: one constant effect whose forces never change,
+	// so every tick ends in the deduplicated path
+	{
+		SteadyClock clock;
+		NullSink sink;
+		VibrationPort port(0, clock, sink);
+
+		int32_t dir[2] = { 1, 1 };
+		ConstantForce cf = { 5000 };
+		EffectDesc eff = {};
+		eff.dwDuration = EFFECT_INFINITE;
+		eff.dwGain = 10000;
+		eff.cAxes = 2;
+		eff.rglDirection = dir;
+		eff.cbTypeSpecificParams = sizeof(cf);
+		eff.lpvTypeSpecificParams = &cf;
+		uint32_t dwHandle = 0;
+		port.DownloadEffect(EFFECT_CONSTANT, eff, dwHandle, DOWNLOAD_START);
+		port.Tick();
+
+		auto t0 = BenchClock::now();
+		for (int i = 0; i < ticks; i++)
+			port.Tick();
+		double tickNs = NsPer(t0, ticks);
+
+		// What the pass adds: the counter of its outcome, plus one histogram
+		// record per applied command. Consecutive passes are far apart, so
+		// spread the adds over several counters rather than timing the
+		// store-to-load chain of a single one.
+		std::atomic<uint64_t> outcome[8];
+		for (auto& counter : outcome)
+			counter = 0;
+		t0 = BenchClock::now();
+		for (int i = 0; i < ticks; i++)
+			CounterAdd(outcome[i & 7]);
+		double counterNs = NsPer(t0, ticks);
+
+		LatencyHistogram histogram;
+		t0 = BenchClock::now();
+		for (int i = 0; i < ticks; i++)
+			histogram.Record((uint64_t)(i * 7919) & 0xFFFFF);
+		double recordNs = NsPer(t0, ticks);
+
+		printf("idle pass ns %6.1f  counter ns %5.2f (%.2f%%)  histogram record ns %5.2f  [%llu]\n",
+			tickNs, counterNs, 100.0 * counterNs / tickNs, recordNs, (unsigned long long)outcome[0]);
+	}
+
+	// Live port
+	SteadyClock clock;
+	OutputScheduler scheduler(clock);
+	DeviceRegistry registry(clock, scheduler);
+
+	std::unique_ptr<IReportTransport> transport(new FakeTransport(std::chrono::milliseconds(1)));
+	VibrationPort& port = registry.Register(1, 0, std::move(transport));
+
+	int32_t dir[2] = { 1, 1 };
+	uint32_t dwHandle = 0;
+	auto end = BenchClock::now() + std::chrono::seconds(1);
+	for (int i = 0; BenchClock::now() < end; i++) {
+		ConstantForce cf = { -9000 + (i * 997) % 18000 };
+		EffectDesc eff = {};
+		eff.dwDuration = 50000;
+		eff.dwGain = 10000;
+		eff.cAxes = 2;
+		eff.rglDirection = dir;
+		eff.cbTypeSpecificParams = sizeof(cf);
+		eff.lpvTypeSpecificParams = &cf;
+		port.DownloadEffect(EFFECT_CONSTANT, eff, dwHandle, DOWNLOAD_START);
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	std::unique_ptr<PortTelemetry> telemetry(new PortTelemetry());
+	registry.GetTelemetry(1, *telemetry);
+
+	printf("live port  passes %llu  sent %llu  deduplicated %llu  deferred %llu  merged %llu  commands %llu  writes %llu  coalesced %llu\n",
+		(unsigned long long)telemetry->mixPasses, (unsigned long long)telemetry->reportsSent,
+		(unsigned long long)telemetry->reportsDeduplicated, (unsigned long long)telemetry->reportsDeferred,
+		(unsigned long long)telemetry->reportsMerged,
+		(unsigned long long)telemetry->commandsApplied, (unsigned long long)telemetry->writesStarted,
+		(unsigned long long)telemetry->reportsCoalesced);
+	PrintHistogram("call to mix", telemetry->callToMix);
+	PrintHistogram("mix to write", telemetry->mixToWrite);
+	PrintHistogram("write duration", telemetry->writeDuration);
+
+	registry.UnregisterAll();
+	return 0;
+}
@@ -0,0 +1,132 @@
+// Plays short effects through a VibrationPort on a virtual microsecond
+// clock started at several origins: zero, just before the 32-bit
+// millisecond wrap of GetTickCount and just before the 64-bit wrap. The
+// port is serviced only at the times it asks for. Every origin must
+// produce the same reports at the same offsets, and the start/stop edges
+// must land exactly on the requested delays and durations. Exits with 1
+// on a mismatch.
+
+#include "Simulation.h"
+#include <cstdio>
+#include <vector>
+
+using namespace vibration;
+
+namespace {
+
+	struct Report {
+		uint64_t offset;
+		uint8_t forceX;
+		uint8_t forceY;
+
+		bool operator==(const Report& r) const {
+			return offset == r.offset && forceX == r.forceX && forceY == r.forceY;
+		}
+	};
+
+	// Records the reports with their offset from the origin
+	class TraceSink : public IReportSink
+	{
+	public:
+		TraceSink(VirtualClock& clock, uint64_t origin) : clock(clock), origin(origin) {}
+		void SendReport(const uint8_t* buff, size_t /* buffsz */) override {
+			reports.push_back({ clock.Now() - origin, buff[4], buff[3] });
+		}
+
+		VirtualClock& clock;
+		uint64_t origin;
+		std::vector<Report> reports;
+	};
+
+	struct Case {
+		const char* name;
+		uint32_t dwEffectType;
+		uint32_t dwStartDelay;
+		uint32_t dwDuration;
+	};
+
+	const uint64_t ORIGINS[] = {
+		0,
+		(1ull << 32) * 1000 - 7000,
+		0 - 7000ull,
+	};
+
+	std::vector<Report> Play(const Case& c, uint64_t origin) {
+		VirtualClock clock(origin);
+		TraceSink sink(clock, origin);
+		VibrationPort port(0, clock, sink);
+
+		int32_t dir[2] = { 1, 1 };
+		ConstantForce cf = { 10000 };
+		PeriodicForce pf = { 5000, 2000, 0, 10000 };
+		RampForce rf = { 0, 10000 };
+
+		EffectDesc eff = {};
+		eff.dwDuration = c.dwDuration;
+		eff.dwGain = 10000;
+		eff.dwStartDelay = c.dwStartDelay;
+		eff.cAxes = 2;
+		eff.rglDirection = dir;
+		eff.cbTypeSpecificParams = sizeof(cf);
+		eff.lpvTypeSpecificParams = &cf;
+		if (c.dwEffectType == EFFECT_SQUARE) {
+			eff.cbTypeSpecificParams = sizeof(pf);
+			eff.lpvTypeSpecificParams = &pf;
+		}
+		else if (c.dwEffectType == EFFECT_RAMP) {
+			eff.cbTypeSpecificParams = sizeof(rf);
+			eff.lpvTypeSpecificParams = &rf;
+		}
+
+		uint32_t dwHandle = 0;
+		port.DownloadEffect(c.dwEffectType, eff, dwHandle, DOWNLOAD_START);
+
+		uint64_t nextTime;
+		while (port.Service(nextTime) && clock.Now() - origin < 10000000)
+			clock.Set(nextTime);
+
+		return sink.reports;
+	}
+
+	bool Expect(const char* what, uint64_t actual, uint64_t expected) {
+		if (actual == expected)
+			return true;
+
+		printf("  %s at %llu us, expected %llu us\n", what, (unsigned long long)actual, (unsigned long long)expected);
+		return false;
+	}
+
+}
+
+int main()
+{
+	const Case cases[] = {
+		{ "constant 20 ms", EFFECT_CONSTANT, 0, 20000 },
+		{ "constant 20.5 ms", EFFECT_CONSTANT, 0, 20500 },
+		{ "delay 5.25 ms + 20 ms", EFFECT_CONSTANT, 5250, 20000 },
+		{ "square 10 ms x 5", EFFECT_SQUARE, 0, 50000 },
+		{ "ramp 30 ms", EFFECT_RAMP, 1500, 30000 },
+	};
+
+	int failures = 0;
+	for (const Case& c : cases) {
+		std::vector<Report> reference = Play(c, ORIGINS[0]);
+
+		bool ok = !reference.empty()
+			&& Expect("first report", reference.front().offset, c.dwStartDelay)
+			&& Expect("stop report", reference.back().offset, (uint64_t)c.dwStartDelay + c.dwDuration)
+			&& reference.back().forceX == 0 && reference.back().forceY == 0;
+
+		for (uint64_t origin : ORIGINS) {
+			if (Play(c, origin) != reference) {
+				printf("  reports differ from origin %llu\n", (unsigned long long)origin);
+				ok = false;
+			}
+		}
+
+		printf("%-24s reports %3zu  %s\n", c.name, reference.size(), ok ? "ok" : "FAILED");
+		failures += ok ? 0 : 1;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+// Writes an effect trace covering every record type, reads it back and
+// checks each field, including envelopes, directions and custom force
+// samples, a second session appended to the file, records too large for
+// the ring and a truncated record. A burst larger than the ring then
+// checks that every record is either written or counted as dropped.
+//
+//   TraceCheck [file]
+//
+// With a file name the trace is kept, for TraceReplay.
+
+#include "EffectTrace.h"
+#include "Simulation.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace vibration;
+
+namespace {
+
+	int failures = 0;
+
+	void Check(bool ok, const char* what) {
+		if (!ok) {
+			printf("FAIL %s\n", what);
+			failures++;
+		}
+	}
+
+	bool SameDesc(const EffectDesc& a, const EffectDesc& b) {
+		if (a.dwDuration != b.dwDuration || a.dwGain != b.dwGain || a.dwStartDelay != b.dwStartDelay
+			|| a.dwSamplePeriod != b.dwSamplePeriod || a.dwPriority != b.dwPriority || a.cAxes != b.cAxes
+			|| a.cbTypeSpecificParams != b.cbTypeSpecificParams)
+			return false;
+		if (a.cAxes != 0 && memcmp(a.rglDirection, b.rglDirection, a.cAxes * sizeof(int32_t)) != 0)
+			return false;
+		if ((a.lpEnvelope == NULL) != (b.lpEnvelope == NULL)
+			|| (a.lpEnvelope != NULL && memcmp(a.lpEnvelope, b.lpEnvelope, sizeof(Envelope)) != 0))
+			return false;
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "TraceCheck.vbtrace";
+	remove(path);
+
+	VirtualClock clock(5000000000ull);
+
+	int32_t dir[2] = { 1, -1 };
+	Envelope env = { sizeof(Envelope), 2000, 100000, 0, 300000 };
+	ConstantForce constant = { 7000 };
+	EffectDesc constantDesc = { 800000, 10000, 0, 2, dir, sizeof(constant), &constant, &env, 0, 0 };
+
+	PeriodicForce periodic = { 6000, 0, 0, 50000 };
+	EffectDesc periodicDesc = { EFFECT_INFINITE, 8000, 200000, 1, dir, sizeof(periodic), &periodic, NULL, 0, 3 };
+
+	int32_t samples[6] = { 10000, -10000, 5000, -5000, 0, 2500 };
+	CustomForce custom = { 2, 20000, 6, samples };
+	EffectDesc customDesc = { 600000, 10000, 0, 2, dir, sizeof(custom), &custom, NULL, 10000, 0 };
+
+	EffectTraceWriter writer;
+	Check(writer.Open(path, clock), "open");
+	writer.DeviceID(3, true, 1, 125, MIX_SATURATING_SUM);
+	clock.Advance(1500);
+	writer.DownloadEffect(3, EFFECT_CONSTANT, constantDesc, DOWNLOAD_START, 0, 0x10001);
+	clock.Advance(250);
+	writer.DownloadEffect(3, EFFECT_SINE, periodicDesc, 0, 0, 0x10002);
+	writer.StartEffect(3, 0x10002, START_SOLO, 1);
+	writer.DownloadEffect(3, EFFECT_CUSTOM, customDesc, DOWNLOAD_START, 0x10003, 0);
+	clock.Advance(40000);
+	writer.SetGain(3, 5000);
+	writer.Command(3, DEVICE_PAUSE);
+	writer.StopEffect(3, 0x10002);
+	writer.DestroyEffect(3, 0x10001);
+	writer.DeviceID(3, false, 0, 0, 0);
+	writer.Close();
+
+	// Second run of the driver, appended
+	clock.Advance(1000000);
+	Check(writer.Open(path, clock), "reopen");
+	writer.Command(4, DEVICE_STOP_ALL);
+
+	// Counted ahead of the next record that fits, or at Close
+	std::vector<int32_t> many(TRACE_RING_BYTES / sizeof(int32_t) + 1);
+	CustomForce large = { 1, 1000, (uint32_t)many.size(), many.data() };
+	EffectDesc largeDesc = { 600000, 10000, 0, 2, dir, sizeof(large), &large, NULL, 1000, 0 };
+	writer.DownloadEffect(4, EFFECT_CUSTOM, largeDesc, 0, 0, 0x10004);
+	writer.StopEffect(4, 0x10004);
+	writer.DownloadEffect(4, EFFECT_CUSTOM, largeDesc, 0, 0, 0x10005);
+	writer.Close();
+
+	EffectTraceReader reader;
+	Check(reader.Open(path), "read open");
+
+	TraceRecord record;
+	Check(reader.Next(record) && record.type == TRACE_DEVICE_ID && record.time == 5000000000ull && record.dwID == 3
+		&& record.fBegin == 1 && record.dwPort == 1 && record.dwMaxReportRate == 125
+		&& record.dwMixMode == MIX_SATURATING_SUM, "device attach");
+
+	Check(reader.Next(record) && record.type == TRACE_DOWNLOAD_EFFECT && record.time == 5000001500ull
+		&& record.dwEffectType == EFFECT_CONSTANT && record.dwFlags == DOWNLOAD_START && record.dwEffect == 0
+		&& record.dwResult == 0x10001 && SameDesc(record.eff, constantDesc)
+		&& ((const ConstantForce*)record.eff.lpvTypeSpecificParams)->lMagnitude == 7000, "constant download");
+
+	Check(reader.Next(record) && record.type == TRACE_DOWNLOAD_EFFECT && record.dwEffectType == EFFECT_SINE
+		&& SameDesc(record.eff, periodicDesc)
+		&& memcmp(record.eff.lpvTypeSpecificParams, &periodic, sizeof(periodic)) == 0, "periodic download");
+
+	Check(reader.Next(record) && record.type == TRACE_START_EFFECT && record.dwEffect == 0x10002
+		&& record.dwFlags == START_SOLO && record.dwCount == 1, "start");
+
+	bool customOk = reader.Next(record) && record.type == TRACE_DOWNLOAD_EFFECT && record.dwEffect == 0x10003
+		&& record.dwResult == 0 && SameDesc(record.eff, customDesc);
+	if (customOk) {
+		const CustomForce* read = (const CustomForce*)record.eff.lpvTypeSpecificParams;
+		customOk = read->cChannels == 2 && read->dwSamplePeriod == 20000 && read->cSamples == 6
+			&& memcmp(read->rglForceData, samples, sizeof(samples)) == 0;
+	}
+	Check(customOk, "custom download");
+
+	Check(reader.Next(record) && record.type == TRACE_SET_GAIN && record.time == 5000041750ull
+		&& record.dwGain == 5000, "gain");
+	Check(reader.Next(record) && record.type == TRACE_COMMAND && record.dwCommand == DEVICE_PAUSE, "pause");
+	Check(reader.Next(record) && record.type == TRACE_STOP_EFFECT && record.dwEffect == 0x10002, "stop");
+	Check(reader.Next(record) && record.type == TRACE_DESTROY_EFFECT && record.dwEffect == 0x10001, "destroy");
+	Check(reader.Next(record) && record.type == TRACE_DEVICE_ID && record.fBegin == 0, "device detach");
+	Check(reader.Next(record) && record.type == TRACE_SESSION && record.time == 5001041750ull, "second session");
+	Check(reader.Next(record) && record.type == TRACE_COMMAND && record.dwID == 4
+		&& record.dwCommand == DEVICE_STOP_ALL, "stop all");
+	Check(reader.Next(record) && record.type == TRACE_DROPPED && record.dwCount == 1, "dropped");
+	Check(reader.Next(record) && record.type == TRACE_STOP_EFFECT && record.dwEffect == 0x10004, "after dropped");
+	Check(reader.Next(record) && record.type == TRACE_DROPPED && record.dwCount == 1, "dropped at close");
+	Check(!reader.Next(record) && !reader.IsCorrupt(), "end");
+
+	// A record cut short by a crash ends the trace as corrupt
+	{
+		std::ofstream file(path, std::ios_base::binary | std::ios_base::app);
+		const char partial[10] = {};
+		file.write(partial, sizeof(partial));
+	}
+	EffectTraceReader truncated;
+	Check(truncated.Open(path), "truncated open");
+	int records = 0;
+	while (truncated.Next(record))
+		records++;
+	Check(records == 15 && truncated.IsCorrupt(), "truncated");
+
+	// The flusher drains the ring while it fills
+	{
+		const uint32_t BURST = TRACE_RING_BYTES / 8;
+		remove(path);
+		writer.Open(path, clock);
+		for (uint32_t k = 0; k < BURST; k++)
+			writer.StartEffect(5, k, 0, 1);
+		writer.Close();
+
+		EffectTraceReader burst;
+		Check(burst.Open(path), "burst open");
+		uint32_t next = 0;
+		uint64_t accounted = 0;
+		bool ordered = true;
+		while (burst.Next(record)) {
+			if (record.type == TRACE_DROPPED) {
+				accounted += record.dwCount;
+				continue;
+			}
+			ordered = ordered && record.type == TRACE_START_EFFECT && record.dwEffect >= next;
+			next = record.dwEffect + 1;
+			accounted++;
+		}
+		Check(!burst.IsCorrupt() && ordered && accounted == BURST, "burst");
+	}
+
+	if (argc > 1) {
+		// Kept for TraceReplay, without the truncated record
+		remove(path);
+		writer.Open(path, clock);
+		writer.DeviceID(3, true, 1, 125, MIX_MAX);
+		clock.Advance(1500);
+		writer.DownloadEffect(3, EFFECT_CONSTANT, constantDesc, DOWNLOAD_START, 0, 0x10001);
+		clock.Advance(250);
+		writer.DownloadEffect(3, EFFECT_SINE, periodicDesc, 0, 0, 0x10002);
+		writer.StartEffect(3, 0x10002, 0, 1);
+		writer.DownloadEffect(3, EFFECT_CUSTOM, customDesc, DOWNLOAD_START, 0, 0x10003);
+		clock.Advance(400000);
+		writer.SetGain(3, 5000);
+		clock.Advance(200000);
+		writer.Command(3, DEVICE_PAUSE);
+		clock.Advance(100000);
+		writer.Command(3, DEVICE_CONTINUE);
+		clock.Advance(300000);
+		writer.StopEffect(3, 0x10002);
+		writer.Close();
+	}
+	else {
+		remove(path);
+	}
+
+	printf("%s\n", failures == 0 ? "ok" : "FAILED");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Prints a BinaryLog file as text, one line per record. Records of each
+// session are sorted by time, since the flusher writes them thread by
+// thread; --unsorted keeps the file order.
+//
+//   LogDecode <file> [--unsorted]
+
+#include "BinaryLog.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <vector>
+
+using namespace vibration;
+
+namespace {
+
+	const char LEVEL_NAMES[] = { '-', 'E', 'I', 'T' };
+
+	struct Session {
+		uint64_t time;
+		uint64_t wall;
+	};
+
+	void PrintTime(const Session& session, uint64_t time) {
+		uint64_t wall = session.wall + TimeDiff(time, session.time);
+		time_t seconds = (time_t)(wall / 1000000);
+		const tm* utc = gmtime(&seconds);
+
+		char text[32];
+		strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", utc);
+		printf("%s.%06u", text, (unsigned)(wall % 1000000));
+	}
+
+	void PrintRecord(const Session& session, const LogRecord& record) {
+		const LogEventFormat& format = GetLogEventFormat(record.event);
+
+		PrintTime(session, record.time);
+		printf("  %c  %6u  %s", record.level < sizeof(LEVEL_NAMES) ? LEVEL_NAMES[record.level] : '?',
+			record.thread, format.name);
+
+		// The wall clock is already in the time column
+		uint32_t count = record.argCount < LOG_MAX_ARGS ? record.argCount : LOG_MAX_ARGS;
+		if (record.event == LOG_SESSION)
+			count = 2;
+
+		for (uint32_t k = 0; k < count; k++) {
+			if (record.event == LOG_CALL_FAILED && k == 0)
+				printf(" %s", GetLogEventFormat((uint16_t)record.args[0]).name);
+			else if (record.event == LOG_DROPPED || record.event == LOG_SESSION)
+				printf(" %s=%u", format.args[k], record.args[k]);
+			else
+				printf(" %s=0x%04x", format.args[k], record.args[k]);
+		}
+		printf("\n");
+	}
+
+	void PrintSession(const Session& session, std::vector<LogRecord>& records, bool sorted) {
+		if (sorted) {
+			std::stable_sort(records.begin(), records.end(), [](const LogRecord& a, const LogRecord& b) {
+				return TimeDiff(a.time, b.time) < 0;
+			});
+		}
+
+		for (const LogRecord& record : records)
+			PrintRecord(session, record);
+		records.clear();
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <file> [--unsorted]\n", argv[0]);
+		return 2;
+	}
+	bool sorted = !(argc > 2 && strcmp(argv[2], "--unsorted") == 0);
+
+	std::ifstream file(argv[1], std::ios_base::binary);
+	if (!file.is_open()) {
+		fprintf(stderr, "cannot open %s\n", argv[1]);
+		return 1;
+	}
+
+	Session session = {};
+	bool hasSession = false;
+	std::vector<LogRecord> records;
+
+	LogRecord record;
+	while (file.read((char*)&record, sizeof(record))) {
+		if (record.event == LOG_SESSION) {
+			if (record.args[0] != LOG_MAGIC || record.args[1] != LOG_FORMAT_VERSION) {
+				fprintf(stderr, "%s: not a version %u log\n", argv[1], LOG_FORMAT_VERSION);
+				return 1;
+			}
+
+			if (hasSession)
+				PrintSession(session, records, sorted);
+
+			session.time = record.time;
+			session.wall = record.args[2] | (uint64_t)record.args[3] << 32;
+			hasSession = true;
+			PrintRecord(session, record);
+			continue;
+		}
+
+		if (!hasSession) {
+			fprintf(stderr, "%s: not a log file\n", argv[1]);
+			return 1;
+		}
+		records.push_back(record);
+	}
+
+	if (hasSession)
+		PrintSession(session, records, sorted);
+
+	if (file.gcount() != 0)
+		fprintf(stderr, "%s: %u trailing bytes\n", argv[1], (unsigned)file.gcount());
+	return 0;
+}
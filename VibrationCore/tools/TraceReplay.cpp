@@ -0,0 +1,285 @@
+// Replays an effect trace recorded by the driver (TracePath, EffectTrace.h)
+// through VibrationPort on a virtual clock and prints every report sent,
+// with its time from the start of the trace. The output only depends on
+// the trace, so two runs can be diffed. Each call is serviced as soon as
+// it is made, as the OutputScheduler does.
+//
+//   TraceReplay <trace> [--quiet] [--tail ms]
+//
+// --quiet only prints the summary; --tail keeps mixing after the last call
+// (1000 ms by default) so that the effects it started play out.
+
+#include "EffectTrace.h"
+#include "Simulation.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+using namespace vibration;
+
+namespace {
+
+	class PrintSink : public IReportSink
+	{
+	public:
+		PrintSink(IClock& clock, uint64_t& origin, bool quiet, uint32_t dwID)
+			: clock(clock), origin(origin), quiet(quiet), dwID(dwID), reports(0) {}
+
+		void SendReport(const uint8_t* buff, size_t buffsz) override {
+			reports++;
+			if (quiet)
+				return;
+
+			uint64_t time = clock.Now() - origin;
+			printf("%10llu.%03u  id %u ", (unsigned long long)(time / 1000), (unsigned)(time % 1000), dwID);
+			for (size_t k = 0; k < buffsz; k++)
+				printf(" %02x", buff[k]);
+			printf("\n");
+		}
+
+		uint64_t GetReportCount() const { return reports; }
+
+	private:
+		IClock& clock;
+		uint64_t& origin;
+		bool quiet;
+		uint32_t dwID;
+		uint64_t reports;
+	};
+
+	// The port belongs to the simulation and is removed before the sink
+	struct ReplayPort {
+		std::unique_ptr<PrintSink> sink;
+		VibrationPort* port;
+
+		// Recorded handle to the handle of the replay
+		std::unordered_map<uint32_t, uint32_t> handles;
+	};
+
+	class Replay
+	{
+	public:
+		Replay(bool quiet) : quiet(quiet), origin(0), started(false), reports(0), divergences(0), dropped(0) {}
+		~Replay() { DetachAll(); }
+
+		void Apply(const TraceRecord& record) {
+			if (!started) {
+				origin = record.time;
+				started = true;
+			}
+			AdvanceTo(record.time);
+
+			if (record.type == TRACE_SESSION) {
+				// Another run of the driver
+				DetachAll();
+				return;
+			}
+
+			if (record.type == TRACE_DROPPED) {
+				// The driver could not keep up with the calls
+				dropped += record.dwCount;
+				return;
+			}
+
+			if (record.type == TRACE_DEVICE_ID) {
+				if (record.fBegin)
+					Attach(record);
+				else
+					Detach(record.dwID);
+				return;
+			}
+
+			auto it = ports.find(record.dwID);
+			if (it == ports.end())
+				return;
+
+			ReplayPort& rp = it->second;
+			Call(rp, record);
+			sim.Sync(*rp.port);
+		}
+
+		// Services each port at its start/stop times up to time
+		void AdvanceTo(uint64_t time) {
+			sim.AdvanceTo(time);
+		}
+
+		void DetachAll() {
+			while (!ports.empty())
+				Detach(ports.begin()->first);
+		}
+
+		uint64_t GetTime() { return sim.Now() - origin; }
+		uint64_t GetReportCount() const { return reports; }
+		uint64_t GetDivergenceCount() const { return divergences; }
+		uint64_t GetDroppedCount() const { return dropped; }
+
+	private:
+		void Attach(const TraceRecord& record) {
+			Detach(record.dwID);
+
+			ReplayPort& rp = ports[record.dwID];
+			rp.sink.reset(new PrintSink(sim.GetClock(), origin, quiet, record.dwID));
+			rp.port = &sim.AddPort(record.dwPort, *rp.sink);
+			rp.port->SetMaxReportRate(record.dwMaxReportRate);
+			rp.port->SetMixMode((uint8_t)record.dwMixMode);
+			sim.Sync(*rp.port);
+		}
+
+		void Detach(uint32_t dwID) {
+			auto it = ports.find(dwID);
+			if (it == ports.end())
+				return;
+
+			sim.RemovePort(*it->second.port);
+			reports += it->second.sink->GetReportCount();
+			ports.erase(it);
+		}
+
+		uint32_t MapHandle(ReplayPort& rp, uint32_t dwEffect) {
+			auto it = rp.handles.find(dwEffect);
+			if (it == rp.handles.end() || !rp.port->IsEffectHandle(it->second))
+				return 0;
+			return it->second;
+		}
+
+		// Same checks as VibrationController
+		void Call(ReplayPort& rp, const TraceRecord& record) {
+			VibrationPort& port = *rp.port;
+
+			switch (record.type) {
+			case TRACE_DOWNLOAD_EFFECT: {
+				uint32_t dwHandle = record.dwEffect != 0 ? MapHandle(rp, record.dwEffect) : 0;
+				bool downloaded = port.DownloadEffect(record.dwEffectType, record.eff, dwHandle, record.dwFlags);
+
+				if (downloaded != (record.dwResult != 0)) {
+					divergences++;
+					fprintf(stderr, "download of effect 0x%x on id %u %s in the trace but %s here\n", record.dwEffect,
+						record.dwID, record.dwResult != 0 ? "succeeded" : "failed", downloaded ? "succeeded" : "failed");
+				}
+				if (downloaded && record.dwResult != 0)
+					rp.handles[record.dwResult] = dwHandle;
+				break;
+			}
+
+			case TRACE_START_EFFECT: {
+				uint32_t dwHandle = MapHandle(rp, record.dwEffect);
+				if (dwHandle != 0)
+					port.StartEffect(dwHandle, record.dwFlags & START_SOLO, record.dwCount);
+				break;
+			}
+
+			case TRACE_STOP_EFFECT: {
+				uint32_t dwHandle = MapHandle(rp, record.dwEffect);
+				if (dwHandle != 0)
+					port.StopEffect(dwHandle);
+				break;
+			}
+
+			case TRACE_DESTROY_EFFECT: {
+				uint32_t dwHandle = MapHandle(rp, record.dwEffect);
+				if (dwHandle != 0)
+					port.DestroyEffect(dwHandle);
+				rp.handles.erase(record.dwEffect);
+				break;
+			}
+
+			case TRACE_COMMAND:
+				switch (record.dwCommand) {
+				case DEVICE_RESET:
+					port.Reset();
+					break;
+				case DEVICE_STOP_ALL:
+					port.StopAllEffects();
+					break;
+				case DEVICE_PAUSE:
+					port.Pause();
+					break;
+				case DEVICE_CONTINUE:
+					port.Continue();
+					break;
+				case DEVICE_ACTUATORS_ON:
+					port.SetActuators(true);
+					break;
+				case DEVICE_ACTUATORS_OFF:
+					port.SetActuators(false);
+					break;
+				}
+				break;
+
+			case TRACE_SET_GAIN:
+				port.SetGain(record.dwGain);
+				break;
+			}
+		}
+
+		bool quiet;
+		Simulation sim;
+		uint64_t origin;
+		bool started;
+		std::map<uint32_t, ReplayPort> ports;
+		uint64_t reports;
+		uint64_t divergences;
+		uint64_t dropped;
+	};
+
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = NULL;
+	bool quiet = false;
+	uint64_t tail = 1000;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--quiet") == 0)
+			quiet = true;
+		else if (strcmp(argv[i], "--tail") == 0 && i + 1 < argc)
+			tail = strtoull(argv[++i], NULL, 10);
+		else
+			path = argv[i];
+	}
+
+	if (path == NULL) {
+		fprintf(stderr, "usage: %s <trace> [--quiet] [--tail ms]\n", argv[0]);
+		return 2;
+	}
+
+	EffectTraceReader reader;
+	if (!reader.Open(path)) {
+		fprintf(stderr, "%s: not a version %u effect trace\n", path, TRACE_FORMAT_VERSION);
+		return 1;
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	Replay replay(quiet);
+	TraceRecord record;
+	uint64_t records = 0;
+	uint64_t lastTime = 0;
+	while (reader.Next(record)) {
+		replay.Apply(record);
+		lastTime = record.time;
+		records++;
+	}
+
+	if (reader.IsCorrupt())
+		fprintf(stderr, "%s: malformed record after %llu records, replay stopped there\n", path, (unsigned long long)records);
+	if (replay.GetDroppedCount() != 0)
+		fprintf(stderr, "%s: %llu calls were not recorded, the replay may diverge after them\n", path,
+			(unsigned long long)replay.GetDroppedCount());
+
+	replay.AdvanceTo(lastTime + tail * 1000);
+	uint64_t span = replay.GetTime();
+	replay.DetachAll();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	fprintf(stderr, "%llu records, %llu reports, %.3f s of trace replayed in %.3f s (%.0fx), %llu divergences\n",
+		(unsigned long long)records, (unsigned long long)replay.GetReportCount(), span / 1e6, seconds,
+		seconds > 0 ? span / 1e6 / seconds : 0.0, (unsigned long long)replay.GetDivergenceCount());
+
+	return reader.IsCorrupt() || replay.GetDivergenceCount() != 0 ? 1 : 0;
+}